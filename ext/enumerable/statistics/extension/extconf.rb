@@ -14,4 +14,9 @@ have_func('rb_complex_plus')
 have_func('rb_complex_div')
 have_func('rb_dbl_complex_new')
 
+have_func('rb_arithmetic_sequence_extract')
+have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
+have_func('pthread_create', 'pthread.h')
+have_header('ruby/ractor.h')
+
 create_makefile('enumerable/statistics/extension')
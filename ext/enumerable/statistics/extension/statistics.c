@@ -1,7 +1,18 @@
 #include <ruby/ruby.h>
 #include <ruby/util.h>
 #include <ruby/version.h>
+#ifdef HAVE_RUBY_RACTOR_H
+# include <ruby/ractor.h>
+#endif
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+# include <ruby/thread.h>
+#endif
+#ifdef HAVE_PTHREAD_CREATE
+# include <pthread.h>
+# include <signal.h>
+#endif
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 
 #if RUBY_API_VERSION_CODE >= 20400
@@ -96,11 +107,19 @@ static VALUE half_in_rational;
 static ID idPow, idPLUS, idMINUS, idSTAR, idDIV, idGE;
 static ID id_eqeq_p, id_idiv, id_negate, id_to_f, id_cmp, id_nan_p;
 static ID id_each, id_real_p, id_sum, id_population, id_closed, id_edge;
-static ID id_skip_na;
+static ID id_skip_na, id_upto, id_percentiles, id_size, id_last, id_fdiv;
+static ID id_normalize, id_sort, id_ascending, id_dropna, id_weights, id_edges;
+static ID id_key, id_index, id_aref;
+static ID id_by, id_value, id_stats, id_call;
+static ID id_count, id_mean, id_variance, id_stdev, id_min, id_max;
+static ID id_min_periods, id_alpha, id_halflife, id_span;
+static ID id_exact, id_quo, id_to_r;
+static ID id_bit_length, id_lshift, id_rshift, id_divmod, id_odd_p;
+static ID id_algorithm, id_kahan, id_pairwise, id_validity;
 
 static VALUE sym_auto, sym_left, sym_right, sym_sturges;
 
-static VALUE cHistogram;
+static VALUE cHistogram, cSummary, cNumericBuffer, cEWMAccumulator;
 
 static VALUE orig_enum_sum, orig_ary_sum;
 
@@ -361,6 +380,27 @@ rb_int_ge(VALUE x, VALUE y)
 }
 #endif
 
+inline static long
+i_gcd(long x, long y)
+{
+  if (x < 0)
+    x = -x;
+  if (y < 0)
+    y = -y;
+
+  if (x == 0)
+    return y;
+  if (y == 0)
+    return x;
+
+  while (x > 0) {
+    long t = x;
+    x = y % x;
+    y = t;
+  }
+  return y;
+}
+
 #ifndef HAVE_RB_RATIONAL_PLUS
 # define ZERO INT2FIX(0)
 # define ONE  INT2FIX(1)
@@ -420,27 +460,6 @@ f_to_f(VALUE x)
   return rb_funcall(x, id_to_f, 0);
 }
 
-inline static long
-i_gcd(long x, long y)
-{
-  if (x < 0)
-    x = -x;
-  if (y < 0)
-    y = -y;
-
-  if (x == 0)
-    return y;
-  if (y == 0)
-    return x;
-
-  while (x > 0) {
-    long t = x;
-    x = y % x;
-    y = t;
-  }
-  return y;
-}
-
 inline static VALUE
 f_imul(long a, long b)
 {
@@ -637,1885 +656,8226 @@ rb_rational_plus(VALUE self, VALUE other)
 }
 #endif
 
+/* NA detection
+ *
+ * nil, NaN, and the objects whose `nan?` returns true are NA values.
+ *
+ * How to test the values of a class is cached in struct na_cache while a
+ * collection is scanned, so that `nan?` is looked up only when the class of
+ * the values changes.  Float values are tested by isnan() unless `Float#nan?`
+ * is redefined, and `nan?` is not called at all for the classes that do not
+ * respond to it, such as Integer and Rational. */
+
+enum na_check {
+  NA_CHECK_NONE,  /* never NA because the class does not respond to nan? */
+  NA_CHECK_FLOAT, /* NaN is the only NA because Float#nan? is not redefined */
+  NA_CHECK_CALL   /* nan? must be called */
+};
+
+struct na_cache {
+  VALUE klass;
+  enum na_check check;
+};
+
+static inline void
+na_cache_init(struct na_cache *cache)
+{
+  cache->klass = Qundef;
+  cache->check = NA_CHECK_CALL;
+}
+
+static enum na_check
+na_check_of(VALUE v)
+{
+  if (!rb_respond_to(v, id_nan_p))
+    return NA_CHECK_NONE;
+  if (RB_FLOAT_TYPE_P(v) && rb_method_basic_definition_p(rb_cFloat, id_nan_p))
+    return NA_CHECK_FLOAT;
+  return NA_CHECK_CALL;
+}
+
 static inline int
-is_na(VALUE v)
+is_na_cached(VALUE v, struct na_cache *cache)
 {
+  VALUE klass;
+
   if (NIL_P(v))
     return 1;
 
   if (RB_FLOAT_TYPE_P(v) && isnan(RFLOAT_VALUE(v)))
     return 1;
 
-  if (rb_respond_to(v, id_nan_p) && RTEST(rb_funcall(v, id_nan_p, 0)))
+  klass = CLASS_OF(v);
+  if (klass != cache->klass) {
+    cache->klass = klass;
+    cache->check = na_check_of(v);
+  }
+
+  if (cache->check == NA_CHECK_CALL && RTEST(rb_funcall(v, id_nan_p, 0)))
     return 1;
 
   return 0;
 }
 
-static int opt_skip_na(VALUE opts)
+static inline int
+is_na(VALUE v)
 {
-  VALUE skip_na = Qfalse;
-
-  if (!NIL_P(opts)) {
-#ifdef HAVE_RB_GET_KWARGS
-    ID kwargs = id_skip_na;
-    rb_get_kwargs(opts, &kwargs, 0, 1, &skip_na);
-#else
-    VALUE val = rb_hash_aref(opts, ID2SYM(id_skip_na));
-    skip_na = NIL_P(val) ? skip_na : val;
-#endif
-  }
+  struct na_cache cache;
 
-  return RTEST(skip_na);
+  na_cache_init(&cache);
+  return is_na_cached(v, &cache);
 }
 
-VALUE
-ary_calculate_sum(VALUE ary, VALUE init, int skip_na, long *na_count_out)
+/* Classify the values in ary at once, and return a mask whose i-th byte
+ * is nonzero if the i-th value is NA, or nil if ary has no NA value.
+ * The mask is a hidden String as the native buffers, and its length is
+ * the number of the classified values.  The number of NA values is
+ * stored in *na_count_ptr. */
+static VALUE
+ary_na_mask(VALUE ary, long *na_count_ptr)
 {
-  VALUE e, v, r;
-  long i, n;
-  int block_given;
-  long na_count = 0;
-
-  block_given = rb_block_given_p();
+  struct na_cache cache;
+  VALUE mask;
+  char *p;
+  long i, na_count = 0;
 
-  if (RARRAY_LEN(ary) == 0) {
-    if (na_count_out != NULL) {
-      *na_count_out = 0;
-    }
-    return init;
+  na_cache_init(&cache);
+  for (i = 0; i < RARRAY_LEN(ary); ++i) {
+    if (is_na_cached(RARRAY_AREF(ary, i), &cache))
+      break;
+  }
+  if (i == RARRAY_LEN(ary)) {
+    *na_count_ptr = 0;
+    return Qnil;
   }
 
-  n = 0;
-  r = Qundef;
-  v = init;
-  for (i = 0; i < RARRAY_LEN(ary); i++) {
-    e = RARRAY_AREF(ary, i);
-    if (block_given)
-      e = rb_yield(e);
-    if (skip_na && is_na(e)) {
-      ++na_count;
-      continue;
-    }
-
-    if (FIXNUM_P(e)) {
-      n += FIX2LONG(e); /* should not overflow long type */
-      if (!FIXABLE(n)) {
-        v = rb_big_plus(LONG2NUM(n), v);
-        n = 0;
-      }
-    }
-    else if (RB_TYPE_P(e, T_BIGNUM))
-      v = rb_big_plus(e, v);
-    else if (RB_TYPE_P(e, T_RATIONAL)) {
-      if (r == Qundef)
-        r = e;
-      else
-        r = rb_rational_plus(r, e);
-    }
-    else
-      goto not_exact;
+  mask = rb_str_tmp_new(RARRAY_LEN(ary));
+  p = RSTRING_PTR(mask);
+  memset(p, 0, i);
+  p[i] = 1;
+  na_count = 1;
+  for (++i; i < RARRAY_LEN(ary) && i < RSTRING_LEN(mask); ++i) {
+    p[i] = (char)is_na_cached(RARRAY_AREF(ary, i), &cache);
+    na_count += p[i];
   }
+  rb_str_set_len(mask, i);
 
-  if (n != 0)
-    v = rb_fix_plus(LONG2FIX(n), v);
-  if (r != Qundef)
-    v = rb_rational_plus(r, v);
-  goto finish;
+  *na_count_ptr = na_count;
+  return mask;
+}
 
-not_exact:
-  if (n != 0)
-    v = rb_fix_plus(LONG2FIX(n), v);
-  if (r != Qundef)
-    v = rb_rational_plus(r, v);
+static inline double
+value_to_dbl(VALUE e)
+{
+  if (RB_FLOAT_TYPE_P(e))
+    return RFLOAT_VALUE(e);
+  else if (FIXNUM_P(e))
+    return FIX2LONG(e);
+  else if (RB_TYPE_P(e, T_BIGNUM))
+    return rb_big2dbl(e);
+  else
+    return rb_num2dbl(e);
+}
 
-  if (RB_FLOAT_TYPE_P(e)) {
-    /* Kahan's compensated summation algorithm */
-    double f, c;
+/* A native accumulator of Integer values.
+ *
+ * Fixnum values, and Bignum values that fit in it, are added natively.
+ * The accumulated value is spilled into a Ruby Integer only when it grows
+ * beyond WIDE_INT_LIMIT, so that no Bignum is allocated for each value
+ * even after the sum overflows Fixnum. */
+
+/* The square of a long value in [-LONG_SQUARE_MAX, LONG_SQUARE_MAX] fits in long. */
+#define LONG_SQUARE_MAX (1L << (sizeof(long) * CHAR_BIT / 2 - 1))
+
+#ifdef HAVE_INT128_T
+typedef int128_t wide_int;
+# define WIDE_INT_LIMIT (((int128_t)1) << 125)
+/* The square of any Fixnum value is less than WIDE_INT_LIMIT. */
+# define WIDE_INT_SQUARE_MAX FIXNUM_MAX
+# define WIDE_INT_PACK_FLAGS \
+  (INTEGER_PACK_LSWORD_FIRST | INTEGER_PACK_NATIVE_BYTE_ORDER | INTEGER_PACK_2COMP)
+#else
+typedef long wide_int;
+# define WIDE_INT_LIMIT FIXNUM_MAX
+# define WIDE_INT_SQUARE_MAX LONG_SQUARE_MAX
+#endif
 
-    f = NUM2DBL(v);
-    c = 0.0;
-    goto has_float_value;
-    for (; i < RARRAY_LEN(ary); i++) {
-      double x, y, t;
-      e = RARRAY_AREF(ary, i);
-      if (block_given)
-        e = rb_yield(e);
-      if (skip_na && is_na(e)) {
-        ++na_count;
-        continue;
-      }
+#define WIDE_INT_SPILL_P(w) ((w) > WIDE_INT_LIMIT || (w) < -WIDE_INT_LIMIT)
 
-      if (RB_FLOAT_TYPE_P(e))
-        has_float_value:
-          x = RFLOAT_VALUE(e);
-      else if (FIXNUM_P(e))
-        x = FIX2LONG(e);
-      else if (RB_TYPE_P(e, T_BIGNUM))
-        x = rb_big2dbl(e);
-      else if (RB_TYPE_P(e, T_RATIONAL))
-        x = rb_num2dbl(e);
-      else
-        goto not_float;
+static VALUE
+wide_int_to_num(wide_int w)
+{
+#ifdef HAVE_INT128_T
+  if (w < LONG_MIN || LONG_MAX < w) {
+    return rb_integer_unpack(&w, 1, sizeof(w), 0, WIDE_INT_PACK_FLAGS);
+  }
+#endif
+  return LONG2NUM((long)w);
+}
 
-      y = x - c;
-      t = f + y;
-      c = (t - f) - y;
-      f = t;
+/* Add the Integer e to the accumulator *w, spilling it into *v if needed. */
+static inline void
+wide_int_add(wide_int *w, VALUE *v, VALUE e)
+{
+  if (FIXNUM_P(e)) {
+    *w += FIX2LONG(e);
+  }
+  else {
+#ifdef HAVE_INT128_T
+    int128_t x;
+    int const sign = rb_integer_pack(e, &x, 1, sizeof(x), 0, WIDE_INT_PACK_FLAGS);
+    if (-2 < sign && sign < 2 && !WIDE_INT_SPILL_P(x)) {
+      *w += x;
     }
+    else
+#endif
+    {
+      *v = rb_big_plus(e, *v);
+      return;
+    }
+  }
 
-    v = DBL2NUM(f);
-    goto finish;
-
-  not_float:
-    v = DBL2NUM(f);
+  if (WIDE_INT_SPILL_P(*w)) {
+    *v = rb_int_plus(wide_int_to_num(*w), *v);
+    *w = 0;
   }
+}
 
-  goto has_some_value;
-  for (; i < RARRAY_LEN(ary); i++) {
-    e = RARRAY_AREF(ary, i);
-    if (block_given)
-      e = rb_yield(e);
-    if (skip_na && is_na(e)) {
-      ++na_count;
-      continue;
+/* Add the square of the Integer e to the accumulator *w,
+ * spilling it into *v if needed. */
+static inline void
+wide_int_add_square(wide_int *w, VALUE *v, VALUE e)
+{
+  if (FIXNUM_P(e)) {
+    long const x = FIX2LONG(e);
+    if (-WIDE_INT_SQUARE_MAX <= x && x <= WIDE_INT_SQUARE_MAX) {
+      *w += (wide_int)x * x;
+      if (WIDE_INT_SPILL_P(*w)) {
+        *v = rb_int_plus(wide_int_to_num(*w), *v);
+        *w = 0;
+      }
+      return;
     }
-  has_some_value:
-    v = rb_funcall(v, idPLUS, 1, e);
+    e = rb_int2big(x);
   }
+  *v = rb_int_plus(rb_big_mul(e, e), *v);
+}
 
-finish:
-  if (na_count_out != NULL) {
-    *na_count_out = na_count;
-  }
-  return v;
+/* Return the sum of the accumulator w and v. */
+static inline VALUE
+wide_int_flush(wide_int w, VALUE v)
+{
+  if (w == 0)
+    return v;
+  return rb_int_plus(wide_int_to_num(w), v);
 }
 
-/* call-seq:
- *    ary.sum(skip_na: false)
- *
- * Calculate the sum of the values in `ary`.
- * This method utilizes
- * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
- * to compensate the result precision when the `ary` includes Float values.
- *
- * Note that This library does not redefine `sum` method introduced in Ruby 2.4.
+/* A native accumulator of Rational values.
  *
- * @return [Number] A summation value
- */
-static VALUE
-ary_sum(int argc, VALUE* argv, VALUE ary)
+ * Rational values with Fixnum numerators and denominators are added to
+ * num/den natively, where den is a common multiple of their denominators,
+ * so that no Rational is allocated and no gcd is calculated for each value
+ * when the denominators are the same.  The fraction is reduced only when
+ * it overflows, and it is spilled into a Ruby Rational if it still does
+ * not fit.  The result is normalized by rb_rational_new at the end,
+ * so it is the same as the one of rb_rational_plus. */
+
+struct rational_acc {
+  wide_int num;
+  long den; /* 0 while nothing is accumulated */
+};
+
+static inline void
+rational_acc_init(struct rational_acc *acc)
 {
-  VALUE v, opts;
-  int skip_na;
+  acc->num = 0;
+  acc->den = 0;
+}
 
-  if (rb_scan_args(argc, argv, "01:", &v, &opts) == 0) {
-    v = LONG2FIX(0);
-  }
-  skip_na = opt_skip_na(opts);
+static VALUE
+rational_acc_to_num(const struct rational_acc *acc)
+{
+  return rb_rational_new(wide_int_to_num(acc->num), LONG2NUM(acc->den));
+}
 
-#ifndef HAVE_ENUM_SUM
-  if (!skip_na) {
-    return rb_funcall(orig_ary_sum, rb_intern("call"), argc, &v);
-  }
-#endif
+/* Reduce the fraction in acc, and return whether it is changed. */
+static int
+rational_acc_reduce(struct rational_acc *acc)
+{
+  long const g = i_gcd((long)(acc->num % acc->den), acc->den);
 
-  return ary_calculate_sum(ary, v, skip_na, NULL);
+  if (g <= 1)
+    return 0;
+  acc->num /= g;
+  acc->den /= g;
+  return 1;
 }
 
 static void
-calculate_and_set_mean(VALUE *mean_ptr, VALUE sum, long const n)
+rational_acc_spill(struct rational_acc *acc, VALUE *r)
 {
-  if (RB_TYPE_P(sum, T_COMPLEX)) {
-    VALUE real_mean, imag_mean;
-    VALUE const real = RCOMPLEX(sum)->real;
-    VALUE const imag = RCOMPLEX(sum)->imag;
+  VALUE const x = rational_acc_to_num(acc);
 
-    if (RB_FLOAT_TYPE_P(real))
-      real_mean = DBL2NUM(RFLOAT_VALUE(real) / n);
-    else
-      real_mean = rb_funcall(real, idDIV, 1, DBL2NUM(n));
+  *r = (*r == Qundef) ? x : rb_rational_plus(*r, x);
+  rational_acc_init(acc);
+}
 
-    if (RB_FLOAT_TYPE_P(imag))
-      imag_mean = DBL2NUM(RFLOAT_VALUE(imag) / n);
-    else
-      imag_mean = rb_funcall(imag, idDIV, 1, DBL2NUM(n));
+/* Add a/b to acc, spilling it into *r if needed.  b must be positive. */
+static void
+rational_acc_add_parts(struct rational_acc *acc, VALUE *r, long a, long b)
+{
+  int reduced = 0;
+  long g, m, k;
 
-    SET_MEAN(complex_new(CLASS_OF(sum), real_mean, imag_mean));
+  if (acc->den == 0) {
+    acc->num = a;
+    acc->den = b;
+    return;
   }
-  else if (RB_FLOAT_TYPE_P(sum)) {
-    SET_MEAN(DBL2NUM(RFLOAT_VALUE(sum) / n));
+
+retry:
+  if (acc->den == b) {
+    acc->num += a;
   }
-  else
-    SET_MEAN(rb_funcall(sum, idDIV, 1, DBL2NUM(n)));
+  else if (acc->den % b == 0) {
+    /* b divides den, as it does after den covers all the denominators */
+    k = acc->den / b;
+    if (a > WIDE_INT_LIMIT / k || a < -(WIDE_INT_LIMIT / k)) {
+      rational_acc_spill(acc, r);
+      acc->num = a;
+      acc->den = b;
+      return;
+    }
+    acc->num += (wide_int)a * k;
+  }
+  else {
+    g = i_gcd(acc->den, b);
+    m = b / g;
+    k = acc->den / g;
+    /* m and k are positive */
+    if (acc->den > LONG_MAX / m ||
+        acc->num > WIDE_INT_LIMIT / m || acc->num < -(WIDE_INT_LIMIT / m) ||
+        a > WIDE_INT_LIMIT / k || a < -(WIDE_INT_LIMIT / k)) {
+      if (!reduced && (reduced = rational_acc_reduce(acc)))
+        goto retry;
+      rational_acc_spill(acc, r);
+      acc->num = a;
+      acc->den = b;
+      return;
+    }
+    acc->num = acc->num * m + (wide_int)a * k;
+    acc->den *= m;
+  }
+
+  if (WIDE_INT_SPILL_P(acc->num))
+    rational_acc_spill(acc, r);
 }
 
-static void
-ary_mean_variance(VALUE ary, VALUE *mean_ptr, VALUE *variance_ptr, size_t ddof, int skip_na)
+/* Add the Rational e to acc, spilling it into *r if needed. */
+static inline void
+rational_acc_add(struct rational_acc *acc, VALUE *r, VALUE e)
 {
-  long i;
-  long na_count;
-  size_t n = 0;
-  double m = 0.0, m2 = 0.0, f = 0.0, c = 0.0;
+  VALUE const num = rb_rational_num(e), den = rb_rational_den(e);
 
-  SET_MEAN(DBL2NUM(0));
-  SET_VARIANCE(DBL2NUM(NAN));
+  if (FIXNUM_P(num) && FIXNUM_P(den))
+    rational_acc_add_parts(acc, r, FIX2LONG(num), FIX2LONG(den));
+  else
+    *r = (*r == Qundef) ? e : rb_rational_plus(*r, e);
+}
 
-  if (RARRAY_LEN(ary) == 0)
-    return;
-  else if (RARRAY_LEN(ary) == 1) {
-    VALUE e = RARRAY_AREF(ary, 0);
-    if (rb_block_given_p())
-      e = rb_yield(e);
-    if (RB_TYPE_P(e, T_COMPLEX))
-      SET_MEAN(e);
-    else {
-      e = rb_Float(e);
-      SET_MEAN(e);
+/* Add the square of the Rational e to acc, spilling it into *r if needed. */
+static inline void
+rational_acc_add_square(struct rational_acc *acc, VALUE *r, VALUE e)
+{
+  VALUE const num = rb_rational_num(e), den = rb_rational_den(e);
+
+  if (FIXNUM_P(num) && FIXNUM_P(den)) {
+    long const a = FIX2LONG(num), b = FIX2LONG(den);
+    if (-LONG_SQUARE_MAX <= a && a <= LONG_SQUARE_MAX && b <= LONG_SQUARE_MAX) {
+      rational_acc_add_parts(acc, r, a * a, b * b);
+      return;
     }
-    return;
   }
+  e = rb_funcall(e, idSTAR, 1, e);
+  *r = (*r == Qundef) ? e : rb_rational_plus(*r, e);
+}
 
-  if (variance_ptr == NULL) {
-    VALUE init = DBL2NUM(0.0);
-    VALUE const sum = ary_calculate_sum(ary, init, skip_na, &na_count);
-    long const n = RARRAY_LEN(ary) - na_count;
-    calculate_and_set_mean(mean_ptr, sum, n);
+/* Return the sum of acc and r, or Qundef if nothing is accumulated. */
+static VALUE
+rational_acc_flush(const struct rational_acc *acc, VALUE r)
+{
+  VALUE x;
+
+  if (acc->den == 0)
+    return r;
+  x = rational_acc_to_num(acc);
+  return (r == Qundef) ? x : rb_rational_plus(r, x);
+}
+
+/* Shewchuk's exact summation of Float values
+ *
+ * The exact sum is kept as non-overlapping partials in the increasing
+ * order of their magnitudes, in the same way as math.fsum of Python.
+ * Each partial covers a distinct range of exponents, so there are at
+ * most about 40 of them, and no memory is allocated while adding. */
+
+#define FSUM_PARTIALS_MAX 64
+
+struct fsum {
+  double p[FSUM_PARTIALS_MAX];
+  int n;
+  double special; /* the sum of infinite and NaN values */
+};
+
+static inline void
+fsum_init(struct fsum *s)
+{
+  s->n = 0;
+  s->special = 0.0;
+}
+
+static inline void
+fsum_add(struct fsum *s, double x)
+{
+  int i, j;
+
+  if (!isfinite(x)) {
+    s->special += x;
     return;
   }
 
-  for (i = 0; i < RARRAY_LEN(ary); ++i) {
-    double x, delta, y, t;
-    VALUE e;
+  for (i = j = 0; j < s->n; ++j) {
+    double y = s->p[j], hi, lo;
+    if (fabs(x) < fabs(y)) {
+      double const t = x;
+      x = y;
+      y = t;
+    }
+    hi = x + y;
+    lo = y - (hi - x);
+    if (lo != 0.0)
+      s->p[i++] = lo;
+    x = hi;
+  }
+  if (!isfinite(x))
+    rb_raise(rb_eRangeError, "intermediate overflow in exact summation");
+  if (x != 0.0) {
+    assert(i < FSUM_PARTIALS_MAX);
+    s->p[i++] = x;
+  }
+  s->n = i;
+}
+
+/* Add the Integer w to s exactly by splitting it into Float values. */
+static void
+fsum_add_wide_int(struct fsum *s, wide_int w)
+{
+  while (w != 0) {
+    double const hi = (double)w;
+    fsum_add(s, hi);
+    w -= (wide_int)hi;
+  }
+}
 
-    n += 1;
+/* Return the correctly rounded sum of s. */
+static double
+fsum_result(const struct fsum *s)
+{
+  double hi = 0.0, lo = 0.0, x, y, yr;
+  int n = s->n;
+
+  if (s->special != 0.0)
+    return s->special;
+  if (n == 0)
+    return 0.0;
+
+  hi = s->p[--n];
+  while (n > 0) {
+    x = hi;
+    y = s->p[--n];
+    hi = x + y;
+    yr = hi - x;
+    lo = y - yr;
+    if (lo != 0.0)
+      break;
+  }
 
-    e = RARRAY_AREF(ary, i);
-    if (rb_block_given_p())
-      e = rb_yield(e);
+  /* Round half to even across the rest of the partials */
+  if (n > 0 && ((lo < 0.0 && s->p[n-1] < 0.0) || (lo > 0.0 && s->p[n-1] > 0.0))) {
+    y = lo * 2;
+    x = hi + y;
+    yr = x - hi;
+    if (y == yr)
+      hi = x;
+  }
+  return hi;
+}
 
-    if (RB_FLOAT_TYPE_P(e))
-      x = RFLOAT_VALUE(e);
-    else if (FIXNUM_P(e))
-      x = FIX2LONG(e);
-    else if (RB_TYPE_P(e, T_BIGNUM))
-      x = rb_big2dbl(e);
-    else
-      x = rb_num2dbl(e);
+/* Return the exact sum of the finite partials of s as a Rational. */
+static VALUE
+fsum_to_rational(const struct fsum *s)
+{
+  VALUE v = INT2FIX(0);
+  int i;
 
-    y = x - c;
-    t = f + y;
-    c = (t - f) - y;
-    f = t;
+  for (i = 0; i < s->n; ++i)
+    v = rb_funcall(v, idPLUS, 1, rb_funcall(DBL2NUM(s->p[i]), id_to_r, 0));
+  return v;
+}
 
-    delta = x - m;
-    m += delta / n;
-    m2 += delta * (x - m);
-  }
+/* Return the Float nearest to the Integer or Rational x, rounding half to
+ * even.  Rational#to_f does not always round correctly, e.g. it rounds
+ * 1 + 2**-53 + 2**-106 down to 1.0. */
+static double
+exact_to_dbl(VALUE x)
+{
+  VALUE num, den, qr, q, low, half;
+  long k, extra;
+  int neg, sticky, cmp;
+  double d;
 
-  SET_MEAN(DBL2NUM(f / n));
-  if (n >= 2) {
-    assert(n > ddof);
-    SET_VARIANCE(DBL2NUM(m2 / (n - ddof)));
+  if (RB_TYPE_P(x, T_RATIONAL)) {
+    num = rb_rational_num(x);
+    den = rb_rational_den(x);
   }
+  else {
+    num = x;
+    den = INT2FIX(1);
+  }
+  if (FIXNUM_P(num) && FIX2LONG(num) == 0)
+    return 0.0;
+  neg = RTEST(rb_funcall(num, '<', 1, INT2FIX(0)));
+  if (neg)
+    num = rb_funcall(num, id_negate, 0);
+
+  /* Take the quotient of 55 or 56 bits, and the remainder as a sticky bit */
+  k = 55 - (NUM2LONG(rb_funcall(num, id_bit_length, 0)) -
+            NUM2LONG(rb_funcall(den, id_bit_length, 0)));
+  if (k >= 0)
+    num = rb_funcall(num, id_lshift, 1, LONG2NUM(k));
+  else
+    den = rb_funcall(den, id_lshift, 1, LONG2NUM(-k));
+  qr = rb_funcall(num, id_divmod, 1, den);
+  q = RARRAY_AREF(qr, 0);
+  sticky = !(FIXNUM_P(RARRAY_AREF(qr, 1)) && FIX2LONG(RARRAY_AREF(qr, 1)) == 0);
+
+  /* Round off the bits below the 53 bits, or below 2**-1074 for subnormals */
+  extra = NUM2LONG(rb_funcall(q, id_bit_length, 0)) - DBL_MANT_DIG;
+  if (extra - k < DBL_MIN_EXP - DBL_MANT_DIG)
+    extra = k + DBL_MIN_EXP - DBL_MANT_DIG;
+
+  half = rb_funcall(INT2FIX(1), id_lshift, 1, LONG2NUM(extra - 1));
+  low = rb_funcall(q, '&', 1, rb_funcall(rb_funcall(half, id_lshift, 1, INT2FIX(1)), idMINUS, 1, INT2FIX(1)));
+  q = rb_funcall(q, id_rshift, 1, LONG2NUM(extra));
+  cmp = FIX2INT(rb_funcall(low, id_cmp, 1, half));
+  if (cmp > 0 || (cmp == 0 && (sticky || RTEST(rb_funcall(q, id_odd_p, 0)))))
+    q = rb_funcall(q, idPLUS, 1, INT2FIX(1));
+
+  d = ldexp(NUM2DBL(q), (int)(extra - k));
+  return neg ? -d : d;
 }
 
-struct variance_opts {
-  int population;
+/* The state of `sum(exact: true)` and `mean(exact: true)`.
+ *
+ * Integer and Rational values are accumulated exactly by wide_int and
+ * rational_acc, and Float values by fsum. */
+struct exact_sum_memo {
+  int block_given;
   int skip_na;
+  int float_p;
+  long count;
+  wide_int n;
+  VALUE v, r;
+  struct rational_acc ra;
+  struct fsum fs;
+  struct na_cache na;
 };
 
 static void
-get_variance_opts(VALUE opts, struct variance_opts *out)
+exact_sum_memo_init(struct exact_sum_memo *memo, int skip_na)
 {
-  assert(out != NULL);
+  memo->block_given = rb_block_given_p();
+  memo->skip_na = skip_na;
+  memo->float_p = 0;
+  memo->count = 0;
+  memo->n = 0;
+  memo->v = INT2FIX(0);
+  memo->r = Qundef;
+  rational_acc_init(&memo->ra);
+  fsum_init(&memo->fs);
+  na_cache_init(&memo->na);
+}
 
-  out->population = 0;
-  out->skip_na = 0;
+static inline void
+exact_sum_add(struct exact_sum_memo *memo, VALUE e)
+{
+  if (RB_FLOAT_TYPE_P(e)) {
+    fsum_add(&memo->fs, RFLOAT_VALUE(e));
+    memo->float_p = 1;
+  }
+  else if (FIXNUM_P(e) || RB_TYPE_P(e, T_BIGNUM))
+    wide_int_add(&memo->n, &memo->v, e);
+  else if (RB_TYPE_P(e, T_RATIONAL))
+    rational_acc_add(&memo->ra, &memo->r, e);
+  else {
+    rb_raise(rb_eTypeError,
+             "exact calculation needs Integer, Rational, or Float values (%"PRIsVALUE" given)",
+             rb_obj_class(e));
+  }
+}
 
-  if (!NIL_P(opts)) {
-#ifdef HAVE_RB_GET_KWARGS
-    static ID kwarg_keys[2];
-    VALUE kwarg_vals;
+static void
+exact_sum_iter(VALUE e, struct exact_sum_memo *memo)
+{
+  if (memo->block_given)
+    e = rb_yield(e);
+  if (memo->skip_na && is_na_cached(e, &memo->na))
+    return;
 
-    if (!kwarg_keys[0]) {
-      kwarg_keys[0] = id_population;
-      kwarg_keys[1] = id_skip_na;
-    }
+  exact_sum_add(memo, e);
+  ++memo->count;
+}
 
-    rb_get_kwargs(opts, &kwarg_keys, 0, 2, kwarg_vals);
-    out->population = (kwarg_vals[0] != Qundef) ? RTEST(kwarg_vals[0]) : out->population;
-    out->skip_na = (kwarg_vals[1] != Qundef) ? RTEST(kwarg_vals[1]) : out->skip_na;
-#else
-    VALUE val;
+/* Return the exact sum of the finite values in memo. */
+static VALUE
+exact_sum_memo_exact(const struct exact_sum_memo *memo)
+{
+  VALUE v = wide_int_flush(memo->n, memo->v);
+  VALUE const r = rational_acc_flush(&memo->ra, memo->r);
 
-    val = rb_hash_aref(opts, ID2SYM(id_population));
-    out->population = NIL_P(val) ? out->population : RTEST(val);
+  if (r != Qundef)
+    v = rb_rational_plus(r, v);
+  if (memo->float_p)
+    v = rb_funcall(fsum_to_rational(&memo->fs), idPLUS, 1, v);
+  return v;
+}
 
-    val = rb_hash_aref(opts, ID2SYM(id_skip_na));
-    out->skip_na = NIL_P(val) ? out->skip_na : RTEST(val);
-#endif
+/* Return the sum in memo.  This is exact if memo has no Float value,
+ * and the correctly rounded Float of the exact sum otherwise. */
+static VALUE
+exact_sum_memo_result(const struct exact_sum_memo *memo)
+{
+  struct fsum fs;
+
+  if (!memo->float_p)
+    return exact_sum_memo_exact(memo);
+  if (memo->fs.special != 0.0)
+    return DBL2NUM(memo->fs.special);
+
+  if (memo->v == INT2FIX(0) && memo->r == Qundef && memo->ra.den == 0) {
+    fs = memo->fs;
+    fsum_add_wide_int(&fs, memo->n);
+    return DBL2NUM(fsum_result(&fs));
   }
+  return DBL2NUM(exact_to_dbl(exact_sum_memo_exact(memo)));
 }
 
-/* call-seq:
- *    ary.mean_variance(population: false, skip_na: false)
- *
- * Calculate a mean and a variance of the values in `ary`.
- * The first element of the result array is the mean, and the second is the variance.
- *
- * When the `population:` keyword parameter is `true`,
- * the variance is calculated as a population variance (divided by $n$).
- * The default `population:` keyword parameter is `false`;
- * this means the variance is a sample variance (divided by $n-1$).
- *
- * This method scan values in `ary` only once,
- * and does not cache the values on memory.
- *
- * @return (mean, variance) Two element array consists of mean and variance values
- */
+/* Return the mean in memo.  This is a Rational if memo has no Float value,
+ * and the correctly rounded Float of the exact mean otherwise. */
 static VALUE
-ary_mean_variance_m(int argc, VALUE* argv, VALUE ary)
+exact_sum_memo_mean(const struct exact_sum_memo *memo)
 {
-  struct variance_opts options;
-  VALUE opts, mean = Qnil, variance = Qnil;
-  size_t ddof = 1;
+  VALUE mean;
 
-  rb_scan_args(argc, argv, "0:", &opts);
-  get_variance_opts(opts, &options);
-  if (options.population)
-    ddof = 0;
+  if (memo->count == 0)
+    return rb_rational_new(INT2FIX(0), INT2FIX(1));
+  if (memo->float_p && memo->fs.special != 0.0)
+    return DBL2NUM(memo->fs.special);
 
-  ary_mean_variance(ary, &mean, &variance, ddof, options.skip_na);
-  return rb_assoc_new(mean, variance);
+  mean = rb_funcall(exact_sum_memo_exact(memo), id_quo, 1, LONG2NUM(memo->count));
+  return memo->float_p ? DBL2NUM(exact_to_dbl(mean)) : mean;
 }
 
-/* call-seq:
- *    ary.mean(skip_na: false)
- *
- * Calculate a mean of the values in `ary`.
- * This method utilizes
- * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
- * to compensate the result precision when the `enum` includes Float values.
- *
- * @return [Number] A mean value
- */
-static VALUE
-ary_mean(int argc, VALUE *argv, VALUE ary)
+static int opt_skip_na(VALUE opts)
 {
-  VALUE mean = Qnil, opts;
-  int skip_na;
+  VALUE skip_na = Qfalse;
 
-  rb_scan_args(argc, argv, ":", &opts);
-  skip_na = opt_skip_na(opts);
+  if (!NIL_P(opts)) {
+#ifdef HAVE_RB_GET_KWARGS
+    ID kwargs = id_skip_na;
+    rb_get_kwargs(opts, &kwargs, 0, 1, &skip_na);
+#else
+    VALUE val = rb_hash_aref(opts, ID2SYM(id_skip_na));
+    skip_na = NIL_P(val) ? skip_na : val;
+#endif
+  }
 
-  ary_mean_variance(ary, &mean, NULL, 1, skip_na);
-  return mean;
+  return RTEST(skip_na);
 }
 
-/* call-seq:
- *    ary.variance(population: false, skip_na: false)
- *
- * Calculate a variance of the values in `ary`.
- * This method scan values in `ary` only once,
- * and does not cache the values on memory.
- *
- * When the `population:` keyword parameter is `true`,
- * the variance is calculated as a population variance (divided by $n$).
- * The default `population:` keyword parameter is `false`;
- * this means the variance is a sample variance (divided by $n-1$).
- *
- * @return [Number] A variance value
- */
+static inline VALUE
+field_value(VALUE e, VALUE key, long index, int index_p)
+{
+  if (index_p) {
+    if (RB_TYPE_P(e, T_ARRAY))
+      return rb_ary_entry(e, index);
+    return rb_funcall(e, id_aref, 1, LONG2NUM(index));
+  }
+
+  switch (TYPE(e)) {
+    case T_HASH:
+      return rb_hash_aref(e, key);
+    case T_STRUCT:
+      return rb_struct_aref(e, key);
+    default:
+      return rb_funcall(e, id_aref, 1, key);
+  }
+}
+
+/* Take the option `id` out of *kwargs_ptr, and return its value, or Qundef
+ * if it is not given.  *kwargs_ptr is replaced by a copy without the option,
+ * or nil if no option is left. */
 static VALUE
-ary_variance(int argc, VALUE* argv, VALUE ary)
+kwargs_take(VALUE *kwargs_ptr, ID id)
 {
-  struct variance_opts options;
-  VALUE opts, variance;
-  size_t ddof = 1;
+  VALUE kwargs = *kwargs_ptr, val;
 
-  rb_scan_args(argc, argv, "0:", &opts);
-  get_variance_opts(opts, &options);
-  if (options.population)
-    ddof = 0;
+  if (NIL_P(kwargs))
+    return Qundef;
 
-  ary_mean_variance(ary, NULL, &variance, ddof, options.skip_na);
-  return variance;
-}
+  val = rb_hash_lookup2(kwargs, ID2SYM(id), Qundef);
+  if (val == Qundef)
+    return Qundef;
 
-#define ENUM_WANT_SVALUE() do { \
-  e = rb_enum_values_pack(argc, argv); \
-} while (0)
+  kwargs = rb_hash_dup(kwargs);
+  rb_hash_delete(kwargs, ID2SYM(id));
+  *kwargs_ptr = RHASH_SIZE(kwargs) == 0 ? Qnil : kwargs;
 
-struct enum_sum_memo {
-  VALUE v, r;
-  long n, count;
-  double f, c;
-  int block_given;
-  int float_value;
-  int skip_na;
-};
+  return val;
+}
 
-static void
-sum_iter(VALUE e, struct enum_sum_memo *memo)
+/* Take `key:` and `index:` options out of *kwargs_ptr, and return an array
+ * of the fields of the rows in ary specified by them.  The rest of the
+ * options are left in *kwargs_ptr for the caller.
+ *
+ * `key:` looks up Hash values and Struct members, and `index:` looks up
+ * Array elements.  The other rows are looked up by their `[]` method.
+ *
+ * This returns ary itself if neither option is given. */
+static VALUE
+ary_extract_field(VALUE ary, VALUE *kwargs_ptr)
 {
-  int const unused = (assert(memo != NULL), 0);
+  VALUE key, index, res;
+  long i, n, idx = 0;
+  int index_p;
 
-  long n = memo->n;
-  VALUE v = memo->v;
-  VALUE r = memo->r;
-  double f = memo->f;
-  double c = memo->c;
+  key = kwargs_take(kwargs_ptr, id_key);
+  index = kwargs_take(kwargs_ptr, id_index);
+  if (key == Qundef && index == Qundef)
+    return ary;
 
-  if (memo->block_given) {
-    e = rb_yield(e);
+  if (key != Qundef && index != Qundef) {
+    rb_raise(rb_eArgError, "Unable to use both `key` and `index` together");
   }
-  if (memo->skip_na && is_na(e)) {
-    return;
+
+  index_p = index != Qundef;
+  if (index_p) {
+    idx = NUM2LONG(index);
   }
 
-  memo->count += 1;
+  n = RARRAY_LEN(ary);
+  res = rb_ary_new_capa(n);
+  for (i = 0; i < n && i < RARRAY_LEN(ary); ++i) {
+    rb_ary_push(res, field_value(RARRAY_AREF(ary, i), key, idx, index_p));
+  }
 
-  if (memo->float_value)
-    goto float_value;
+  return res;
+}
 
-  if (FIXNUM_P(v) || RB_TYPE_P(v, T_BIGNUM) || RB_TYPE_P(v, T_RATIONAL)) {
-    if (FIXNUM_P(e)) {
-      n += FIX2LONG(e); /* should not overflow long type */
-      if (!FIXABLE(n)) {
-        v = rb_big_plus(LONG2NUM(n), v);
-        n = 0;
-      }
-    }
-    else if (RB_TYPE_P(e, T_BIGNUM))
-      v = rb_big_plus(e, v);
-    else if (RB_TYPE_P(e, T_RATIONAL)) {
-      if (r == Qundef)
-        r = e;
-      else
-        r = rb_rational_plus(r, e);
-    }
-    else {
-      if (n != 0) {
-        v = rb_fix_plus(LONG2FIX(n), v);
-        n = 0;
-      }
-      if (r != Qundef) {
-        v = rb_rational_plus(r, v);
-        r = Qundef;
-      }
-      if (RB_FLOAT_TYPE_P(e)) {
-        f = NUM2DBL(v);
-        c = 0.0;
-        memo->float_value = 1;
-        goto float_value;
-      }
-      else
-        goto some_value;
-    }
-  }
-  else if (RB_FLOAT_TYPE_P(v)) {
-    /* Kahan's compensated summation algorithm */
-    double x, y, t;
-
-  float_value:
-    if (RB_FLOAT_TYPE_P(e))
-      x = RFLOAT_VALUE(e);
-    else if (FIXNUM_P(e))
-      x = FIX2LONG(e);
-    else if (RB_TYPE_P(e, T_BIGNUM))
-      x = rb_big2dbl(e);
-    else if (RB_TYPE_P(e, T_RATIONAL))
-      x = rb_num2dbl(e);
-    else {
-      v = DBL2NUM(f);
-      memo->float_value = 0;
-      goto some_value;
-    }
+static VALUE
+check_weight_array(VALUE weight_array, const long ary_len)
+{
+  if (weight_array == Qundef || NIL_P(weight_array)) return Qnil;
 
-    y = x - c;
-    t = f + y;
-    c = (t - f) - y;
-    f = t;
-  }
-  else {
-  some_value:
-    v = rb_funcall(v, idPLUS, 1, e);
+  weight_array = rb_convert_type(weight_array, T_ARRAY, "Array", "to_ary");
+  if (RARRAY_LEN(weight_array) != ary_len) {
+    rb_raise(rb_eArgError, "weight array must have the same number of items as the receiver array");
   }
 
-  memo->v = v;
-  memo->n = n;
-  memo->r = r;
-  memo->f = f;
-  memo->c = c;
-  (void)unused;
+  return weight_array;
 }
 
+/* Take `weights:` option out of *kwargs_ptr, and return the weight array
+ * checked against ary, or nil if it is not given. */
 static VALUE
-enum_sum_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+ary_extract_weights(VALUE ary, VALUE *kwargs_ptr)
 {
-  ENUM_WANT_SVALUE();
-  sum_iter(e, (struct enum_sum_memo *) args);
-  return Qnil;
+  VALUE weights = kwargs_take(kwargs_ptr, id_weights);
+
+  if (weights == Qundef || NIL_P(weights))
+    return Qnil;
+  return check_weight_array(weights, RARRAY_LEN(ary));
 }
 
-static int
-hash_sum_i(VALUE key, VALUE value, VALUE arg)
+/* A buffer of native double values.
+ *
+ * The storage is a hidden String so that GC releases it even when an
+ * exception is raised while the buffer is being filled. */
+
+#define DBL_BUFFER_PTR(buf) ((double *)RSTRING_PTR(buf))
+#define DBL_BUFFER_LEN(buf) (RSTRING_LEN(buf) / (long)sizeof(double))
+
+static VALUE
+dbl_buffer_new(long capa)
 {
-  sum_iter(rb_assoc_new(key, value), (struct enum_sum_memo *) arg);
-  return ST_CONTINUE;
+  VALUE buf = rb_str_tmp_new(capa * (long)sizeof(double));
+  rb_str_set_len(buf, 0);
+  return buf;
 }
 
-static void
-hash_sum(VALUE hash, struct enum_sum_memo *memo)
+static inline void
+dbl_buffer_push(VALUE buf, double x)
 {
-  assert(RB_TYPE_P(hash, T_HASH));
-  assert(memo != NULL);
+  long const len = RSTRING_LEN(buf);
 
-  rb_hash_foreach(hash, hash_sum_i, (VALUE)memo);
+  if ((size_t)len + sizeof(double) > rb_str_capacity(buf))
+    rb_str_modify_expand(buf, len + (long)sizeof(double));
+
+  memcpy(RSTRING_PTR(buf) + len, &x, sizeof(double));
+  rb_str_set_len(buf, len + (long)sizeof(double));
+}
+
+static inline void
+dbl_swap(double *a, long i, long j)
+{
+  double const t = a[i];
+  a[i] = a[j];
+  a[j] = t;
 }
 
+/* Rearrange a[lo...hi] so that a[k] is the value that would be there
+ * if a[lo...hi] were sorted, all of a[lo...k] are less than or equal
+ * to a[k], and all of a[k+1...hi] are greater than or equal to a[k].
+ * This is Hoare's quickselect with the median-of-three pivot. */
 static void
-int_range_sum_count(VALUE beg, VALUE end, int excl,
-                    VALUE init, VALUE *sum_ptr, long *count_ptr)
+dbl_select(double *a, long lo, long hi, long k)
 {
-  if (excl) {
-    if (FIXNUM_P(end))
-      end = LONG2FIX(FIX2LONG(end) - 1);
+  assert(lo <= k && k < hi);
+
+  while (hi - lo > 16) {
+    long const mid = lo + (hi - lo) / 2;
+    long i, j;
+    double pivot;
+
+    if (a[mid] < a[lo]) dbl_swap(a, mid, lo);
+    if (a[hi - 1] < a[lo]) dbl_swap(a, hi - 1, lo);
+    if (a[hi - 1] < a[mid]) dbl_swap(a, hi - 1, mid);
+    pivot = a[mid];
+
+    i = lo;
+    j = hi - 1;
+    while (i <= j) {
+      while (a[i] < pivot) ++i;
+      while (pivot < a[j]) --j;
+      if (i <= j) {
+        dbl_swap(a, i, j);
+        ++i;
+        --j;
+      }
+    }
+
+    if (k <= j)
+      hi = j + 1;
+    else if (k >= i)
+      lo = i;
     else
-      end = rb_big_minus(end, LONG2FIX(1));
+      return;
   }
 
-  if (rb_int_ge(end, beg)) {
-    VALUE a;
-    a = rb_int_plus(rb_int_minus(end, beg), LONG2FIX(1));
-    a = f_mul(a, rb_int_plus(end, beg));
-    a = f_idiv(a, LONG2FIX(2));
-    if (sum_ptr)
-      *sum_ptr = rb_int_plus(init, a);
-    if (count_ptr)
-      *count_ptr = a;
-    return;
+  /* insertion sort for a short range */
+  {
+    long i, j;
+    for (i = lo + 1; i < hi; ++i) {
+      double const x = a[i];
+      for (j = i; j > lo && x < a[j - 1]; --j)
+        a[j] = a[j - 1];
+      a[j] = x;
+    }
   }
+}
 
-  if (sum_ptr)
-    *sum_ptr = init;
-  if (count_ptr)
-    *count_ptr = 0;
+static int
+long_cmp(const void *ap, const void *bp, void *dummy)
+{
+  long const a = *(const long *)ap, b = *(const long *)bp;
+  return (a > b) - (a < b);
 }
 
-static void
-enum_sum_count(VALUE obj, VALUE init, int skip_na, VALUE *sum_ptr, long *count_ptr)
+static int
+dbl_cmp(const void *ap, const void *bp, void *dummy)
 {
-  struct enum_sum_memo memo;
-  VALUE beg, end;
-  int excl;
+  double const a = *(const double *)ap, b = *(const double *)bp;
+  return (a > b) - (a < b);
+}
 
-  memo.count = 0;
-  memo.v = init;
-  memo.block_given = rb_block_given_p();
-  memo.n = 0;
-  memo.r = Qundef;
-  memo.skip_na = skip_na;
+/* Store the ranks of the order statistics needed to calculate the
+ * percentiles qs[0...m] of n values into ranks in ascending order, and
+ * return the number of them.  ranks must have room for 2*m elements. */
+static long
+dbl_percentile_ranks(long n, const double *qs, long m, long *ranks)
+{
+  long i, nranks;
 
-  if ((memo.float_value = RB_FLOAT_TYPE_P(memo.v))) {
-    memo.f = RFLOAT_VALUE(memo.v);
-    memo.c = 0.0;
+  for (i = nranks = 0; i < m; ++i) {
+    long const l = (long)((n - 1) * qs[i] / 100.0);
+    ranks[nranks++] = l;
+    if (l + 1 < n)
+      ranks[nranks++] = l + 1;
   }
+  ruby_qsort(ranks, nranks, sizeof(long), long_cmp, NULL);
 
-  if (RTEST(rb_range_values(obj, &beg, &end, &excl))) {
-    if (!rb_block_given_p() && !memo.float_value &&
-        RB_INTEGER_TYPE_P(beg) && RB_INTEGER_TYPE_P(end)) {
-      int_range_sum_count(beg, end, excl, memo.v, sum_ptr, count_ptr);
-      return;
-    }
-  }
+  return nranks;
+}
 
-  if (RB_TYPE_P(obj, T_HASH) &&
-      rb_method_basic_definition_p(CLASS_OF(obj), id_each))
-    hash_sum(obj, &memo);
-  else
-    rb_block_call(obj, id_each, 0, 0, enum_sum_i, (VALUE)&memo);
+/* Select the order statistics of the ranks ranks[0...nranks], which
+ * must be in ascending order, in the buffer a of n values. */
+static void
+dbl_select_ranks(double *a, long n, const long *ranks, long nranks)
+{
+  long i, lo;
 
-  if (memo.float_value) {
-    if (sum_ptr)
-      *sum_ptr = DBL2NUM(memo.f);
-  }
-  else {
-    if (memo.n != 0)
-      memo.v = rb_fix_plus(LONG2FIX(memo.n), memo.v);
-    if (memo.r != Qundef)
-      memo.v = rb_rational_plus(memo.r, memo.v);
-    if (sum_ptr)
-      *sum_ptr = memo.v;
+  for (i = 0, lo = 0; i < nranks; ++i) {
+    if (ranks[i] < lo)
+      continue;
+    dbl_select(a, lo, n, ranks[i]);
+    lo = ranks[i] + 1;
   }
-
-  if (count_ptr)
-    *count_ptr = memo.count;
 }
 
-/* call-seq:
- *    enum.sum(skip_na: false)
- *
- * Calculate the sum of the values in `enum`.
- * This method utilizes
- * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
- * to compensate the result precision when the `enum` includes Float values.
- *
- * Note that This library does not redefine `sum` method introduced in Ruby 2.4.
- *
- * @return [Number] A summation value
- */
-static VALUE
-enum_sum(int argc, VALUE* argv, VALUE obj)
+/* Calculate the percentiles qs[0...m] from the buffer a of n values,
+ * in which the order statistics needed for them have been selected. */
+static void
+dbl_interpolate_percentiles(const double *a, long n, const double *qs, double *out, long m)
 {
-  VALUE sum, init, opts;
-  int skip_na;
+  long i;
 
-  if (rb_scan_args(argc, argv, "01:", &init, &opts) == 0) {
-    init = LONG2FIX(0);
+  for (i = 0; i < m; ++i) {
+    double l, f;
+    f = modf((n - 1) * qs[i] / 100.0, &l);
+    if (f == 0 || (long)l == n - 1)
+      out[i] = a[(long)l];
+    else
+      out[i] = a[(long)l] * (1 - f) + a[(long)l + 1] * f;
   }
-  skip_na = opt_skip_na(opts);
+}
 
-#ifndef HAVE_ENUM_SUM
-  if (skip_na) {
-    enum_sum_count(obj, init, skip_na, &sum, NULL);
-  }
-  else {
-    rb_funcall(orig_enum_sum, rb_intern("call"), argc, &init);
-  }
-#else
-  enum_sum_count(obj, init, skip_na, &sum, NULL);
-#endif
+/* Calculate the percentiles qs[0...m] of the n values in the buffer a
+ * by selecting only the order statistics needed for them.
+ * The buffer a is partially reordered.  The values of qs must be
+ * between 0 and 100, and n must be positive. */
+static void
+dbl_percentiles(double *a, long n, const double *qs, double *out, long m)
+{
+  VALUE tmp;
+  long *ranks;
+  long nranks;
 
-  return sum;
+  assert(n > 0);
+
+  ranks = ALLOCV_N(long, tmp, 2*m);
+  nranks = dbl_percentile_ranks(n, qs, m, ranks);
+  dbl_select_ranks(a, n, ranks, nranks);
+  dbl_interpolate_percentiles(a, n, qs, out, m);
+  ALLOCV_END(tmp);
 }
 
-struct enum_mean_variance_memo {
-  int block_given;
-  size_t n;
-  double m, m2, f, c;
-};
+/* The minimum length of arrays whose statistics are calculated without
+ * the GVL.  A negative value disables releasing the GVL. */
+static long nogvl_threshold = 100000;
 
 static void
-mean_variance_iter(VALUE e, struct enum_mean_variance_memo *memo)
+call_without_gvl(void *(*func)(void *), void *arg)
 {
-  int const unused = (assert(memo != NULL), 0);
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+  rb_thread_call_without_gvl(func, arg, NULL, NULL);
+#else
+  func(arg);
+#endif
+}
 
-  double x, delta, y, t;
+/* Call func without the GVL only if the calculation on n values is
+ * large enough to pay the cost of releasing the GVL. */
+static void
+call_without_gvl_if_large(void *(*func)(void *), void *arg, long n)
+{
+  if (0 <= nogvl_threshold && nogvl_threshold <= n)
+    call_without_gvl(func, arg);
+  else
+    func(arg);
+}
 
-  long n = memo->n;
-  double m = memo->m;
-  double m2 = memo->m2;
-  double f = memo->f;
-  double c = memo->c;
+#define NUMERIC_SNAPSHOT_FIXNUM 1 /* accept Fixnum values as well as Float */
+#define NUMERIC_SNAPSHOT_NAN    2 /* accept NaN values */
 
-  if (memo->block_given)
-    e = rb_yield(e);
+/* Copy the values in ary into a native buffer, so that the calculation
+ * on them can run without the GVL.
+ *
+ * This returns nil if ary is shorter than nogvl_threshold, or if ary
+ * has any value that is not acceptable according to flags. */
+static VALUE
+ary_numeric_snapshot(VALUE ary, int flags)
+{
+  long const n = RARRAY_LEN(ary);
+  VALUE buf;
+  double *p;
+  long i;
 
-  n += 1;
+  if (nogvl_threshold < 0 || n < nogvl_threshold || n == 0)
+    return Qnil;
 
-  if (RB_FLOAT_TYPE_P(e))
-    x = RFLOAT_VALUE(e);
-  else if (FIXNUM_P(e))
-    x = FIX2LONG(e);
-  else if (RB_TYPE_P(e, T_BIGNUM))
-    x = rb_big2dbl(e);
-  else {
-    x = rb_num2dbl(e);
+  buf = dbl_buffer_new(n);
+  p = DBL_BUFFER_PTR(buf);
+  for (i = 0; i < n; ++i) {
+    VALUE const e = RARRAY_AREF(ary, i);
+    if (RB_FLOAT_TYPE_P(e)) {
+      p[i] = RFLOAT_VALUE(e);
+      if (isnan(p[i]) && !(flags & NUMERIC_SNAPSHOT_NAN))
+        return Qnil;
+    }
+    else if (FIXNUM_P(e) && (flags & NUMERIC_SNAPSHOT_FIXNUM))
+      p[i] = FIX2LONG(e);
+    else
+      return Qnil;
   }
+  rb_str_set_len(buf, n * (long)sizeof(double));
 
-  y = x - c;
-  t = f + y;
-  c = (t - f) - y;
-  f = t;
+  return buf;
+}
 
-  delta = x - m;
-  m += delta / n;
-  m2 += delta * (x - m);
+#ifdef HAVE_RUBY_RACTOR_H
+/* The Ractor that loaded this extension */
+static VALUE main_ractor = Qnil;
+#endif
 
-  memo->n = n;
-  memo->m = m;
-  memo->m2 = m2;
-  memo->f = f;
-  memo->c = c;
-  (void)unused;
+/* Raise Ractor::UnsafeError unless called in the main Ractor, because the
+ * settings are process-global variables shared by all the Ractors. */
+static void
+check_main_ractor(const char *name)
+{
+#ifdef HAVE_RUBY_RACTOR_H
+  if (rb_funcall(rb_cRactor, rb_intern("current"), 0) != main_ractor) {
+    rb_raise(rb_path2class("Ractor::UnsafeError"),
+             "EnumerableStatistics.%s can be set only by the main Ractor", name);
+  }
+#endif
 }
 
+/* call-seq:
+ *    EnumerableStatistics.gvl_release_threshold -> integer or nil
+ *
+ * The minimum length of arrays whose statistics are calculated
+ * without holding the GVL, or `nil` if it is disabled.
+ *
+ * When an array of Float (and Integer, for some methods) values is at least
+ * this long, its values are copied into a native buffer, and `sum`, `mean`,
+ * `variance` and their friends, `percentile`, `median`, and `histogram`
+ * run on the buffer with the GVL released, so that other threads can run
+ * during the calculation.  The default value is 100,000.
+ */
 static VALUE
-enum_mean_variance_iter_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+es_get_gvl_release_threshold(VALUE mod)
 {
-  struct enum_mean_variance_memo *memo = (struct enum_mean_variance_memo *)args;
-  ENUM_WANT_SVALUE();
-  mean_variance_iter(e, memo);
-  return Qnil;
+  if (nogvl_threshold < 0)
+    return Qnil;
+  return LONG2NUM(nogvl_threshold);
 }
 
-static int
-hash_mean_variance_i(VALUE key, VALUE value, VALUE arg)
+/* call-seq:
+ *    EnumerableStatistics.gvl_release_threshold = integer or nil
+ *
+ * Set the minimum length of arrays whose statistics are calculated
+ * without holding the GVL.  `nil` disables releasing the GVL.
+ * It can be set only by the main Ractor.
+ */
+static VALUE
+es_set_gvl_release_threshold(VALUE mod, VALUE val)
 {
-  mean_variance_iter(rb_assoc_new(key, value), (struct enum_mean_variance_memo *) arg);
-  return ST_CONTINUE;
+  check_main_ractor("gvl_release_threshold");
+  if (NIL_P(val))
+    nogvl_threshold = -1;
+  else {
+    long const n = NUM2LONG(val);
+    if (n < 0) {
+      rb_raise(rb_eArgError, "negative threshold: %ld", n);
+    }
+    nogvl_threshold = n;
+  }
+  return val;
 }
 
-static void
-hash_mean_variance(VALUE hash, struct enum_mean_variance_memo *memo)
+#define PARALLELISM_MAX 256
+
+/* The minimum number of elements processed by a worker thread */
+#define PARALLEL_CHUNK_MIN_LEN 16384
+
+/* The maximum number of threads used for a calculation on a native buffer */
+static int parallelism = 1;
+
+/* call-seq:
+ *    EnumerableStatistics.parallelism -> integer
+ *
+ * The maximum number of threads used to calculate `sum`, `mean`, `variance`
+ * and their friends, `percentile`, and `median` of a large array.
+ * The default value is 1, which means the calculation runs only in the
+ * calling thread.
+ */
+static VALUE
+es_get_parallelism(VALUE mod)
 {
-  assert(RB_TYPE_P(hash, T_HASH));
-  assert(memo != NULL);
+  return INT2FIX(parallelism);
+}
 
-  rb_hash_foreach(hash, hash_mean_variance_i, (VALUE)memo);
+/* call-seq:
+ *    EnumerableStatistics.parallelism = integer
+ *
+ * Set the maximum number of threads used to calculate `sum`, `mean`,
+ * `variance` and their friends of a large array.
+ *
+ * The parallel calculation is applied to the arrays whose values are copied
+ * into a native buffer (see `EnumerableStatistics.gvl_release_threshold`).
+ * The buffer is split into chunks of at least 16,384 elements, and the partial
+ * results of the chunks are merged in order.  So the result does not depend
+ * on the thread scheduling, though it can differ from the one of the serial
+ * calculation in the last few bits.  It can be set only by the main Ractor.
+ */
+static VALUE
+es_set_parallelism(VALUE mod, VALUE val)
+{
+  int n;
+
+  check_main_ractor("parallelism");
+  n = NUM2INT(val);
+  if (n < 1 || PARALLELISM_MAX < n) {
+    rb_raise(rb_eArgError, "parallelism out of range (1..%d): %d",
+             PARALLELISM_MAX, n);
+  }
+  parallelism = n;
+  return val;
+}
+
+/* The number of chunks into which a native buffer of length n is split */
+static long
+parallel_chunk_count(long n)
+{
+  long k = n / PARALLEL_CHUNK_MIN_LEN;
+  if (k > parallelism)
+    k = parallelism;
+  return k < 1 ? 1 : k;
 }
 
+/* Call func with each of count arguments in args, whose size is size, in
+ * separate threads.  The first one is processed in the calling thread.
+ * func must not call any Ruby API. */
 static void
-enum_mean_variance(VALUE obj, VALUE *mean_ptr, VALUE *variance_ptr, size_t ddof)
+parallel_run(void *(*func)(void *), void *args, size_t size, long count)
 {
-  struct enum_mean_variance_memo memo;
+  char *const p = (char *)args;
+  long i = 1;
+#ifdef HAVE_PTHREAD_CREATE
+  pthread_t threads[PARALLELISM_MAX];
+  sigset_t mask, omask;
+  long started;
+
+  assert(count <= PARALLELISM_MAX);
+
+  /* Signals must be handled by the threads Ruby knows */
+  sigfillset(&mask);
+  pthread_sigmask(SIG_SETMASK, &mask, &omask);
+  for (; i < count; ++i) {
+    if (pthread_create(&threads[i], NULL, func, p + i*size) != 0)
+      break;
+  }
+  pthread_sigmask(SIG_SETMASK, &omask, NULL);
+  started = i;
+#endif
 
-  SET_MEAN(DBL2NUM(0));
-  SET_VARIANCE(DBL2NUM(NAN));
+  func(p);
+  /* the rest of chunks that could not be given to threads */
+  for (; i < count; ++i)
+    func(p + i*size);
 
-  if (variance_ptr == NULL) {
-    long n;
-    VALUE sum;
-    VALUE init = DBL2NUM(0.0);
-    enum_sum_count(obj, init, 0, &sum, &n); /* TODO: skip_na */
-    if (n > 0)
-      calculate_and_set_mean(mean_ptr, sum, n);
-    return;
-  }
+#ifdef HAVE_PTHREAD_CREATE
+  for (i = 1; i < started; ++i)
+    pthread_join(threads[i], NULL);
+#endif
+}
 
-  memo.block_given = rb_block_given_p();
-  memo.n = 0;
-  memo.m = 0.0;
-  memo.m2 = 0.0;
-  memo.f = 0.0;
-  memo.c = 0.0;
+/* Kahan's compensated summation algorithm */
+static inline void
+kahan_add(double *f, double *c, double x)
+{
+  double const y = x - *c;
+  double const t = *f + y;
+  *c = (t - *f) - y;
+  *f = t;
+}
 
-  if (RB_TYPE_P(obj, T_HASH) &&
-      rb_method_basic_definition_p(CLASS_OF(obj), id_each))
-    hash_mean_variance(obj, &memo);
+/* Store the value of the real number x in *out, and return whether
+ * x is a Float, an Integer, or a Rational. */
+static inline int
+real_to_dbl(VALUE x, double *out)
+{
+  if (RB_FLOAT_TYPE_P(x))
+    *out = RFLOAT_VALUE(x);
+  else if (FIXNUM_P(x))
+    *out = FIX2LONG(x);
+  else if (RB_TYPE_P(x, T_BIGNUM))
+    *out = rb_big2dbl(x);
+  else if (RB_TYPE_P(x, T_RATIONAL))
+    *out = rb_num2dbl(x);
   else
-    rb_block_call(obj, id_each, 0, 0, enum_mean_variance_iter_i, (VALUE)&memo);
-
-  if (memo.n == 0)
-    return;
-  else if (memo.n == 1)
-    SET_MEAN(DBL2NUM(memo.f));
-  else {
-    SET_MEAN(DBL2NUM(memo.f / memo.n));
-
-    assert(memo.n > ddof);
-    SET_VARIANCE(DBL2NUM(memo.m2 / (double)(memo.n - ddof)));
-  }
+    return 0;
+  return 1;
 }
 
-/* call-seq:
- *    enum.mean_variance(population: false)
- *
- * Calculate a mean and a variance of the values in `enum`.
- * The first element of the result array is the mean, and the second is the variance.
- *
- * When the `population:` keyword parameter is `true`,
- * the variance is calculated as a population variance (divided by $n$).
- * The default `population:` keyword parameter is `false`;
- * this means the variance is a sample variance (divided by $n-1$).
- *
- * This method scan values in `enum` only once,
- * and does not cache the values on memory.
- *
- * @return (mean, variance) Two element array consists of mean and variance values
- */
-static VALUE
-enum_mean_variance_m(int argc, VALUE* argv, VALUE obj)
+/* Store the parts of x in *re and *im, and return whether x is a Complex
+ * of Float parts.  The sum of such values is accumulated in two Kahan's
+ * accumulators instead of allocating a Complex for each value. */
+static inline int
+complex_to_dbl(VALUE x, double *re, double *im)
 {
-  struct variance_opts options;
-  VALUE opts, mean, variance;
-  size_t ddof = 1;
-
-  rb_scan_args(argc, argv, "0:", &opts);
-  get_variance_opts(opts, &options);
-  if (options.population)
-    ddof = 0;
+  VALUE real, imag;
+
+  if (!RB_TYPE_P(x, T_COMPLEX))
+    return 0;
+  real = RCOMPLEX(x)->real;
+  imag = RCOMPLEX(x)->imag;
+  if (!RB_FLOAT_TYPE_P(real) || !RB_FLOAT_TYPE_P(imag))
+    return 0;
+  *re = RFLOAT_VALUE(real);
+  *im = RFLOAT_VALUE(imag);
+  return 1;
+}
 
-  enum_mean_variance(obj, &mean, &variance, ddof);
-  return rb_assoc_new(mean, variance);
+static inline VALUE
+dbl_complex_new(double re, double im)
+{
+  return complex_new(rb_cComplex, DBL2NUM(re), DBL2NUM(im));
 }
 
-/* call-seq:
- *    enum.mean
+/* Validity bitmaps
  *
- * Calculate a mean of the values in `enum`.
- * This method utilizes
- * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
- * to compensate the result precision when the `enum` includes Float values.
+ * A validity bitmap marks the valid slots of a native buffer by 1 bits, in
+ * the same layout as Apache Arrow: the bit of the i-th slot is bit (i % 64)
+ * of word (i / 64).  The slots marked by 0 bits are NA values regardless of
+ * their contents.
  *
- * @return [Number] A mean value
- */
-static VALUE
-enum_mean(VALUE obj)
+ * The kernels process the buffer in runs of valid slots, which are found a
+ * word at a time, so that fully valid words are processed by the same dense
+ * loops as the buffers without a bitmap. */
+
+static inline int
+ntz64(uint64_t x)
 {
-  VALUE mean;
-  enum_mean_variance(obj, &mean, NULL, 1);
-  return mean;
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    ++n;
+  }
+  return n;
+#endif
 }
 
-/* call-seq:
- *    enum.variance(population: false)
- *
- * Calculate a variance of the values in `enum`.
- * This method scan values in `enum` only once,
- * and does not cache the values on memory.
- *
- * When the `population:` keyword parameter is `true`,
- * the variance is calculated as a population variance (divided by $n$).
- * The default `population:` keyword parameter is `false`;
- * this means the variance is a sample variance (divided by $n-1$).
- *
- * @return [Number] A variance value
- */
-static VALUE
-enum_variance(int argc, VALUE* argv, VALUE obj)
+/* Find the next run [*start, *end) of valid slots from *pos in the n slots
+ * whose first slot is at bit offset of validity, and advance *pos to the end
+ * of the run.  A NULL validity makes all the slots valid.
+ * This returns 0 if there is no more valid slot. */
+static inline int
+validity_next_run(const uint64_t *validity, long offset, long n,
+                  long *pos, long *start, long *end)
 {
-  struct variance_opts options;
-  VALUE opts, variance;
-  size_t ddof = 1;
+  long i = *pos;
 
-  rb_scan_args(argc, argv, "0:", &opts);
-  get_variance_opts(opts, &options);
-  if (options.population)
-    ddof = 0;
+  if (validity == NULL) {
+    if (i >= n)
+      return 0;
+    *start = i;
+    *end = *pos = n;
+    return 1;
+  }
 
-  enum_mean_variance(obj, NULL, &variance, ddof);
-  return variance;
+  /* Skip invalid slots */
+  while (i < n) {
+    long const b = offset + i;
+    uint64_t const w = validity[b / 64] >> (b % 64);
+    if (w == 0) {
+      i += 64 - b % 64;
+      continue;
+    }
+    i += ntz64(w);
+    break;
+  }
+  if (i >= n) {
+    *pos = n;
+    return 0;
+  }
+  *start = i;
+
+  /* Extend the run over valid slots */
+  while (i < n) {
+    long const b = offset + i;
+    uint64_t const w = ~validity[b / 64] >> (b % 64);
+    if (w == 0) {
+      i += 64 - b % 64;
+      continue;
+    }
+    i += ntz64(w);
+    break;
+  }
+  *end = *pos = i < n ? i : n;
+  return 1;
 }
 
-static VALUE
-sqrt_value(VALUE x)
+struct nogvl_sum_args {
+  const double *p;
+  long n;
+  long nchunks;
+  const uint64_t *validity; /* NULL if all the slots are valid */
+  long validity_offset;
+  int skip_na;
+  double f, c;
+  long na_count;
+};
+
+static void *
+sum_chunk(void *ptr)
 {
-  if (RB_INTEGER_TYPE_P(x) || RB_FLOAT_TYPE_P(x) || RB_TYPE_P(x, T_RATIONAL)) {
-    double f = NUM2DBL(x);
-    return DBL2NUM(sqrt(f));
+  struct nogvl_sum_args *args = (struct nogvl_sum_args *)ptr;
+  double f = args->f, c = args->c;
+  long i, pos = 0, start, end, valid = 0, na_count = 0;
+
+  while (validity_next_run(args->validity, args->validity_offset, args->n,
+                           &pos, &start, &end)) {
+    for (i = start; i < end; ++i) {
+      double const x = args->p[i];
+
+      if (args->skip_na && isnan(x)) {
+        ++na_count;
+        continue;
+      }
+
+      kahan_add(&f, &c, x);
+    }
+    valid += end - start;
   }
 
-  return rb_funcall(x, idPow, 1, half_in_rational);
+  /* The invalid slots are NA values */
+  if (valid < args->n) {
+    if (args->skip_na)
+      na_count += args->n - valid;
+    else
+      kahan_add(&f, &c, NAN);
+  }
+
+  args->f = f;
+  args->c = c;
+  args->na_count = na_count;
+  return NULL;
 }
 
-/* call-seq:
- *    enum.mean_stdev(population: false)
- *
- * Calculate a mean and a standard deviation of the values in `enum`.
- * The first element of the result array is the mean,
- * and the second is the standard deviation.
- *
- * This method is equivalent to:
- *
- * ```ruby
- * def mean_stdev(population: false)
- *   m, v = mean_variance(population: population)
- *   [m, Math.sqrt(v)]
- * end
- * ```
- *
- * @return (mean, stdev)
- */
-static VALUE
-enum_mean_stdev(int argc, VALUE* argv, VALUE obj)
+static void *
+nogvl_sum(void *ptr)
 {
-  struct variance_opts options;
-  VALUE opts, mean, variance;
-  size_t ddof = 1;
+  struct nogvl_sum_args *args = (struct nogvl_sum_args *)ptr;
+  struct nogvl_sum_args chunks[PARALLELISM_MAX];
+  long const k = args->nchunks;
+  long i;
 
-  rb_scan_args(argc, argv, "0:", &opts);
-  get_variance_opts(opts, &options);
-  if (options.population)
-    ddof = 0;
+  if (k <= 1)
+    return sum_chunk(args);
 
-  enum_mean_variance(obj, &mean, &variance, ddof);
-  VALUE stdev = sqrt_value(variance);
-  return rb_assoc_new(mean, stdev);
+  for (i = 0; i < k; ++i) {
+    long const lo = args->n * i / k, hi = args->n * (i + 1) / k;
+    chunks[i] = *args;
+    chunks[i].p = args->p + lo;
+    chunks[i].n = hi - lo;
+    chunks[i].validity_offset = args->validity_offset + lo;
+    chunks[i].f = chunks[i].c = 0.0;
+  }
+  parallel_run(sum_chunk, chunks, sizeof(chunks[0]), k);
+
+  /* Merge the partial sums in the order of the chunks */
+  args->na_count = 0;
+  for (i = 0; i < k; ++i) {
+    kahan_add(&args->f, &args->c, chunks[i].f);
+    kahan_add(&args->f, &args->c, -chunks[i].c);
+    args->na_count += chunks[i].na_count;
+  }
+  return NULL;
 }
 
-/* call-seq:
- *    enum.stdev(population: false)
- *
- * Calculate a standard deviation of the values in `enum`.
- *
- * This method is equivalent to:
+/* Pairwise summation
  *
- * ```ruby
- * Math.sqrt(enum.variance(population: population))
- * ```
+ * The values are summed in blocks of PAIRWISE_BLOCK_LEN values, and the
+ * block sums are added up along a binary tree, so that the rounding error
+ * grows as O(log n) instead of O(n) of the naive summation.
  *
- * @return [Number] A standard deviation value
- */
-static VALUE
-enum_stdev(int argc, VALUE* argv, VALUE obj)
+ * The shape of the tree depends only on the number of the values.  The
+ * parallel calculation assigns the subtrees at a fixed depth to the threads
+ * and combines their sums along the same tree, so its result is the same as
+ * the serial one bit by bit, whatever the parallelism is. */
+
+#define PAIRWISE_BLOCK_LEN 128
+#define PAIRWISE_LANES 8
+
+/* The maximum number of the subtrees assigned to the threads */
+#define PAIRWISE_NODES_MAX PARALLELISM_MAX
+
+/* The length of the left subtree of a tree on n values, where n is larger
+ * than PAIRWISE_BLOCK_LEN.  The left subtree has the first half of the
+ * blocks. */
+static inline long
+pairwise_split(long n)
 {
-  VALUE variance = enum_variance(argc, argv, obj);
-  VALUE stdev = sqrt_value(variance);
-  return stdev;
+  long const nblocks = (n + PAIRWISE_BLOCK_LEN - 1) / PAIRWISE_BLOCK_LEN;
+  return nblocks / 2 * PAIRWISE_BLOCK_LEN;
 }
 
-/* call-seq:
- *    ary.mean_stdev(population: false)
- *
- * Calculate a mean and a standard deviation of the values in `ary`.
- * The first element of the result array is the mean,
- * and the second is the standard deviation.
- *
- * This method is equivalent to:
- *
- * ```ruby
- * def mean_stdev(population: false)
- *   m, v = mean_variance(population: population)
- *   [m, Math.sqrt(v)]
- * end
- * ```
- *
- * @return (mean, stdev)
- */
-static VALUE
-ary_mean_stdev(int argc, VALUE* argv, VALUE ary)
+/* Sum a block in independent lanes, which the compiler can vectorize
+ * without reordering the additions. */
+static double
+pairwise_block_sum(const double *p, long n)
 {
-  struct variance_opts options;
-  VALUE opts, mean, variance;
-  size_t ddof = 1;
+  double s[PAIRWISE_LANES] = { 0.0 };
+  double sum;
+  long i, j;
 
-  rb_scan_args(argc, argv, "0:", &opts);
-  get_variance_opts(opts, &options);
-  if (options.population)
-    ddof = 0;
+  for (i = 0; i + PAIRWISE_LANES <= n; i += PAIRWISE_LANES) {
+    for (j = 0; j < PAIRWISE_LANES; ++j)
+      s[j] += p[i + j];
+  }
+  sum = ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+  for (; i < n; ++i)
+    sum += p[i];
 
-  ary_mean_variance(ary, &mean, &variance, ddof, options.skip_na);
-  VALUE stdev = sqrt_value(variance);
-  return rb_assoc_new(mean, stdev);
+  return sum;
 }
 
-/* call-seq:
- *    ary.stdev(population: false)
- *
- * Calculate a standard deviation of the values in `ary`.
- *
- * This method is equivalent to:
- *
- * ```ruby
- * Math.sqrt(ary.variance(population: population))
- * ```
- *
- * @return [Number] A standard deviation value
- */
-static VALUE
-ary_stdev(int argc, VALUE* argv, VALUE ary)
+static double
+pairwise_sum(const double *p, long n)
 {
-  VALUE variance = ary_variance(argc, argv, ary);
-  VALUE stdev = sqrt_value(variance);
-  return stdev;
+  long m;
+
+  if (n <= PAIRWISE_BLOCK_LEN)
+    return pairwise_block_sum(p, n);
+
+  m = pairwise_split(n);
+  return pairwise_sum(p, m) + pairwise_sum(p + m, n - m);
 }
 
-static int
-ary_percentile_sort_cmp(const void *ap, const void *bp, void *dummy)
+struct pairwise_node {
+  const double *p;
+  long n;
+  double sum;
+};
+
+/* Collect the subtrees at the given depth, or the leaves above it,
+ * in order. */
+static void
+pairwise_collect(const double *p, long n, int depth,
+                 struct pairwise_node *nodes, long *count)
 {
-  VALUE a = *(const VALUE *)ap, b = *(const VALUE *)bp;
-  VALUE cmp;
+  long m;
 
-  if (is_na(a)) {
-    return -1;
-  }
-  else if (is_na(b)) {
-    return 1;
+  if (depth == 0 || n <= PAIRWISE_BLOCK_LEN) {
+    nodes[*count].p = p;
+    nodes[*count].n = n;
+    ++*count;
+    return;
   }
 
-  /* TODO: optimize */
-  cmp = rb_funcall(a, id_cmp, 1, b);
-  return rb_cmpint(cmp, a, b);
+  m = pairwise_split(n);
+  pairwise_collect(p, m, depth - 1, nodes, count);
+  pairwise_collect(p + m, n - m, depth - 1, nodes, count);
 }
 
-static VALUE
-ary_percentile_make_sorted(VALUE ary)
+/* Add up the sums of the nodes collected by pairwise_collect along the
+ * same tree. */
+static double
+pairwise_combine(long n, int depth, const struct pairwise_node *nodes, long *index)
 {
-  long n, i;
-  VALUE sorted;
+  double left;
+  long m;
 
-  n = RARRAY_LEN(ary);
-  sorted = rb_ary_tmp_new(n);
-  for (i = 0; i < n; ++i) {
-    rb_ary_push(sorted, RARRAY_AREF(ary, i));
-  }
-  RARRAY_PTR_USE(sorted, ptr, {
-    ruby_qsort(ptr, n, sizeof(VALUE),
-               ary_percentile_sort_cmp, NULL);
-  });
-  return sorted;
+  if (depth == 0 || n <= PAIRWISE_BLOCK_LEN)
+    return nodes[(*index)++].sum;
+
+  m = pairwise_split(n);
+  left = pairwise_combine(m, depth - 1, nodes, index);
+  return left + pairwise_combine(n - m, depth - 1, nodes, index);
 }
 
-static inline VALUE
-ary_percentile_single_sorted(VALUE sorted, long n, double d)
+struct pairwise_chunk {
+  struct pairwise_node *nodes;
+  long count;
+};
+
+static void *
+pairwise_chunk_sum(void *ptr)
 {
-  VALUE x0, x1;
-  double i, f;
-  long l;
+  struct pairwise_chunk *chunk = (struct pairwise_chunk *)ptr;
+  long i;
 
-  assert(RB_TYPE_P(sorted, T_ARRAY));
-  assert(n == RARRAY_LEN(sorted));
-  assert(n > 0);
+  for (i = 0; i < chunk->count; ++i)
+    chunk->nodes[i].sum = pairwise_sum(chunk->nodes[i].p, chunk->nodes[i].n);
+  return NULL;
+}
 
-  if (d < 0 || 100 < d) {
-    rb_raise(rb_eArgError, "percentile out of bounds");
-  }
+struct nogvl_pairwise_sum_args {
+  double *p;
+  long n;
+  long nchunks;
+  int skip_na;
+  double sum;
+  long na_count;
+};
 
-  if (is_na(RARRAY_AREF(sorted, 0))) {
-    return DBL2NUM(nan(""));
+static void *
+nogvl_pairwise_sum(void *ptr)
+{
+  struct nogvl_pairwise_sum_args *args = (struct nogvl_pairwise_sum_args *)ptr;
+  struct pairwise_node nodes[PAIRWISE_NODES_MAX];
+  struct pairwise_chunk chunks[PARALLELISM_MAX];
+  long const k = args->nchunks;
+  long i, count = 0, index = 0;
+  int depth = 0;
+
+  /* The buffer is owned by the caller, so NA values are removed in place */
+  args->na_count = 0;
+  if (args->skip_na) {
+    long j = 0;
+    for (i = 0; i < args->n; ++i) {
+      if (!isnan(args->p[i]))
+        args->p[j++] = args->p[i];
+    }
+    args->na_count = args->n - j;
+    args->n = j;
   }
 
-  n = RARRAY_LEN(sorted);
-  if (n == 1) {
-    return RARRAY_AREF(sorted, 0);
+  if (k <= 1) {
+    args->sum = pairwise_sum(args->p, args->n);
+    return NULL;
   }
 
-  d = (n - 1) * d / 100.0;
-  f = modf(d, &i);
-  l = (long)i;
+  while ((1L << depth) < k)
+    ++depth;
+  pairwise_collect(args->p, args->n, depth, nodes, &count);
 
-  x0 = RARRAY_AREF(sorted, l);
-  if (f == 0 || l == n - 1) {
-    return x0;
+  for (i = 0; i < k; ++i) {
+    long const lo = count * i / k, hi = count * (i + 1) / k;
+    chunks[i].nodes = nodes + lo;
+    chunks[i].count = hi - lo;
   }
+  parallel_run(pairwise_chunk_sum, chunks, sizeof(chunks[0]), k);
 
-  x0 = rb_funcall(x0, idSTAR, 1, DBL2NUM(1 - f));
-  x1 = RARRAY_AREF(sorted, l + 1);
-  x1 = rb_funcall(x1, idSTAR, 1, DBL2NUM(f));
-
-  return rb_funcall(x0, idPLUS, 1, x1);
+  args->sum = pairwise_combine(args->n, depth, nodes, &index);
+  return NULL;
 }
 
-static VALUE
-ary_percentile_single(VALUE ary, VALUE q)
-{
-  long n;
-  double d;
-  VALUE qf, sorted;
-
-  assert(RB_TYPE_P(ary, T_ARRAY));
-
-  n = RARRAY_LEN(ary);
-  assert(n > 0);
-
-  switch (TYPE(q)) {
-    case T_FIXNUM:
-      d = (double)FIX2LONG(q);
-      break;
-    case T_BIGNUM:
-      d = rb_big2dbl(q);
-      break;
-
-    case T_RATIONAL:
-      /* fall through */
-    default:
-      qf = NUM2DBL(q);
-      goto float_percentile;
+/* Collecting the values for pairwise summation into a native buffer */
 
-    case T_FLOAT:
-      qf = q;
-float_percentile:
-      d = RFLOAT_VALUE(qf);
-      break;
-  }
+struct pairwise_values_memo {
+  int block_given;
+  int skip_na;
+  long na_count;
+  VALUE buf;
+  struct na_cache na;
+};
 
-  if (n == 1) {
-    return RARRAY_AREF(ary, 0);
+static void
+pairwise_values_iter(VALUE e, struct pairwise_values_memo *memo)
+{
+  if (memo->block_given)
+    e = rb_yield(e);
+  if (memo->skip_na && is_na_cached(e, &memo->na)) {
+    ++memo->na_count;
+    return;
   }
+  dbl_buffer_push(memo->buf, value_to_dbl(e));
+}
 
-  sorted = ary_percentile_make_sorted(ary);
-
-  return ary_percentile_single_sorted(sorted, n, d);
+/* Sum the values in memo->buf by pairwise summation.  The number of the
+ * summed values is stored in *count_ptr. */
+static double
+pairwise_values_sum(struct pairwise_values_memo *memo, long *count_ptr)
+{
+  struct nogvl_pairwise_sum_args args;
+
+  args.p = DBL_BUFFER_PTR(memo->buf);
+  args.n = DBL_BUFFER_LEN(memo->buf);
+  args.nchunks = parallel_chunk_count(args.n);
+  args.skip_na = memo->skip_na;
+  call_without_gvl_if_large(nogvl_pairwise_sum, &args, args.n);
+  RB_GC_GUARD(memo->buf);
+
+  memo->na_count += args.na_count;
+  *count_ptr = args.n;
+  return args.sum;
 }
 
-/* call-seq:
- *    ary.percentile(q) -> float
- *
- * Calculate specified percentiles of the values in `ary`.
- *
- * @param [Number, Array] percentile or array of percentiles to compute,
- *   which must be between 0 and 100 inclusive.
- *
- * @return [Float, Array] A percentile value(s)
- */
+/* The mean of count values whose sum is sum.  The mean of no values is
+ * 0.0 as the other means, but NaN if all the values are skipped. */
 static VALUE
-ary_percentile(VALUE ary, VALUE q)
+pairwise_values_mean(const struct pairwise_values_memo *memo, double sum, long count)
 {
-  long n, m, i;
-  double d;
-  VALUE qf, qs, sorted, res;
+  if (count == 0 && memo->na_count == 0)
+    return DBL2NUM(0.0);
+  return DBL2NUM(sum / count);
+}
 
-  n = RARRAY_LEN(ary);
-  if (n == 0) {
-    rb_raise(rb_eArgError, "unable to compute percentile(s) for an empty array");
+VALUE
+ary_calculate_sum(VALUE ary, VALUE init, int skip_na, long *na_count_out)
+{
+  VALUE e, v, r;
+  long i;
+  wide_int n;
+  struct rational_acc ra;
+  struct na_cache na;
+  int block_given;
+  long na_count = 0;
+
+  block_given = rb_block_given_p();
+  na_cache_init(&na);
+
+  if (RARRAY_LEN(ary) == 0) {
+    if (na_count_out != NULL) {
+      *na_count_out = 0;
+    }
+    return init;
   }
 
-  qs = rb_check_convert_type(q, T_ARRAY, "Array", "to_ary");
-  if (NIL_P(qs)) {
-    return ary_percentile_single(ary, q);
+  if (!block_given && (FIXNUM_P(init) || RB_FLOAT_TYPE_P(init))) {
+    VALUE buf = ary_numeric_snapshot(ary, NUMERIC_SNAPSHOT_NAN);
+    if (!NIL_P(buf)) {
+      struct nogvl_sum_args args;
+
+      args.p = DBL_BUFFER_PTR(buf);
+      args.n = DBL_BUFFER_LEN(buf);
+      args.nchunks = parallel_chunk_count(args.n);
+      args.validity = NULL;
+      args.validity_offset = 0;
+      args.skip_na = skip_na;
+      args.f = NUM2DBL(init);
+      args.c = 0.0;
+      call_without_gvl(nogvl_sum, &args);
+      RB_GC_GUARD(buf);
+
+      if (na_count_out != NULL) {
+        *na_count_out = args.na_count;
+      }
+      return DBL2NUM(args.f);
+    }
   }
 
-  m = RARRAY_LEN(qs);
-  res = rb_ary_new_capa(m);
+  n = 0;
+  rational_acc_init(&ra);
+  r = Qundef;
+  v = init;
+  for (i = 0; i < RARRAY_LEN(ary); i++) {
+    e = RARRAY_AREF(ary, i);
+    if (block_given)
+      e = rb_yield(e);
+    if (skip_na && is_na_cached(e, &na)) {
+      ++na_count;
+      continue;
+    }
 
-  if (m == 1) {
-    q = RARRAY_AREF(qs, 0);
-    rb_ary_push(res, ary_percentile_single(ary, q));
+    if (FIXNUM_P(e) || RB_TYPE_P(e, T_BIGNUM))
+      wide_int_add(&n, &v, e);
+    else if (RB_TYPE_P(e, T_RATIONAL))
+      rational_acc_add(&ra, &r, e);
+    else
+      goto not_exact;
   }
-  else {
-    sorted = ary_percentile_make_sorted(ary);
 
-    for (i = 0; i < m; ++i) {
-      VALUE x;
+  v = wide_int_flush(n, v);
+  r = rational_acc_flush(&ra, r);
+  if (r != Qundef)
+    v = rb_rational_plus(r, v);
+  goto finish;
 
-      q = RARRAY_AREF(qs, i);
-      switch (TYPE(q)) {
-        case T_FIXNUM:
-          d = (double)FIX2LONG(q);
-          break;
-        case T_BIGNUM:
-          d = rb_big2dbl(q);
-          break;
+not_exact:
+  v = wide_int_flush(n, v);
+  r = rational_acc_flush(&ra, r);
+  if (r != Qundef)
+    v = rb_rational_plus(r, v);
 
-        case T_RATIONAL:
-          /* fall through */
-        default:
-          qf = NUM2DBL(q);
-          goto float_percentile;
+  if (RB_FLOAT_TYPE_P(e)) {
+    /* Kahan's compensated summation algorithm */
+    double f, c;
 
-        case T_FLOAT:
-          qf = q;
-float_percentile:
-          d = RFLOAT_VALUE(qf);
-          break;
+    f = NUM2DBL(v);
+    c = 0.0;
+    goto has_float_value;
+    for (; i < RARRAY_LEN(ary); i++) {
+      double x, y, t;
+      e = RARRAY_AREF(ary, i);
+      if (block_given)
+        e = rb_yield(e);
+      if (skip_na && is_na_cached(e, &na)) {
+        ++na_count;
+        continue;
       }
 
-      x = ary_percentile_single_sorted(sorted, n, d);
-      rb_ary_push(res, x);
+      if (RB_FLOAT_TYPE_P(e))
+        has_float_value:
+          x = RFLOAT_VALUE(e);
+      else if (FIXNUM_P(e))
+        x = FIX2LONG(e);
+      else if (RB_TYPE_P(e, T_BIGNUM))
+        x = rb_big2dbl(e);
+      else if (RB_TYPE_P(e, T_RATIONAL))
+        x = rb_num2dbl(e);
+      else
+        goto not_float;
+
+      y = x - c;
+      t = f + y;
+      c = (t - f) - y;
+      f = t;
     }
+
+    v = DBL2NUM(f);
+    goto finish;
+
+  not_float:
+    v = DBL2NUM(f);
   }
 
-  return res;
-}
+  if (RB_TYPE_P(e, T_COMPLEX)) {
+    /* Kahan's compensated summation on the real and imaginary parts */
+    double fr, cr, fi, ci, xr, xi;
 
-/* call-seq:
- *    ary.median -> float
- *
- * Calculate a median of the values in `ary`.
- *
- * @return [Float] A median value
- */
-static VALUE
-ary_median(VALUE ary)
-{
-  long n;
-  VALUE sorted, a0, a1;
+    if (!real_to_dbl(v, &fr) || !complex_to_dbl(e, &xr, &xi))
+      goto has_some_value;
+    /* -0.0 keeps the sign of the first imaginary part as Complex#+ does */
+    fi = -0.0;
+    cr = ci = 0.0;
+    goto has_complex_value;
+    for (; i < RARRAY_LEN(ary); i++) {
+      e = RARRAY_AREF(ary, i);
+      if (block_given)
+        e = rb_yield(e);
+      if (skip_na && is_na_cached(e, &na)) {
+        ++na_count;
+        continue;
+      }
 
-  n = RARRAY_LEN(ary);
-  switch (n) {
-    case 0:
-      goto return_nan;
-    case 1:
-      return RARRAY_AREF(ary, 0);
-    case 2:
-      a0 = RARRAY_AREF(ary, 0);
-      a1 = RARRAY_AREF(ary, 1);
-      goto mean_two;
-    default:
-      break;
-  }
+      if (RB_TYPE_P(e, T_COMPLEX)) {
+        if (!complex_to_dbl(e, &xr, &xi))
+          goto not_complex;
+      has_complex_value:
+        kahan_add(&fi, &ci, xi);
+      }
+      else if (!real_to_dbl(e, &xr))
+        goto not_complex;
+      kahan_add(&fr, &cr, xr);
+    }
 
-  sorted = ary_percentile_make_sorted(ary);
+    v = dbl_complex_new(fr, fi);
+    goto finish;
 
-  a0 = RARRAY_AREF(sorted, 0);
-  if (is_na(a0)) {
-return_nan:
-    return DBL2NUM(nan(""));
+  not_complex:
+    v = dbl_complex_new(fr, fi);
   }
 
-  a1 = RARRAY_AREF(sorted, n / 2);
-  if (n % 2 == 1) {
-    return a1;
-  }
-  else {
-    a0 = RARRAY_AREF(sorted, n / 2 - 1);
+  goto has_some_value;
+  for (; i < RARRAY_LEN(ary); i++) {
+    e = RARRAY_AREF(ary, i);
+    if (block_given)
+      e = rb_yield(e);
+    if (skip_na && is_na_cached(e, &na)) {
+      ++na_count;
+      continue;
+    }
+  has_some_value:
+    v = rb_funcall(v, idPLUS, 1, e);
+  }
+
+finish:
+  if (na_count_out != NULL) {
+    *na_count_out = na_count;
+  }
+  return v;
+}
+
+/* Calculate the sum and the mean of the values in ary with exact
+ * summation.  init is added to the sum, but is not counted for the mean. */
+static void
+ary_exact_sum(VALUE ary, VALUE init, int skip_na, VALUE *sum_ptr, VALUE *mean_ptr)
+{
+  struct exact_sum_memo memo;
+  long i;
+
+  exact_sum_memo_init(&memo, skip_na);
+  exact_sum_add(&memo, init);
+  for (i = 0; i < RARRAY_LEN(ary); ++i)
+    exact_sum_iter(RARRAY_AREF(ary, i), &memo);
+
+  if (sum_ptr)
+    *sum_ptr = exact_sum_memo_result(&memo);
+  SET_MEAN(exact_sum_memo_mean(&memo));
+}
+
+/* Calculate the sum and the mean of the values in ary by pairwise
+ * summation.  init is added to the sum, but is not counted for the mean. */
+static void
+ary_pairwise_sum(VALUE ary, VALUE init, int skip_na, VALUE *sum_ptr, VALUE *mean_ptr)
+{
+  struct pairwise_values_memo memo;
+  double sum;
+  long i, count;
+
+  memo.block_given = rb_block_given_p();
+  memo.skip_na = skip_na;
+  memo.na_count = 0;
+  na_cache_init(&memo.na);
+  memo.buf = Qnil;
+  if (!memo.block_given)
+    memo.buf = ary_numeric_snapshot(ary, NUMERIC_SNAPSHOT_FIXNUM | NUMERIC_SNAPSHOT_NAN);
+  if (NIL_P(memo.buf)) {
+    memo.buf = dbl_buffer_new(RARRAY_LEN(ary));
+    for (i = 0; i < RARRAY_LEN(ary); ++i)
+      pairwise_values_iter(RARRAY_AREF(ary, i), &memo);
+  }
+
+  sum = pairwise_values_sum(&memo, &count);
+  if (sum_ptr)
+    *sum_ptr = rb_funcall(init, idPLUS, 1, DBL2NUM(sum));
+  SET_MEAN(pairwise_values_mean(&memo, sum, count));
+}
+
+/* Calculate the mean and the variance of the values in ary exactly.
+ * They are Rational if all the values are Integer or Rational,
+ * and the correctly rounded Float of the exact results otherwise.
+ *
+ * The sum and the sum of squares of Integer values are accumulated in
+ * wide_int counters, so that no Bignum is allocated for each value.
+ * Float values are converted to Rational for the variance. */
+static void
+ary_exact_mean_variance(VALUE ary, VALUE *mean_ptr, VALUE *variance_ptr,
+                        size_t ddof, int skip_na)
+{
+  wide_int s1 = 0, s2 = 0;
+  struct rational_acc ra1, ra2;
+  VALUE v1 = INT2FIX(0), v2 = INT2FIX(0);
+  VALUE r1 = Qundef, r2 = Qundef;
+  VALUE e, n, numer, denom, mean, variance;
+  int const block_given = rb_block_given_p();
+  int float_p = 0;
+  double special = 0.0;
+  long i, count = 0;
+  struct na_cache na;
+
+  if (variance_ptr == NULL) {
+    ary_exact_sum(ary, INT2FIX(0), skip_na, NULL, mean_ptr);
+    return;
+  }
+
+  rational_acc_init(&ra1);
+  rational_acc_init(&ra2);
+  na_cache_init(&na);
+  for (i = 0; i < RARRAY_LEN(ary); ++i) {
+    e = RARRAY_AREF(ary, i);
+    if (block_given)
+      e = rb_yield(e);
+    if (skip_na && is_na_cached(e, &na))
+      continue;
+
+    if (RB_FLOAT_TYPE_P(e)) {
+      float_p = 1;
+      if (!isfinite(RFLOAT_VALUE(e))) {
+        special += RFLOAT_VALUE(e);
+        ++count;
+        continue;
+      }
+      e = rb_funcall(e, id_to_r, 0);
+    }
+
+    if (FIXNUM_P(e) || RB_TYPE_P(e, T_BIGNUM)) {
+      wide_int_add(&s1, &v1, e);
+      wide_int_add_square(&s2, &v2, e);
+    }
+    else if (RB_TYPE_P(e, T_RATIONAL)) {
+      rational_acc_add(&ra1, &r1, e);
+      rational_acc_add_square(&ra2, &r2, e);
+    }
+    else {
+      rb_raise(rb_eTypeError,
+               "exact calculation needs Integer, Rational, or Float values (%"PRIsVALUE" given)",
+               rb_obj_class(e));
+    }
+    ++count;
+  }
+
+  SET_VARIANCE(DBL2NUM(NAN));
+  if (special != 0.0) {
+    SET_MEAN(DBL2NUM(special));
+    return;
+  }
+
+  v1 = wide_int_flush(s1, v1);
+  r1 = rational_acc_flush(&ra1, r1);
+  if (r1 != Qundef)
+    v1 = rb_rational_plus(r1, v1);
+
+  n = LONG2NUM(count);
+  if (count == 0) {
+    SET_MEAN(rb_rational_new(INT2FIX(0), INT2FIX(1)));
+    return;
+  }
+  mean = rb_funcall(v1, id_quo, 1, n);
+  SET_MEAN(float_p ? DBL2NUM(exact_to_dbl(mean)) : mean);
+
+  if (count < 2)
+    return;
+
+  v2 = wide_int_flush(s2, v2);
+  r2 = rational_acc_flush(&ra2, r2);
+  if (r2 != Qundef)
+    v2 = rb_rational_plus(r2, v2);
+
+  /* (n * sum(x^2) - sum(x)^2) / (n * (n - ddof)) */
+  numer = rb_funcall(rb_funcall(n, idSTAR, 1, v2), idMINUS, 1, rb_funcall(v1, idSTAR, 1, v1));
+  denom = rb_funcall(n, idSTAR, 1, LONG2NUM(count - (long)ddof));
+  variance = rb_funcall(numer, id_quo, 1, denom);
+  SET_VARIANCE(float_p ? DBL2NUM(exact_to_dbl(variance)) : variance);
+}
+
+/* Return whether the value of `exact:` option is true.  The exact
+ * calculation cannot be combined with `weights:`. */
+static int
+exact_p(VALUE exact, VALUE weights)
+{
+  if (exact == Qundef || !RTEST(exact))
+    return 0;
+  if (!NIL_P(weights))
+    rb_raise(rb_eArgError, "Unable to use both `exact` and `weights` together");
+  return 1;
+}
+
+/* Take `exact:` option out of *kwargs_ptr, and return whether it is true. */
+static int
+opt_exact(VALUE *kwargs_ptr, VALUE weights)
+{
+  return exact_p(kwargs_take(kwargs_ptr, id_exact), weights);
+}
+
+/* Return whether the value of `algorithm:` option is `:pairwise`.  The
+ * default algorithm is `:kahan`.  Pairwise summation cannot be combined
+ * with `exact:` and `weights:`. */
+static int
+pairwise_p(VALUE algorithm, VALUE weights, int exact)
+{
+  if (algorithm == Qundef || algorithm == ID2SYM(id_kahan))
+    return 0;
+  if (algorithm != ID2SYM(id_pairwise))
+    rb_raise(rb_eArgError, "unknown algorithm: %"PRIsVALUE, rb_inspect(algorithm));
+  if (exact)
+    rb_raise(rb_eArgError, "Unable to use both `exact` and `algorithm: :pairwise` together");
+  if (!NIL_P(weights))
+    rb_raise(rb_eArgError, "Unable to use both `weights` and `algorithm: :pairwise` together");
+  return 1;
+}
+
+/* Take `algorithm:` option out of *kwargs_ptr, and return whether it is
+ * `:pairwise`. */
+static int
+opt_pairwise(VALUE *kwargs_ptr, VALUE weights, int exact)
+{
+  return pairwise_p(kwargs_take(kwargs_ptr, id_algorithm), weights, exact);
+}
+
+/* call-seq:
+ *    ary.sum(skip_na: false, exact: false, algorithm: :kahan, key: nil, index: nil)
+ *
+ * Calculate the sum of the values in `ary`.
+ * This method utilizes
+ * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
+ * to compensate the result precision when the `ary` includes Float values.
+ *
+ * When `key:` or `index:` is given, the values are taken from
+ * `row[key]` or `row[index]` of each row in `ary`.
+ * Hash, Struct, and Array rows are looked up without calling `[]`.
+ *
+ * When `exact:` is `true`, the values must be Integer, Rational, or Float.
+ * The sum of Float values is calculated without rounding errors by
+ * Shewchuk's algorithm, and the result is the correctly rounded Float.
+ *
+ * When `algorithm:` is `:pairwise`, the values are converted to Float and
+ * summed by pairwise summation.  Its result is the same bit by bit whatever
+ * `EnumerableStatistics.parallelism` is.
+ *
+ * Note that This library does not redefine `sum` method introduced in Ruby 2.4.
+ *
+ * @return [Number] A summation value
+ */
+static VALUE
+ary_sum(int argc, VALUE* argv, VALUE ary)
+{
+  VALUE v, opts;
+  int exact, pairwise, skip_na;
+
+  if (rb_scan_args(argc, argv, "01:", &v, &opts) == 0) {
+    v = LONG2FIX(0);
+  }
+  ary = ary_extract_field(ary, &opts);
+  exact = opt_exact(&opts, Qnil);
+  pairwise = opt_pairwise(&opts, Qnil, exact);
+  skip_na = opt_skip_na(opts);
+
+  if (exact) {
+    ary_exact_sum(ary, v, skip_na, &v, NULL);
+    return v;
+  }
+  if (pairwise) {
+    ary_pairwise_sum(ary, v, skip_na, &v, NULL);
+    return v;
+  }
+
+#ifndef HAVE_ENUM_SUM
+  if (!skip_na) {
+    return rb_funcall(orig_ary_sum, rb_intern("call"), argc, &v);
+  }
+#endif
+
+  return ary_calculate_sum(ary, v, skip_na, NULL);
+}
+
+static void
+calculate_and_set_mean(VALUE *mean_ptr, VALUE sum, long const n)
+{
+  if (RB_TYPE_P(sum, T_COMPLEX)) {
+    VALUE real_mean, imag_mean;
+    VALUE const real = RCOMPLEX(sum)->real;
+    VALUE const imag = RCOMPLEX(sum)->imag;
+
+    if (RB_FLOAT_TYPE_P(real))
+      real_mean = DBL2NUM(RFLOAT_VALUE(real) / n);
+    else
+      real_mean = rb_funcall(real, idDIV, 1, DBL2NUM(n));
+
+    if (RB_FLOAT_TYPE_P(imag))
+      imag_mean = DBL2NUM(RFLOAT_VALUE(imag) / n);
+    else
+      imag_mean = rb_funcall(imag, idDIV, 1, DBL2NUM(n));
+
+    SET_MEAN(complex_new(CLASS_OF(sum), real_mean, imag_mean));
+  }
+  else if (RB_FLOAT_TYPE_P(sum)) {
+    SET_MEAN(DBL2NUM(RFLOAT_VALUE(sum) / n));
+  }
+  else
+    SET_MEAN(rb_funcall(sum, idDIV, 1, DBL2NUM(n)));
+}
+
+struct enum_mean_variance_memo {
+  int block_given;
+  int skip_na;
+  int order;
+  int allow_complex; /* set by the callers that can return a Complex mean */
+  int complex_p;
+  size_t n;
+  double m, m2, m3, m4, f, c;
+  double mi, fi, ci; /* the imaginary parts while complex_p is true */
+  struct na_cache na;
+};
+
+static void
+mean_variance_memo_init(struct enum_mean_variance_memo *memo, int order, int skip_na)
+{
+  assert(memo != NULL);
+  assert(2 <= order && order <= 4);
+
+  memo->block_given = rb_block_given_p();
+  memo->skip_na = skip_na;
+  na_cache_init(&memo->na);
+  memo->order = order;
+  memo->n = 0;
+  memo->m = 0.0;
+  memo->m2 = 0.0;
+  memo->m3 = 0.0;
+  memo->m4 = 0.0;
+  memo->f = 0.0;
+  memo->c = 0.0;
+  memo->allow_complex = 0;
+  memo->complex_p = 0;
+  memo->mi = 0.0;
+  memo->fi = 0.0;
+  memo->ci = 0.0;
+}
+
+/* Update the running sum and central moments by the value x.
+ *
+ * The mean and the second moment are updated by Welford's algorithm.
+ * When memo->order is greater than 2, the third and fourth moments are
+ * also updated by the extension of the recurrence by Terriberry (2007). */
+static inline void
+mean_variance_update(struct enum_mean_variance_memo *memo, double x)
+{
+  double delta, delta_n;
+  size_t const n = memo->n + 1;
+
+  kahan_add(&memo->f, &memo->c, x);
+
+  delta = x - memo->m;
+  delta_n = delta / n;
+
+  if (memo->order > 2) {
+    double const dn = (double)n;
+    double const delta_n2 = delta_n * delta_n;
+    double const term = delta * delta_n * (dn - 1);
+
+    memo->m += delta_n;
+    memo->m4 += term * delta_n2 * (dn*dn - 3*dn + 3)
+              + 6 * delta_n2 * memo->m2 - 4 * delta_n * memo->m3;
+    memo->m3 += term * delta_n * (dn - 2) - 3 * delta_n * memo->m2;
+    memo->m2 += term;
+  }
+  else {
+    memo->m += delta_n;
+    memo->m2 += delta * (x - memo->m);
+  }
+
+  memo->n = n;
+}
+
+/* Update the running sums and the second moment by the complex value
+ * xr + xi*i.  The second moment is the sum of |x - mean|**2 so that the
+ * variance E|x - mean|**2 is a real number. */
+static inline void
+mean_variance_update_complex(struct enum_mean_variance_memo *memo, double xr, double xi)
+{
+  size_t const n = memo->n + 1;
+  double const dr = xr - memo->m, di = xi - memo->mi;
+
+  assert(memo->order == 2);
+
+  kahan_add(&memo->f, &memo->c, xr);
+  kahan_add(&memo->fi, &memo->ci, xi);
+
+  memo->m += dr / n;
+  memo->mi += di / n;
+  memo->m2 += dr * (xr - memo->m) + di * (xi - memo->mi);
+
+  memo->n = n;
+}
+
+/* Update memo by the value e.  A Complex value switches memo to complex
+ * moments if memo->allow_complex is true; the real values before and
+ * after it are treated as complex values whose imaginary parts are zero. */
+static inline void
+mean_variance_update_value(struct enum_mean_variance_memo *memo, VALUE e)
+{
+  double xr, xi = 0.0;
+
+  if (RB_TYPE_P(e, T_COMPLEX) && memo->allow_complex) {
+    xr = value_to_dbl(RCOMPLEX(e)->real);
+    xi = value_to_dbl(RCOMPLEX(e)->imag);
+    memo->complex_p = 1;
+  }
+  else
+    xr = value_to_dbl(e);
+
+  if (memo->complex_p)
+    mean_variance_update_complex(memo, xr, xi);
+  else
+    mean_variance_update(memo, xr);
+}
+
+/* Return the mean in memo, which is a Complex if memo->complex_p is true. */
+static VALUE
+mean_variance_memo_mean(const struct enum_mean_variance_memo *memo)
+{
+  if (memo->complex_p)
+    return dbl_complex_new(memo->f / memo->n, memo->fi / memo->n);
+  return DBL2NUM(memo->f / memo->n);
+}
+
+/* Merge the running sum and central moments in b into a.
+ *
+ * The moments are combined by the pairwise formulas by Chan et al. (1979)
+ * and their extension to the higher moments by Pebay (2008). */
+static void
+mean_variance_merge(struct enum_mean_variance_memo *a,
+                    const struct enum_mean_variance_memo *b)
+{
+  double na, nb, n, delta, delta_n;
+
+  if (b->n == 0)
+    return;
+
+  kahan_add(&a->f, &a->c, b->f);
+  kahan_add(&a->f, &a->c, -b->c);
+
+  if (a->n == 0) {
+    a->n = b->n;
+    a->m = b->m;
+    a->m2 = b->m2;
+    a->m3 = b->m3;
+    a->m4 = b->m4;
+    return;
+  }
+
+  na = (double)a->n;
+  nb = (double)b->n;
+  n = na + nb;
+  delta = b->m - a->m;
+  delta_n = delta / n;
+
+  if (a->order > 2) {
+    a->m4 += b->m4
+           + delta * delta_n * delta_n * delta_n * na * nb * (na*na - na*nb + nb*nb)
+           + 6 * delta_n * delta_n * (na*na * b->m2 + nb*nb * a->m2)
+           + 4 * delta_n * (na * b->m3 - nb * a->m3);
+    a->m3 += b->m3
+           + delta * delta_n * delta_n * na * nb * (na - nb)
+           + 3 * delta_n * (na * b->m2 - nb * a->m2);
+  }
+  a->m2 += b->m2 + delta * delta_n * na * nb;
+  a->m += delta_n * nb;
+  a->n += b->n;
+}
+
+struct nogvl_moments_args {
+  const double *p;
+  long n;
+  long nchunks;
+  const uint64_t *validity; /* NULL if all the slots are valid */
+  long validity_offset;
+  struct enum_mean_variance_memo *memo;
+};
+
+static void *
+moments_chunk(void *ptr)
+{
+  struct nogvl_moments_args *args = (struct nogvl_moments_args *)ptr;
+  struct enum_mean_variance_memo st = *args->memo;
+  long i, pos = 0, start, end, valid = 0;
+
+  while (validity_next_run(args->validity, args->validity_offset, args->n,
+                           &pos, &start, &end)) {
+    for (i = start; i < end; ++i) {
+      double const x = args->p[i];
+      if (st.skip_na && isnan(x))
+        continue;
+      mean_variance_update(&st, x);
+    }
+    valid += end - start;
+  }
+
+  /* The invalid slots are NA values */
+  if (valid < args->n && !st.skip_na)
+    mean_variance_update(&st, NAN);
+
+  *args->memo = st;
+  return NULL;
+}
+
+static void *
+nogvl_moments(void *ptr)
+{
+  struct nogvl_moments_args *args = (struct nogvl_moments_args *)ptr;
+  struct nogvl_moments_args chunks[PARALLELISM_MAX];
+  struct enum_mean_variance_memo memos[PARALLELISM_MAX];
+  long const k = args->nchunks;
+  long i;
+
+  if (k <= 1)
+    return moments_chunk(args);
+
+  for (i = 0; i < k; ++i) {
+    long const lo = args->n * i / k, hi = args->n * (i + 1) / k;
+    memos[i] = *args->memo;
+    if (i > 0) {
+      memos[i].n = 0;
+      memos[i].m = memos[i].m2 = memos[i].m3 = memos[i].m4 = 0.0;
+      memos[i].f = memos[i].c = 0.0;
+    }
+    chunks[i].p = args->p + lo;
+    chunks[i].n = hi - lo;
+    chunks[i].nchunks = 1;
+    chunks[i].validity = args->validity;
+    chunks[i].validity_offset = args->validity_offset + lo;
+    chunks[i].memo = &memos[i];
+  }
+  parallel_run(moments_chunk, chunks, sizeof(chunks[0]), k);
+
+  /* Merge the partial moments in the order of the chunks */
+  for (i = 1; i < k; ++i)
+    mean_variance_merge(&memos[0], &memos[i]);
+  *args->memo = memos[0];
+  return NULL;
+}
+
+static void
+ary_moments(VALUE ary, struct enum_mean_variance_memo *memo)
+{
+  /* Work on a local copy so that the accumulators can stay in registers
+   * across rb_yield calls. */
+  struct enum_mean_variance_memo st = *memo;
+  long i;
+
+  if (!memo->block_given) {
+    int const flags = NUMERIC_SNAPSHOT_FIXNUM | NUMERIC_SNAPSHOT_NAN;
+    VALUE buf = ary_numeric_snapshot(ary, flags);
+    if (!NIL_P(buf)) {
+      struct nogvl_moments_args args;
+
+      args.p = DBL_BUFFER_PTR(buf);
+      args.n = DBL_BUFFER_LEN(buf);
+      args.nchunks = parallel_chunk_count(args.n);
+      args.validity = NULL;
+      args.validity_offset = 0;
+      args.memo = memo;
+      call_without_gvl(nogvl_moments, &args);
+      RB_GC_GUARD(buf);
+      return;
+    }
+  }
+
+  for (i = 0; i < RARRAY_LEN(ary); ++i) {
+    VALUE e;
+
+    e = RARRAY_AREF(ary, i);
+    if (st.block_given)
+      e = rb_yield(e);
+    if (st.skip_na && is_na_cached(e, &st.na))
+      continue;
+
+    mean_variance_update_value(&st, e);
+  }
+
+  *memo = st;
+}
+
+static void
+ary_mean_variance(VALUE ary, VALUE *mean_ptr, VALUE *variance_ptr, size_t ddof, int skip_na)
+{
+  long na_count;
+  struct enum_mean_variance_memo memo;
+
+  SET_MEAN(DBL2NUM(0));
+  SET_VARIANCE(DBL2NUM(NAN));
+
+  if (RARRAY_LEN(ary) == 0)
+    return;
+  else if (RARRAY_LEN(ary) == 1) {
+    VALUE e = RARRAY_AREF(ary, 0);
+    if (rb_block_given_p())
+      e = rb_yield(e);
+    if (RB_TYPE_P(e, T_COMPLEX))
+      SET_MEAN(e);
+    else {
+      e = rb_Float(e);
+      SET_MEAN(e);
+    }
+    return;
+  }
+
+  if (variance_ptr == NULL) {
+    VALUE init = DBL2NUM(0.0);
+    VALUE const sum = ary_calculate_sum(ary, init, skip_na, &na_count);
+    long const n = RARRAY_LEN(ary) - na_count;
+    calculate_and_set_mean(mean_ptr, sum, n);
+    return;
+  }
+
+  mean_variance_memo_init(&memo, 2, skip_na);
+  memo.allow_complex = 1;
+  ary_moments(ary, &memo);
+
+  if (memo.n == 0)
+    return;
+
+  SET_MEAN(mean_variance_memo_mean(&memo));
+  if (memo.n >= 2) {
+    assert(memo.n > ddof);
+    SET_VARIANCE(DBL2NUM(memo.m2 / (memo.n - ddof)));
+  }
+}
+
+/* Copy the values in ary and their weights into a native buffer of
+ * (value, weight) pairs.  The pairs of zero weight, and of NA values if
+ * skip_na is true, are dropped.  NA values that are kept are stored as
+ * NaN if na_as_nan is true.  The values are passed to the block if it is
+ * given. */
+static VALUE
+ary_weighted_snapshot(VALUE ary, VALUE weights, int skip_na, int na_as_nan)
+{
+  int const block_given = rb_block_given_p();
+  long const n = RARRAY_LEN(ary);
+  VALUE buf = dbl_buffer_new(2*n);
+  double *p;
+  long i, len = 0;
+  struct na_cache na;
+
+  na_cache_init(&na);
+  for (i = 0; i < n && i < RARRAY_LEN(ary); ++i) {
+    VALUE e;
+    double w;
+
+    /* the block may have changed the weight array */
+    if (i >= RARRAY_LEN(weights)) {
+      rb_raise(rb_eArgError, "weight array must have the same number of items as the receiver array");
+    }
+    e = RARRAY_AREF(ary, i);
+    w = value_to_dbl(RARRAY_AREF(weights, i));
+
+    if (!(w >= 0) || isinf(w)) {
+      rb_raise(rb_eArgError, "weights must be non-negative finite numbers");
+    }
+    if (block_given)
+      e = rb_yield(e);
+    if (w == 0 || (skip_na && is_na_cached(e, &na)))
+      continue;
+
+    p = DBL_BUFFER_PTR(buf);
+    p[len++] = (na_as_nan && is_na_cached(e, &na)) ? NAN : value_to_dbl(e);
+    p[len++] = w;
+  }
+  rb_str_set_len(buf, len * (long)sizeof(double));
+
+  return buf;
+}
+
+struct weighted_moments_args {
+  const double *p;  /* (value, weight) pairs */
+  long n;
+  double w, mean, m2;
+};
+
+/* Calculate the weighted mean and the weighted sum of squared deviations
+ * by West's (1979) extension of Welford's algorithm. */
+static void *
+weighted_moments(void *ptr)
+{
+  struct weighted_moments_args *args = (struct weighted_moments_args *)ptr;
+  const double *p = args->p;
+  double w = 0.0, mean = 0.0, m2 = 0.0;
+  long i;
+
+  for (i = 0; i < args->n; ++i) {
+    double const x = p[2*i], wi = p[2*i + 1];
+    double const delta = x - mean;
+
+    w += wi;
+    mean += delta * (wi / w);
+    m2 += wi * delta * (x - mean);
+  }
+
+  args->w = w;
+  args->mean = mean;
+  args->m2 = m2;
+  return NULL;
+}
+
+/* The weights are treated as frequency weights: the result is the same
+ * as the one of the array in which each value is repeated by its weight. */
+static void
+ary_weighted_mean_variance(VALUE ary, VALUE weights, VALUE *mean_ptr, VALUE *variance_ptr,
+                           size_t ddof, int skip_na)
+{
+  struct weighted_moments_args args;
+  VALUE buf;
+
+  SET_MEAN(DBL2NUM(0));
+  SET_VARIANCE(DBL2NUM(NAN));
+
+  buf = ary_weighted_snapshot(ary, weights, skip_na, 0);
+  args.p = DBL_BUFFER_PTR(buf);
+  args.n = DBL_BUFFER_LEN(buf) / 2;
+  if (args.n == 0)
+    return;
+
+  call_without_gvl_if_large(weighted_moments, &args, args.n);
+  RB_GC_GUARD(buf);
+
+  SET_MEAN(DBL2NUM(args.mean));
+  if (args.w > ddof) {
+    SET_VARIANCE(DBL2NUM(args.m2 / (args.w - ddof)));
+  }
+}
+
+struct variance_opts {
+  int population;
+  int skip_na;
+};
+
+static void
+get_variance_opts(VALUE opts, struct variance_opts *out)
+{
+  assert(out != NULL);
+
+  out->population = 0;
+  out->skip_na = 0;
+
+  if (!NIL_P(opts)) {
+#ifdef HAVE_RB_GET_KWARGS
+    ID kwarg_keys[2];
+    VALUE kwarg_vals[2];
+
+    kwarg_keys[0] = id_population;
+    kwarg_keys[1] = id_skip_na;
+
+    rb_get_kwargs(opts, kwarg_keys, 0, 2, kwarg_vals);
+    out->population = (kwarg_vals[0] != Qundef) ? RTEST(kwarg_vals[0]) : out->population;
+    out->skip_na = (kwarg_vals[1] != Qundef) ? RTEST(kwarg_vals[1]) : out->skip_na;
+#else
+    VALUE val;
+
+    val = rb_hash_aref(opts, ID2SYM(id_population));
+    out->population = NIL_P(val) ? out->population : RTEST(val);
+
+    val = rb_hash_aref(opts, ID2SYM(id_skip_na));
+    out->skip_na = NIL_P(val) ? out->skip_na : RTEST(val);
+#endif
+  }
+}
+
+/* call-seq:
+ *    ary.mean_variance(population: false, skip_na: false, weights: nil, exact: false, key: nil, index: nil)
+ *
+ * Calculate a mean and a variance of the values in `ary`.
+ * The first element of the result array is the mean, and the second is the variance.
+ *
+ * When `key:` or `index:` is given, the values are taken from
+ * `row[key]` or `row[index]` of each row in `ary`.
+ * Hash, Struct, and Array rows are looked up without calling `[]`.
+ *
+ * When `weights:` is given, each value is weighted by the non-negative
+ * weight at the same index, as if it were repeated by the weight.
+ *
+ * When `exact:` is `true`, the results are calculated exactly.  They are
+ * Rational if the values are Integer or Rational, and Float converted
+ * from the exact results if the values have Float.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the variance is calculated as a population variance (divided by $n$).
+ * The default `population:` keyword parameter is `false`;
+ * this means the variance is a sample variance (divided by $n-1$).
+ *
+ * This method scan values in `ary` only once,
+ * and does not cache the values on memory.
+ *
+ * @return (mean, variance) Two element array consists of mean and variance values
+ */
+static VALUE
+ary_mean_variance_m(int argc, VALUE* argv, VALUE ary)
+{
+  struct variance_opts options;
+  VALUE opts, weights, mean = Qnil, variance = Qnil;
+  size_t ddof = 1;
+  int exact;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  ary = ary_extract_field(ary, &opts);
+  weights = ary_extract_weights(ary, &opts);
+  exact = opt_exact(&opts, weights);
+  get_variance_opts(opts, &options);
+  if (options.population)
+    ddof = 0;
+
+  if (exact)
+    ary_exact_mean_variance(ary, &mean, &variance, ddof, options.skip_na);
+  else if (!NIL_P(weights))
+    ary_weighted_mean_variance(ary, weights, &mean, &variance, ddof, options.skip_na);
+  else
+    ary_mean_variance(ary, &mean, &variance, ddof, options.skip_na);
+  return rb_assoc_new(mean, variance);
+}
+
+/* call-seq:
+ *    ary.mean(skip_na: false, weights: nil, exact: false, algorithm: :kahan, key: nil, index: nil)
+ *
+ * Calculate a mean of the values in `ary`.
+ * This method utilizes
+ * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
+ * to compensate the result precision when the `enum` includes Float values.
+ *
+ * When `key:` or `index:` is given, the values are taken from
+ * `row[key]` or `row[index]` of each row in `ary`.
+ * Hash, Struct, and Array rows are looked up without calling `[]`.
+ *
+ * When `weights:` is given, each value is weighted by the non-negative
+ * weight at the same index, as if it were repeated by the weight.
+ *
+ * When `exact:` is `true`, the results are calculated exactly.  They are
+ * Rational if the values are Integer or Rational, and Float converted
+ * from the exact results if the values have Float.
+ *
+ * When `algorithm:` is `:pairwise`, the values are converted to Float and
+ * summed by pairwise summation, as `sum(algorithm: :pairwise)`.
+ *
+ * @return [Number] A mean value
+ */
+static VALUE
+ary_mean(int argc, VALUE *argv, VALUE ary)
+{
+  VALUE mean = Qnil, opts, weights;
+  int exact, pairwise, skip_na;
+
+  rb_scan_args(argc, argv, ":", &opts);
+  ary = ary_extract_field(ary, &opts);
+  weights = ary_extract_weights(ary, &opts);
+  exact = opt_exact(&opts, weights);
+  pairwise = opt_pairwise(&opts, weights, exact);
+  skip_na = opt_skip_na(opts);
+
+  if (exact)
+    ary_exact_mean_variance(ary, &mean, NULL, 1, skip_na);
+  else if (pairwise)
+    ary_pairwise_sum(ary, INT2FIX(0), skip_na, NULL, &mean);
+  else if (!NIL_P(weights))
+    ary_weighted_mean_variance(ary, weights, &mean, NULL, 1, skip_na);
+  else
+    ary_mean_variance(ary, &mean, NULL, 1, skip_na);
+  return mean;
+}
+
+/* call-seq:
+ *    ary.variance(population: false, skip_na: false, weights: nil, exact: false, key: nil, index: nil)
+ *
+ * Calculate a variance of the values in `ary`.
+ * This method scan values in `ary` only once,
+ * and does not cache the values on memory.
+ *
+ * When `key:` or `index:` is given, the values are taken from
+ * `row[key]` or `row[index]` of each row in `ary`.
+ * Hash, Struct, and Array rows are looked up without calling `[]`.
+ *
+ * When `weights:` is given, each value is weighted by the non-negative
+ * weight at the same index, as if it were repeated by the weight.
+ *
+ * When `exact:` is `true`, the results are calculated exactly.  They are
+ * Rational if the values are Integer or Rational, and Float converted
+ * from the exact results if the values have Float.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the variance is calculated as a population variance (divided by $n$).
+ * The default `population:` keyword parameter is `false`;
+ * this means the variance is a sample variance (divided by $n-1$).
+ *
+ * @return [Number] A variance value
+ */
+static VALUE
+ary_variance(int argc, VALUE* argv, VALUE ary)
+{
+  struct variance_opts options;
+  VALUE opts, weights, variance;
+  size_t ddof = 1;
+  int exact;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  ary = ary_extract_field(ary, &opts);
+  weights = ary_extract_weights(ary, &opts);
+  exact = opt_exact(&opts, weights);
+  get_variance_opts(opts, &options);
+  if (options.population)
+    ddof = 0;
+
+  if (exact)
+    ary_exact_mean_variance(ary, NULL, &variance, ddof, options.skip_na);
+  else if (!NIL_P(weights))
+    ary_weighted_mean_variance(ary, weights, NULL, &variance, ddof, options.skip_na);
+  else
+    ary_mean_variance(ary, NULL, &variance, ddof, options.skip_na);
+  return variance;
+}
+
+#define ENUM_WANT_SVALUE() do { \
+  e = rb_enum_values_pack(argc, argv); \
+} while (0)
+
+struct enum_sum_memo {
+  VALUE v, r;
+  wide_int n;
+  struct rational_acc ra;
+  long count;
+  double f, c;
+  double fi, ci; /* the imaginary part while complex_value is true */
+  int block_given;
+  int float_value;
+  int complex_value;
+  int skip_na;
+  struct na_cache na;
+};
+
+static void
+sum_iter(VALUE e, struct enum_sum_memo *memo)
+{
+  int const unused = (assert(memo != NULL), 0);
+
+  wide_int n = memo->n;
+  VALUE v = memo->v;
+  VALUE r = memo->r;
+  double f = memo->f;
+  double c = memo->c;
+  double fi = memo->fi;
+  double ci = memo->ci;
+  double xr, xi;
+
+  if (memo->block_given) {
+    e = rb_yield(e);
+  }
+  if (memo->skip_na && is_na_cached(e, &memo->na)) {
+    return;
+  }
+
+  memo->count += 1;
+
+  if (memo->float_value)
+    goto float_value;
+  if (memo->complex_value)
+    goto complex_value;
+
+  if (FIXNUM_P(v) || RB_TYPE_P(v, T_BIGNUM) || RB_TYPE_P(v, T_RATIONAL)) {
+    if (FIXNUM_P(e) || RB_TYPE_P(e, T_BIGNUM))
+      wide_int_add(&n, &v, e);
+    else if (RB_TYPE_P(e, T_RATIONAL))
+      rational_acc_add(&memo->ra, &r, e);
+    else {
+      v = wide_int_flush(n, v);
+      n = 0;
+      r = rational_acc_flush(&memo->ra, r);
+      rational_acc_init(&memo->ra);
+      if (r != Qundef) {
+        v = rb_rational_plus(r, v);
+        r = Qundef;
+      }
+      if (RB_FLOAT_TYPE_P(e)) {
+        f = NUM2DBL(v);
+        c = 0.0;
+        memo->float_value = 1;
+        goto float_value;
+      }
+      else if (complex_to_dbl(e, &xr, &xi)) {
+        f = NUM2DBL(v);
+        fi = -0.0; /* keeps the sign of xi as Complex#+ does */
+        c = ci = 0.0;
+        memo->complex_value = 1;
+        goto has_complex_value;
+      }
+      else
+        goto some_value;
+    }
+  }
+  else if (RB_FLOAT_TYPE_P(v)) {
+    /* Kahan's compensated summation algorithm */
+    double x, y, t;
+
+  float_value:
+    if (RB_FLOAT_TYPE_P(e))
+      x = RFLOAT_VALUE(e);
+    else if (FIXNUM_P(e))
+      x = FIX2LONG(e);
+    else if (RB_TYPE_P(e, T_BIGNUM))
+      x = rb_big2dbl(e);
+    else if (RB_TYPE_P(e, T_RATIONAL))
+      x = rb_num2dbl(e);
+    else if (complex_to_dbl(e, &xr, &xi)) {
+      fi = -0.0; /* keeps the sign of xi as Complex#+ does */
+      ci = 0.0;
+      memo->float_value = 0;
+      memo->complex_value = 1;
+      goto has_complex_value;
+    }
+    else {
+      v = DBL2NUM(f);
+      memo->float_value = 0;
+      goto some_value;
+    }
+
+    y = x - c;
+    t = f + y;
+    c = (t - f) - y;
+    f = t;
+  }
+  else if (memo->complex_value) {
+    /* Kahan's compensated summation on the real and imaginary parts */
+  complex_value:
+    if (RB_TYPE_P(e, T_COMPLEX)) {
+      if (!complex_to_dbl(e, &xr, &xi))
+        goto not_complex;
+    has_complex_value:
+      kahan_add(&fi, &ci, xi);
+    }
+    else if (!real_to_dbl(e, &xr)) {
+    not_complex:
+      v = dbl_complex_new(f, fi);
+      memo->complex_value = 0;
+      goto some_value;
+    }
+    kahan_add(&f, &c, xr);
+  }
+  else {
+  some_value:
+    v = rb_funcall(v, idPLUS, 1, e);
+  }
+
+  memo->v = v;
+  memo->n = n;
+  memo->r = r;
+  memo->f = f;
+  memo->c = c;
+  memo->fi = fi;
+  memo->ci = ci;
+  (void)unused;
+}
+
+static VALUE
+enum_sum_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  ENUM_WANT_SVALUE();
+  sum_iter(e, (struct enum_sum_memo *) args);
+  return Qnil;
+}
+
+static int
+hash_sum_i(VALUE key, VALUE value, VALUE arg)
+{
+  sum_iter(rb_assoc_new(key, value), (struct enum_sum_memo *) arg);
+  return ST_CONTINUE;
+}
+
+static void
+hash_sum(VALUE hash, struct enum_sum_memo *memo)
+{
+  assert(RB_TYPE_P(hash, T_HASH));
+  assert(memo != NULL);
+
+  rb_hash_foreach(hash, hash_sum_i, (VALUE)memo);
+}
+
+/* An arithmetic progression of n values: first, first + step, ...,
+ * and the last value, which can be clamped to the end of the sequence
+ * in the case of Float values. */
+struct arith_progression {
+  int integer_p; /* whether all of first, step, and last are Integers */
+  VALUE n;       /* an Integer */
+  VALUE first, step, last;
+};
+
+/* Extract the arithmetic progression of the values that obj yields,
+ * if obj is an Integer Range or a finite Enumerator::ArithmeticSequence
+ * of Integer or Float values.  This returns 0 otherwise. */
+static int
+arith_progression_extract(VALUE obj, struct arith_progression *ap)
+{
+  if (!rb_method_basic_definition_p(CLASS_OF(obj), id_each))
+    return 0;
+
+  if (RTEST(rb_obj_is_kind_of(obj, rb_cRange))) {
+    VALUE beg, end;
+    int excl;
+
+    if (!RTEST(rb_range_values(obj, &beg, &end, &excl)) ||
+        !RB_INTEGER_TYPE_P(beg) || !RB_INTEGER_TYPE_P(end))
+      return 0;
+
+    ap->integer_p = 1;
+    ap->first = beg;
+    ap->step = LONG2FIX(1);
+    ap->last = excl ? rb_int_minus(end, LONG2FIX(1)) : end;
+    if (rb_int_ge(ap->last, beg))
+      ap->n = rb_int_plus(rb_int_minus(ap->last, beg), LONG2FIX(1));
+    else
+      ap->n = LONG2FIX(0);
+    return 1;
+  }
+
+#ifdef HAVE_RB_ARITHMETIC_SEQUENCE_EXTRACT
+  {
+    rb_arithmetic_sequence_components_t c;
+
+    /* obj is an Enumerator::ArithmeticSequence here, since a Range has
+     * already been handled */
+    if (!rb_arithmetic_sequence_extract(obj, &c))
+      return 0;
+    if (!(RB_INTEGER_TYPE_P(c.begin) || RB_FLOAT_TYPE_P(c.begin)) ||
+        !(RB_INTEGER_TYPE_P(c.end) || RB_FLOAT_TYPE_P(c.end)) ||
+        !(RB_INTEGER_TYPE_P(c.step) || RB_FLOAT_TYPE_P(c.step)))
+      return 0;
+
+    /* Enumerator::ArithmeticSequence#size and #last are calculated
+     * without iteration */
+    ap->n = rb_funcall(obj, id_size, 0);
+    if (!RB_INTEGER_TYPE_P(ap->n))
+      return 0;
+
+    ap->integer_p = RB_INTEGER_TYPE_P(c.begin) && RB_INTEGER_TYPE_P(c.end) &&
+                    RB_INTEGER_TYPE_P(c.step);
+    if (ap->integer_p) {
+      ap->first = c.begin;
+      ap->step = c.step;
+      ap->last = rb_int_plus(c.begin, f_mul(rb_int_minus(ap->n, LONG2FIX(1)), c.step));
+    }
+    else {
+      ap->first = DBL2NUM(NUM2DBL(c.begin));
+      ap->step = DBL2NUM(NUM2DBL(c.step));
+      ap->last = ap->n == INT2FIX(0) ? ap->first : rb_funcall(obj, id_last, 0);
+    }
+    return 1;
+  }
+#endif
+
+  return 0;
+}
+
+/* The sum of an Integer progression */
+static VALUE
+arith_progression_int_sum(const struct arith_progression *ap)
+{
+  assert(ap->integer_p);
+  return f_idiv(f_mul(ap->n, rb_int_plus(ap->first, ap->last)), LONG2FIX(2));
+}
+
+/* Set the running sum and moments of a Float progression to memo */
+static void
+arith_progression_moments(const struct arith_progression *ap,
+                          struct enum_mean_variance_memo *memo)
+{
+  struct enum_mean_variance_memo last = *memo;
+  double const first = RFLOAT_VALUE(ap->first), step = RFLOAT_VALUE(ap->step);
+  double n;
+
+  assert(!ap->integer_p);
+
+  if (ap->n == INT2FIX(0))
+    return;
+
+  /* The values but the last one are first + i*step for i in 0...n */
+  n = NUM2DBL(ap->n) - 1;
+  memo->n = (size_t)n;
+  memo->f = n * first + step * (n * (n - 1) / 2);
+  memo->c = 0.0;
+  memo->m = first + step * ((n - 1) / 2);
+  memo->m2 = step * step * n * (n * n - 1) / 12;
+
+  last.n = 0;
+  last.m = last.m2 = last.f = last.c = 0.0;
+  mean_variance_update(&last, NUM2DBL(ap->last));
+  mean_variance_merge(memo, &last);
+}
+
+/* Calculate the mean and the variance of an arithmetic progression
+ * without iteration */
+static void
+arith_progression_mean_variance(const struct arith_progression *ap,
+                                VALUE *mean_ptr, VALUE *variance_ptr, size_t ddof)
+{
+  SET_MEAN(DBL2NUM(0));
+  SET_VARIANCE(DBL2NUM(NAN));
+
+  if (ap->n == INT2FIX(0))
+    return;
+
+  if (ap->integer_p) {
+    VALUE const n = ap->n;
+    VALUE v;
+
+    SET_MEAN(rb_funcall(arith_progression_int_sum(ap), id_fdiv, 1, n));
+    if (!rb_int_ge(n, LONG2FIX(2)))
+      return;
+
+    /* step**2 * n*(n+1) / 12 for the sample variance,
+     * and step**2 * (n**2 - 1) / 12 for the population variance */
+    if (ddof == 0)
+      v = rb_int_minus(f_mul(n, n), LONG2FIX(1));
+    else
+      v = f_mul(n, rb_int_plus(n, LONG2FIX(1)));
+    v = f_mul(v, f_mul(ap->step, ap->step));
+    SET_VARIANCE(rb_funcall(v, id_fdiv, 1, LONG2FIX(12)));
+  }
+  else {
+    struct enum_mean_variance_memo memo;
+
+    mean_variance_memo_init(&memo, 2, 0);
+    arith_progression_moments(ap, &memo);
+
+    SET_MEAN(DBL2NUM(memo.f / memo.n));
+    if (memo.n >= 2)
+      SET_VARIANCE(DBL2NUM(memo.m2 / (double)(memo.n - ddof)));
+  }
+}
+
+static void
+enum_sum_memo_init(struct enum_sum_memo *memo, VALUE init, int skip_na)
+{
+  memo->count = 0;
+  memo->v = init;
+  memo->block_given = rb_block_given_p();
+  memo->n = 0;
+  rational_acc_init(&memo->ra);
+  memo->r = Qundef;
+  memo->skip_na = skip_na;
+  na_cache_init(&memo->na);
+
+  memo->complex_value = 0;
+  memo->fi = memo->ci = 0.0;
+  if ((memo->float_value = RB_FLOAT_TYPE_P(memo->v))) {
+    memo->f = RFLOAT_VALUE(memo->v);
+    memo->c = 0.0;
+  }
+}
+
+/* Return the sum accumulated in memo so far.  This does not change memo,
+ * so that the summation can continue after this. */
+static VALUE
+enum_sum_memo_result(const struct enum_sum_memo *memo)
+{
+  VALUE v = memo->v, r;
+
+  if (memo->float_value)
+    return DBL2NUM(memo->f);
+  if (memo->complex_value)
+    return dbl_complex_new(memo->f, memo->fi);
+
+  v = wide_int_flush(memo->n, v);
+  r = rational_acc_flush(&memo->ra, memo->r);
+  if (r != Qundef)
+    v = rb_rational_plus(r, v);
+  return v;
+}
+
+static void
+enum_sum_count(VALUE obj, VALUE init, int skip_na, VALUE *sum_ptr, long *count_ptr)
+{
+  struct enum_sum_memo memo;
+  struct arith_progression ap;
+
+  enum_sum_memo_init(&memo, init, skip_na);
+
+  if (!memo.block_given && !memo.float_value && RB_INTEGER_TYPE_P(init) &&
+      arith_progression_extract(obj, &ap) && ap.integer_p &&
+      (count_ptr == NULL || FIXNUM_P(ap.n))) {
+    if (sum_ptr)
+      *sum_ptr = rb_int_plus(init, arith_progression_int_sum(&ap));
+    if (count_ptr)
+      *count_ptr = FIX2LONG(ap.n);
+    return;
+  }
+
+  if (RB_TYPE_P(obj, T_HASH) &&
+      rb_method_basic_definition_p(CLASS_OF(obj), id_each))
+    hash_sum(obj, &memo);
+  else
+    rb_block_call(obj, id_each, 0, 0, enum_sum_i, (VALUE)&memo);
+
+  if (sum_ptr)
+    *sum_ptr = enum_sum_memo_result(&memo);
+  if (count_ptr)
+    *count_ptr = memo.count;
+}
+
+static VALUE
+enum_exact_sum_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  ENUM_WANT_SVALUE();
+  exact_sum_iter(e, (struct exact_sum_memo *)args);
+  return Qnil;
+}
+
+/* Calculate the sum and the mean of the values in obj with exact
+ * summation.  init is added to the sum, but is not counted for the mean. */
+static void
+enum_exact_sum(VALUE obj, VALUE init, int skip_na, VALUE *sum_ptr, VALUE *mean_ptr)
+{
+  struct exact_sum_memo memo;
+
+  exact_sum_memo_init(&memo, skip_na);
+  exact_sum_add(&memo, init);
+  rb_block_call(obj, id_each, 0, 0, enum_exact_sum_i, (VALUE)&memo);
+
+  if (sum_ptr)
+    *sum_ptr = exact_sum_memo_result(&memo);
+  SET_MEAN(exact_sum_memo_mean(&memo));
+}
+
+static VALUE
+enum_pairwise_sum_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  ENUM_WANT_SVALUE();
+  pairwise_values_iter(e, (struct pairwise_values_memo *)args);
+  return Qnil;
+}
+
+/* Calculate the sum and the mean of the values in obj by pairwise
+ * summation.  init is added to the sum, but is not counted for the mean. */
+static void
+enum_pairwise_sum(VALUE obj, VALUE init, int skip_na, VALUE *sum_ptr, VALUE *mean_ptr)
+{
+  struct pairwise_values_memo memo;
+  double sum;
+  long count;
+
+  memo.block_given = rb_block_given_p();
+  memo.skip_na = skip_na;
+  memo.na_count = 0;
+  na_cache_init(&memo.na);
+  memo.buf = dbl_buffer_new(16);
+  rb_block_call(obj, id_each, 0, 0, enum_pairwise_sum_i, (VALUE)&memo);
+
+  sum = pairwise_values_sum(&memo, &count);
+  if (sum_ptr)
+    *sum_ptr = rb_funcall(init, idPLUS, 1, DBL2NUM(sum));
+  SET_MEAN(pairwise_values_mean(&memo, sum, count));
+}
+
+/* call-seq:
+ *    enum.sum(skip_na: false, exact: false, algorithm: :kahan)
+ *
+ * Calculate the sum of the values in `enum`.
+ * This method utilizes
+ * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
+ * to compensate the result precision when the `enum` includes Float values.
+ *
+ * When `exact:` is `true`, the values must be Integer, Rational, or Float.
+ * The sum of Float values is calculated without rounding errors by
+ * Shewchuk's algorithm, and the result is the correctly rounded Float.
+ *
+ * When `algorithm:` is `:pairwise`, the values are collected into a native
+ * buffer of Float values, and summed by pairwise summation.
+ *
+ * Note that This library does not redefine `sum` method introduced in Ruby 2.4.
+ *
+ * @return [Number] A summation value
+ */
+static VALUE
+enum_sum(int argc, VALUE* argv, VALUE obj)
+{
+  VALUE sum, init, opts;
+  int exact, pairwise, skip_na;
+
+  if (rb_scan_args(argc, argv, "01:", &init, &opts) == 0) {
+    init = LONG2FIX(0);
+  }
+  exact = opt_exact(&opts, Qnil);
+  pairwise = opt_pairwise(&opts, Qnil, exact);
+  skip_na = opt_skip_na(opts);
+
+  if (exact) {
+    enum_exact_sum(obj, init, skip_na, &sum, NULL);
+    return sum;
+  }
+  if (pairwise) {
+    enum_pairwise_sum(obj, init, skip_na, &sum, NULL);
+    return sum;
+  }
+
+#ifndef HAVE_ENUM_SUM
+  if (skip_na) {
+    enum_sum_count(obj, init, skip_na, &sum, NULL);
+  }
+  else {
+    rb_funcall(orig_enum_sum, rb_intern("call"), argc, &init);
+  }
+#else
+  enum_sum_count(obj, init, skip_na, &sum, NULL);
+#endif
+
+  return sum;
+}
+
+/* Cumulative sums and products
+ *
+ * Each prefix sum is accumulated by sum_iter in the same way as
+ * `Enumerable#sum`, so the last element of `cumsum` is the same as it. */
+
+struct cumulative_memo {
+  int block_given;
+  int skip_na;
+  struct enum_sum_memo sum;
+  VALUE prod;
+  VALUE result;
+};
+
+static void
+cumulative_memo_init(struct cumulative_memo *memo, VALUE init, int skip_na, long capa)
+{
+  memo->block_given = rb_block_given_p();
+  memo->skip_na = skip_na;
+  enum_sum_memo_init(&memo->sum, init, skip_na);
+  memo->sum.block_given = 0; /* the block is called by cumsum_iter */
+  memo->prod = init;
+  memo->result = rb_ary_new_capa(capa);
+}
+
+static void
+cumsum_iter(VALUE e, struct cumulative_memo *memo)
+{
+  struct enum_sum_memo *sum = &memo->sum;
+
+  if (memo->block_given)
+    e = rb_yield(e);
+  if (memo->skip_na && is_na_cached(e, &memo->sum.na)) {
+    rb_ary_push(memo->result, e);
+    return;
+  }
+
+  if (sum->float_value && RB_FLOAT_TYPE_P(e)) {
+    /* the same update as sum_iter, without the type dispatch */
+    kahan_add(&sum->f, &sum->c, RFLOAT_VALUE(e));
+    sum->count += 1;
+    rb_ary_push(memo->result, DBL2NUM(sum->f));
+    return;
+  }
+
+  sum_iter(e, sum);
+  rb_ary_push(memo->result, enum_sum_memo_result(sum));
+}
+
+static void
+cumprod_iter(VALUE e, struct cumulative_memo *memo)
+{
+  VALUE v = memo->prod;
+
+  if (memo->block_given)
+    e = rb_yield(e);
+  if (memo->skip_na && is_na_cached(e, &memo->sum.na)) {
+    rb_ary_push(memo->result, e);
+    return;
+  }
+
+  if (RB_FLOAT_TYPE_P(v) && RB_FLOAT_TYPE_P(e))
+    v = DBL2NUM(RFLOAT_VALUE(v) * RFLOAT_VALUE(e));
+  else
+    v = rb_funcall(v, idSTAR, 1, e);
+
+  memo->prod = v;
+  rb_ary_push(memo->result, v);
+}
+
+typedef void (*cumulative_iter_func)(VALUE, struct cumulative_memo *);
+
+static void
+cumulative_extract_args(int argc, VALUE *argv, VALUE default_init,
+                        VALUE *init_ptr, int *skip_na_ptr)
+{
+  VALUE opts;
+
+  if (rb_scan_args(argc, argv, "01:", init_ptr, &opts) == 0) {
+    *init_ptr = default_init;
+  }
+  *skip_na_ptr = opt_skip_na(opts);
+}
+
+static VALUE
+ary_cumulative(int argc, VALUE *argv, VALUE ary, VALUE default_init,
+               cumulative_iter_func iter)
+{
+  struct cumulative_memo memo;
+  VALUE init;
+  int skip_na;
+  long i;
+
+  cumulative_extract_args(argc, argv, default_init, &init, &skip_na);
+  cumulative_memo_init(&memo, init, skip_na, RARRAY_LEN(ary));
+
+  for (i = 0; i < RARRAY_LEN(ary); ++i) {
+    iter(RARRAY_AREF(ary, i), &memo);
+  }
+
+  return memo.result;
+}
+
+struct enum_cumulative_arg {
+  cumulative_iter_func iter;
+  struct cumulative_memo *memo;
+};
+
+static VALUE
+enum_cumulative_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  struct enum_cumulative_arg *arg = (struct enum_cumulative_arg *)args;
+  ENUM_WANT_SVALUE();
+  arg->iter(e, arg->memo);
+  return Qnil;
+}
+
+static VALUE
+enum_cumulative(int argc, VALUE *argv, VALUE obj, VALUE default_init,
+                cumulative_iter_func iter)
+{
+  struct cumulative_memo memo;
+  struct enum_cumulative_arg arg;
+  VALUE init;
+  int skip_na;
+
+  cumulative_extract_args(argc, argv, default_init, &init, &skip_na);
+  cumulative_memo_init(&memo, init, skip_na, 0);
+
+  arg.iter = iter;
+  arg.memo = &memo;
+  rb_block_call(obj, id_each, 0, 0, enum_cumulative_i, (VALUE)&arg);
+
+  return memo.result;
+}
+
+/* call-seq:
+ *    ary.cumsum(init=0, skip_na: false) -> array
+ *
+ * Calculate the cumulative sums of the values in `ary`.
+ * The i-th element of the result is the sum of the first i+1 values,
+ * which is calculated in the same way as `Enumerable#sum`, so Integer
+ * and Rational values are summed exactly and Float values are summed
+ * with Kahan summation algorithm.
+ *
+ * When `skip_na:` is `true`, NA values are not added to the sums,
+ * and they are left in the result at the same positions.
+ *
+ * @return [Array] The cumulative sums
+ */
+static VALUE
+ary_cumsum(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_cumulative(argc, argv, ary, LONG2FIX(0), cumsum_iter);
+}
+
+/* call-seq:
+ *    enum.cumsum(init=0, skip_na: false) -> array
+ *
+ * Calculate the cumulative sums of the values in `enum`.
+ * See `Array#cumsum`.
+ *
+ * @return [Array] The cumulative sums
+ */
+static VALUE
+enum_cumsum(int argc, VALUE *argv, VALUE obj)
+{
+  return enum_cumulative(argc, argv, obj, LONG2FIX(0), cumsum_iter);
+}
+
+/* call-seq:
+ *    ary.cumprod(init=1, skip_na: false) -> array
+ *
+ * Calculate the cumulative products of the values in `ary`.
+ * `skip_na:` works in the same way as `cumsum`.
+ *
+ * @return [Array] The cumulative products
+ */
+static VALUE
+ary_cumprod(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_cumulative(argc, argv, ary, LONG2FIX(1), cumprod_iter);
+}
+
+/* call-seq:
+ *    enum.cumprod(init=1, skip_na: false) -> array
+ *
+ * Calculate the cumulative products of the values in `enum`.
+ * See `Array#cumprod`.
+ *
+ * @return [Array] The cumulative products
+ */
+static VALUE
+enum_cumprod(int argc, VALUE *argv, VALUE obj)
+{
+  return enum_cumulative(argc, argv, obj, LONG2FIX(1), cumprod_iter);
+}
+
+static void
+mean_variance_iter(VALUE e, struct enum_mean_variance_memo *memo)
+{
+  assert(memo != NULL);
+
+  if (memo->block_given)
+    e = rb_yield(e);
+  if (memo->skip_na && is_na_cached(e, &memo->na))
+    return;
+
+  mean_variance_update_value(memo, e);
+}
+
+static VALUE
+enum_mean_variance_iter_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  struct enum_mean_variance_memo *memo = (struct enum_mean_variance_memo *)args;
+  ENUM_WANT_SVALUE();
+  mean_variance_iter(e, memo);
+  return Qnil;
+}
+
+static int
+hash_mean_variance_i(VALUE key, VALUE value, VALUE arg)
+{
+  mean_variance_iter(rb_assoc_new(key, value), (struct enum_mean_variance_memo *) arg);
+  return ST_CONTINUE;
+}
+
+static void
+hash_mean_variance(VALUE hash, struct enum_mean_variance_memo *memo)
+{
+  assert(RB_TYPE_P(hash, T_HASH));
+  assert(memo != NULL);
+
+  rb_hash_foreach(hash, hash_mean_variance_i, (VALUE)memo);
+}
+
+/* Note that an Enumerator such as `ary.each` is not routed to the Array
+ * kernels: the C API exposes neither the receiver nor the method of an
+ * Enumerator, and the enumerators of `each_with_index` or `each_index`
+ * yield different values from the ones of `each`.  An Enumerator passes
+ * the block of rb_block_call to its receiver, so it adds no extra frame
+ * per element compared with other enumerables. */
+static void
+enum_moments(VALUE obj, struct enum_mean_variance_memo *memo)
+{
+  if (RB_TYPE_P(obj, T_HASH) &&
+      rb_method_basic_definition_p(CLASS_OF(obj), id_each))
+    hash_mean_variance(obj, memo);
+  else
+    rb_block_call(obj, id_each, 0, 0, enum_mean_variance_iter_i, (VALUE)memo);
+}
+
+static void
+enum_mean_variance(VALUE obj, VALUE *mean_ptr, VALUE *variance_ptr, size_t ddof)
+{
+  struct enum_mean_variance_memo memo;
+  struct arith_progression ap;
+
+  if (!rb_block_given_p() && arith_progression_extract(obj, &ap)) {
+    arith_progression_mean_variance(&ap, mean_ptr, variance_ptr, ddof);
+    return;
+  }
+
+  SET_MEAN(DBL2NUM(0));
+  SET_VARIANCE(DBL2NUM(NAN));
+
+  if (variance_ptr == NULL) {
+    long n;
+    VALUE sum;
+    VALUE init = DBL2NUM(0.0);
+    enum_sum_count(obj, init, 0, &sum, &n); /* TODO: skip_na */
+    if (n > 0)
+      calculate_and_set_mean(mean_ptr, sum, n);
+    return;
+  }
+
+  mean_variance_memo_init(&memo, 2, 0);
+  memo.allow_complex = 1;
+  enum_moments(obj, &memo);
+
+  if (memo.n == 0)
+    return;
+  else if (memo.n == 1)
+    SET_MEAN(mean_variance_memo_mean(&memo));
+  else {
+    SET_MEAN(mean_variance_memo_mean(&memo));
+
+    assert(memo.n > ddof);
+    SET_VARIANCE(DBL2NUM(memo.m2 / (double)(memo.n - ddof)));
+  }
+}
+
+/* call-seq:
+ *    enum.mean_variance(population: false)
+ *
+ * Calculate a mean and a variance of the values in `enum`.
+ * The first element of the result array is the mean, and the second is the variance.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the variance is calculated as a population variance (divided by $n$).
+ * The default `population:` keyword parameter is `false`;
+ * this means the variance is a sample variance (divided by $n-1$).
+ *
+ * This method scan values in `enum` only once,
+ * and does not cache the values on memory.
+ *
+ * @return (mean, variance) Two element array consists of mean and variance values
+ */
+static VALUE
+enum_mean_variance_m(int argc, VALUE* argv, VALUE obj)
+{
+  struct variance_opts options;
+  VALUE opts, mean, variance;
+  size_t ddof = 1;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+  if (options.population)
+    ddof = 0;
+
+  enum_mean_variance(obj, &mean, &variance, ddof);
+  return rb_assoc_new(mean, variance);
+}
+
+/* call-seq:
+ *    enum.mean(exact: false, algorithm: :kahan)
+ *
+ * Calculate a mean of the values in `enum`.
+ * This method utilizes
+ * [Kahan summation algorithm](https://en.wikipedia.org/wiki/Kahan_summation_algorithm)
+ * to compensate the result precision when the `enum` includes Float values.
+ *
+ * When `exact:` is `true`, the values must be Integer, Rational, or Float.
+ * The mean is a Rational calculated exactly if the values have no Float,
+ * and the exact mean converted to Float otherwise.
+ *
+ * When `algorithm:` is `:pairwise`, the values are collected into a native
+ * buffer of Float values, and summed by pairwise summation.
+ *
+ * @return [Number] A mean value
+ */
+static VALUE
+enum_mean(int argc, VALUE *argv, VALUE obj)
+{
+  enum { kw_exact, kw_algorithm };
+  ID kwarg_keys[2];
+  VALUE mean, opts, kwarg_vals[2] = { Qundef, Qundef };
+  int exact, pairwise;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  if (!NIL_P(opts)) {
+    kwarg_keys[kw_exact]     = id_exact;
+    kwarg_keys[kw_algorithm] = id_algorithm;
+
+    rb_get_kwargs(opts, kwarg_keys, 0, 2, kwarg_vals);
+  }
+  exact = exact_p(kwarg_vals[kw_exact], Qnil);
+  pairwise = pairwise_p(kwarg_vals[kw_algorithm], Qnil, exact);
+
+  if (exact)
+    enum_exact_sum(obj, INT2FIX(0), 0, NULL, &mean);
+  else if (pairwise)
+    enum_pairwise_sum(obj, INT2FIX(0), 0, NULL, &mean);
+  else
+    enum_mean_variance(obj, &mean, NULL, 1);
+  return mean;
+}
+
+/* call-seq:
+ *    enum.variance(population: false)
+ *
+ * Calculate a variance of the values in `enum`.
+ * This method scan values in `enum` only once,
+ * and does not cache the values on memory.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the variance is calculated as a population variance (divided by $n$).
+ * The default `population:` keyword parameter is `false`;
+ * this means the variance is a sample variance (divided by $n-1$).
+ *
+ * @return [Number] A variance value
+ */
+static VALUE
+enum_variance(int argc, VALUE* argv, VALUE obj)
+{
+  struct variance_opts options;
+  VALUE opts, variance;
+  size_t ddof = 1;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+  if (options.population)
+    ddof = 0;
+
+  enum_mean_variance(obj, NULL, &variance, ddof);
+  return variance;
+}
+
+static VALUE
+sqrt_value(VALUE x)
+{
+  if (RB_INTEGER_TYPE_P(x) || RB_FLOAT_TYPE_P(x) || RB_TYPE_P(x, T_RATIONAL)) {
+    double f = NUM2DBL(x);
+    return DBL2NUM(sqrt(f));
+  }
+
+  return rb_funcall(x, idPow, 1, half_in_rational);
+}
+
+/* call-seq:
+ *    enum.mean_stdev(population: false)
+ *
+ * Calculate a mean and a standard deviation of the values in `enum`.
+ * The first element of the result array is the mean,
+ * and the second is the standard deviation.
+ *
+ * This method is equivalent to:
+ *
+ * ```ruby
+ * def mean_stdev(population: false)
+ *   m, v = mean_variance(population: population)
+ *   [m, Math.sqrt(v)]
+ * end
+ * ```
+ *
+ * @return (mean, stdev)
+ */
+static VALUE
+enum_mean_stdev(int argc, VALUE* argv, VALUE obj)
+{
+  struct variance_opts options;
+  VALUE opts, mean, variance;
+  size_t ddof = 1;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+  if (options.population)
+    ddof = 0;
+
+  enum_mean_variance(obj, &mean, &variance, ddof);
+  VALUE stdev = sqrt_value(variance);
+  return rb_assoc_new(mean, stdev);
+}
+
+/* call-seq:
+ *    enum.stdev(population: false)
+ *
+ * Calculate a standard deviation of the values in `enum`.
+ *
+ * This method is equivalent to:
+ *
+ * ```ruby
+ * Math.sqrt(enum.variance(population: population))
+ * ```
+ *
+ * @return [Number] A standard deviation value
+ */
+static VALUE
+enum_stdev(int argc, VALUE* argv, VALUE obj)
+{
+  VALUE variance = enum_variance(argc, argv, obj);
+  VALUE stdev = sqrt_value(variance);
+  return stdev;
+}
+
+/* call-seq:
+ *    ary.mean_stdev(population: false, weights: nil, exact: false, key: nil, index: nil)
+ *
+ * Calculate a mean and a standard deviation of the values in `ary`.
+ * The first element of the result array is the mean,
+ * and the second is the standard deviation.
+ *
+ * This method is equivalent to:
+ *
+ * ```ruby
+ * def mean_stdev(population: false)
+ *   m, v = mean_variance(population: population)
+ *   [m, Math.sqrt(v)]
+ * end
+ * ```
+ *
+ * @return (mean, stdev)
+ */
+static VALUE
+ary_mean_stdev(int argc, VALUE* argv, VALUE ary)
+{
+  struct variance_opts options;
+  VALUE opts, weights, mean, variance;
+  size_t ddof = 1;
+  int exact;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  ary = ary_extract_field(ary, &opts);
+  weights = ary_extract_weights(ary, &opts);
+  exact = opt_exact(&opts, weights);
+  get_variance_opts(opts, &options);
+  if (options.population)
+    ddof = 0;
+
+  if (exact)
+    ary_exact_mean_variance(ary, &mean, &variance, ddof, options.skip_na);
+  else if (!NIL_P(weights))
+    ary_weighted_mean_variance(ary, weights, &mean, &variance, ddof, options.skip_na);
+  else
+    ary_mean_variance(ary, &mean, &variance, ddof, options.skip_na);
+  VALUE stdev = sqrt_value(variance);
+  return rb_assoc_new(mean, stdev);
+}
+
+/* call-seq:
+ *    ary.stdev(population: false, weights: nil, exact: false, key: nil, index: nil)
+ *
+ * Calculate a standard deviation of the values in `ary`.
+ *
+ * This method is equivalent to:
+ *
+ * ```ruby
+ * Math.sqrt(ary.variance(population: population))
+ * ```
+ *
+ * @return [Number] A standard deviation value
+ */
+static VALUE
+ary_stdev(int argc, VALUE* argv, VALUE ary)
+{
+  VALUE variance = ary_variance(argc, argv, ary);
+  VALUE stdev = sqrt_value(variance);
+  return stdev;
+}
+
+/* Covariance and correlation
+ *
+ * The means, the second moments, and the co-moment of two series are
+ * updated together by the bivariate form of Welford's algorithm, so that
+ * the correlation is calculated in one pass over the pairs.
+ *
+ * The values are shifted by the first pair, so that the precision is kept
+ * for the values with a large offset. */
+
+struct comoment {
+  size_t n;
+  double kx, ky;   /* the shift */
+  double mx, my;   /* the means of the shifted values */
+  double m2x, m2y; /* the sums of squared deviations */
+  double cxy;      /* the sum of the products of the deviations */
+};
+
+static inline void
+comoment_init(struct comoment *cm)
+{
+  cm->n = 0;
+  cm->kx = cm->ky = 0.0;
+  cm->mx = cm->my = 0.0;
+  cm->m2x = cm->m2y = cm->cxy = 0.0;
+}
+
+static inline void
+comoment_update(struct comoment *cm, double x, double y)
+{
+  size_t const n = cm->n + 1;
+  double dx, dy;
+
+  if (cm->n == 0 && isfinite(x) && isfinite(y)) {
+    cm->kx = x;
+    cm->ky = y;
+  }
+  x -= cm->kx;
+  y -= cm->ky;
+  dx = x - cm->mx;
+  dy = y - cm->my;
+
+  cm->mx += dx / n;
+  cm->my += dy / n;
+  cm->m2x += dx * (x - cm->mx);
+  cm->m2y += dy * (y - cm->my);
+  cm->cxy += dx * (y - cm->my);
+  cm->n = n;
+}
+
+/* Merge the co-moments b of the latter pairs into a */
+static void
+comoment_merge(struct comoment *a, const struct comoment *b)
+{
+  double na, nb, n, dx, dy, w;
+
+  if (b->n == 0)
+    return;
+  if (a->n == 0) {
+    *a = *b;
+    return;
+  }
+
+  na = (double)a->n;
+  nb = (double)b->n;
+  n = na + nb;
+  dx = (b->kx - a->kx) + (b->mx - a->mx);
+  dy = (b->ky - a->ky) + (b->my - a->my);
+  w = na * nb / n;
+
+  a->mx += dx * nb / n;
+  a->my += dy * nb / n;
+  a->m2x += b->m2x + dx * dx * w;
+  a->m2y += b->m2y + dy * dy * w;
+  a->cxy += b->cxy + dx * dy * w;
+  a->n += b->n;
+}
+
+static double
+comoment_covariance(const struct comoment *cm, size_t ddof)
+{
+  if (cm->n < 2)
+    return NAN;
+  return cm->cxy / (cm->n - ddof);
+}
+
+static double
+comoment_correlation(const struct comoment *cm)
+{
+  double r;
+
+  if (cm->n < 2)
+    return NAN;
+  r = cm->cxy / sqrt(cm->m2x * cm->m2y);
+  /* rounding errors can push r out of [-1, 1] slightly */
+  if (r > 1.0)
+    r = 1.0;
+  else if (r < -1.0)
+    r = -1.0;
+  return r;
+}
+
+struct nogvl_comoment_args {
+  const double *x, *y;
+  long n;
+  long nchunks;
+  int skip_na;
+  struct comoment cm;
+};
+
+static void *
+comoment_chunk(void *ptr)
+{
+  struct nogvl_comoment_args *args = (struct nogvl_comoment_args *)ptr;
+  struct comoment cm;
+  long i;
+
+  comoment_init(&cm);
+  for (i = 0; i < args->n; ++i) {
+    double const x = args->x[i], y = args->y[i];
+    if (args->skip_na && (isnan(x) || isnan(y)))
+      continue;
+    comoment_update(&cm, x, y);
+  }
+
+  args->cm = cm;
+  return NULL;
+}
+
+static void *
+nogvl_comoment(void *ptr)
+{
+  struct nogvl_comoment_args *args = (struct nogvl_comoment_args *)ptr;
+  struct nogvl_comoment_args chunks[PARALLELISM_MAX];
+  long const k = args->nchunks;
+  long i;
+
+  if (k <= 1)
+    return comoment_chunk(args);
+
+  for (i = 0; i < k; ++i) {
+    long const lo = args->n * i / k, hi = args->n * (i + 1) / k;
+    chunks[i] = *args;
+    chunks[i].x = args->x + lo;
+    chunks[i].y = args->y + lo;
+    chunks[i].n = hi - lo;
+  }
+  parallel_run(comoment_chunk, chunks, sizeof(chunks[0]), k);
+
+  /* Merge the partial co-moments in the order of the chunks */
+  comoment_init(&args->cm);
+  for (i = 0; i < k; ++i)
+    comoment_merge(&args->cm, &chunks[i].cm);
+  return NULL;
+}
+
+/* Calculate the co-moment of the pairs of the values in ary and other.
+ * With skip_na, the pairs that have an NA value are skipped. */
+static void
+ary_comoment(VALUE ary, VALUE other, int skip_na, struct comoment *cm)
+{
+  int const flags = NUMERIC_SNAPSHOT_FIXNUM | NUMERIC_SNAPSHOT_NAN;
+  struct na_cache na_x, na_y;
+  VALUE xbuf, ybuf;
+  long i;
+
+  other = rb_convert_type(other, T_ARRAY, "Array", "to_ary");
+  if (RARRAY_LEN(ary) != RARRAY_LEN(other)) {
+    rb_raise(rb_eArgError, "arrays must have the same length (%ld and %ld)",
+             RARRAY_LEN(ary), RARRAY_LEN(other));
+  }
+
+  xbuf = ary_numeric_snapshot(ary, flags);
+  ybuf = NIL_P(xbuf) ? Qnil : ary_numeric_snapshot(other, flags);
+  if (!NIL_P(ybuf)) {
+    struct nogvl_comoment_args args;
+
+    args.x = DBL_BUFFER_PTR(xbuf);
+    args.y = DBL_BUFFER_PTR(ybuf);
+    args.n = DBL_BUFFER_LEN(xbuf);
+    args.nchunks = parallel_chunk_count(args.n);
+    args.skip_na = skip_na;
+    call_without_gvl(nogvl_comoment, &args);
+    RB_GC_GUARD(xbuf);
+    RB_GC_GUARD(ybuf);
+
+    *cm = args.cm;
+    return;
+  }
+
+  comoment_init(cm);
+  na_cache_init(&na_x);
+  na_cache_init(&na_y);
+  for (i = 0; i < RARRAY_LEN(ary) && i < RARRAY_LEN(other); ++i) {
+    VALUE const x = RARRAY_AREF(ary, i);
+    VALUE const y = RARRAY_AREF(other, i);
+
+    if (skip_na && (is_na_cached(x, &na_x) || is_na_cached(y, &na_y)))
+      continue;
+    comoment_update(cm, value_to_dbl(x), value_to_dbl(y));
+  }
+}
+
+/* call-seq:
+ *    ary.covariance(other, population: false, skip_na: false) -> float
+ *
+ * Calculate a covariance of the values in `ary` and the values at the
+ * same indices in `other`, which must have the same length as `ary`.
+ * The pairs are scanned only once, and are not copied into new arrays.
+ *
+ * When the `skip_na:` keyword parameter is `true`, the pairs that have
+ * an NA value on either side are skipped.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the covariance is calculated as a population covariance (divided by $n$).
+ * The default is a sample covariance (divided by $n-1$).
+ *
+ * @param [Array] other  The values paired with the values in `ary`
+ *
+ * @return [Float] A covariance value
+ */
+static VALUE
+ary_covariance(int argc, VALUE *argv, VALUE ary)
+{
+  struct variance_opts options;
+  struct comoment cm;
+  VALUE other, opts;
+
+  rb_scan_args(argc, argv, "1:", &other, &opts);
+  get_variance_opts(opts, &options);
+
+  ary_comoment(ary, other, options.skip_na, &cm);
+  return DBL2NUM(comoment_covariance(&cm, options.population ? 0 : 1));
+}
+
+/* call-seq:
+ *    ary.correlation(other, skip_na: false) -> float
+ *
+ * Calculate a Pearson correlation coefficient of the values in `ary` and
+ * the values at the same indices in `other`, which must have the same
+ * length as `ary`.  The means, the variances, and the covariance are
+ * calculated together in one pass over the pairs.
+ *
+ * When the `skip_na:` keyword parameter is `true`, the pairs that have
+ * an NA value on either side are skipped.
+ *
+ * The result is NaN if there are less than two pairs, or either
+ * of the series is constant.
+ *
+ * @param [Array] other  The values paired with the values in `ary`
+ *
+ * @return [Float] A correlation coefficient
+ */
+static VALUE
+ary_correlation(int argc, VALUE *argv, VALUE ary)
+{
+  struct comoment cm;
+  VALUE other, opts;
+
+  rb_scan_args(argc, argv, "1:", &other, &opts);
+
+  ary_comoment(ary, other, opt_skip_na(opts), &cm);
+  return DBL2NUM(comoment_correlation(&cm));
+}
+
+struct moments_opts {
+  int upto;
+  int population;
+  int skip_na;
+};
+
+static void
+get_moments_opts(VALUE opts, struct moments_opts *out)
+{
+  assert(out != NULL);
+
+  out->upto = 4;
+  out->population = 0;
+  out->skip_na = 0;
+
+  if (!NIL_P(opts)) {
+    enum { kw_upto, kw_population, kw_skip_na };
+    ID kwarg_keys[3];
+    VALUE kwarg_vals[3];
+
+    kwarg_keys[kw_upto]       = id_upto;
+    kwarg_keys[kw_population] = id_population;
+    kwarg_keys[kw_skip_na]    = id_skip_na;
+
+    rb_get_kwargs(opts, kwarg_keys, 0, 3, kwarg_vals);
+    if (kwarg_vals[kw_upto] != Qundef)
+      out->upto = NUM2INT(kwarg_vals[kw_upto]);
+    out->population = (kwarg_vals[kw_population] != Qundef) && RTEST(kwarg_vals[kw_population]);
+    out->skip_na    = (kwarg_vals[kw_skip_na]    != Qundef) && RTEST(kwarg_vals[kw_skip_na]);
+  }
+
+  if (out->upto < 1 || 4 < out->upto) {
+    rb_raise(rb_eArgError, "upto must be between 1 and 4, got %d", out->upto);
+  }
+}
+
+static double
+moments_mean(const struct enum_mean_variance_memo *memo)
+{
+  if (memo->n == 0)
+    return 0.0;
+  return memo->f / memo->n;
+}
+
+static double
+moments_variance(const struct enum_mean_variance_memo *memo, int population)
+{
+  size_t const ddof = population ? 0 : 1;
+
+  if (memo->n < 2)
+    return NAN;
+  return memo->m2 / (double)(memo->n - ddof);
+}
+
+static double
+moments_skewness(const struct enum_mean_variance_memo *memo, int population)
+{
+  double const n = (double)memo->n;
+  double g1;
+
+  assert(memo->order >= 3);
+
+  if (memo->n < (population ? 2 : 3))
+    return NAN;
+
+  g1 = sqrt(n) * memo->m3 / pow(memo->m2, 1.5);
+  if (population)
+    return g1;
+
+  /* adjusted Fisher-Pearson standardized moment coefficient */
+  return g1 * sqrt(n * (n - 1)) / (n - 2);
+}
+
+static double
+moments_kurtosis(const struct enum_mean_variance_memo *memo, int population)
+{
+  double const n = (double)memo->n;
+  double g2;
+
+  assert(memo->order >= 4);
+
+  if (memo->n < (population ? 2 : 4))
+    return NAN;
+
+  g2 = n * memo->m4 / (memo->m2 * memo->m2) - 3.0;
+  if (population)
+    return g2;
+
+  /* sample excess kurtosis */
+  return (n - 1) / ((n - 2) * (n - 3)) * ((n + 1) * g2 + 6);
+}
+
+static VALUE
+moments_result(const struct enum_mean_variance_memo *memo, int upto, int population)
+{
+  VALUE res = rb_ary_new_capa(upto);
+
+  rb_ary_push(res, DBL2NUM(moments_mean(memo)));
+  if (upto >= 2)
+    rb_ary_push(res, DBL2NUM(moments_variance(memo, population)));
+  if (upto >= 3)
+    rb_ary_push(res, DBL2NUM(moments_skewness(memo, population)));
+  if (upto >= 4)
+    rb_ary_push(res, DBL2NUM(moments_kurtosis(memo, population)));
+
+  return res;
+}
+
+/* call-seq:
+ *    ary.skewness(population: false, skip_na: false)
+ *
+ * Calculate a skewness of the values in `ary`.
+ * This method scan values in `ary` only once,
+ * and does not cache the values on memory.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the skewness is calculated as the biased estimator $g_1 = m_3 / m_2^{3/2}$.
+ * The default `population:` keyword parameter is `false`;
+ * this means the skewness is the adjusted Fisher-Pearson coefficient
+ * $G_1 = g_1 \sqrt{n(n-1)} / (n-2)$.
+ *
+ * @return [Float] A skewness value
+ */
+static VALUE
+ary_skewness(int argc, VALUE* argv, VALUE ary)
+{
+  struct variance_opts options;
+  struct enum_mean_variance_memo memo;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, 3, options.skip_na);
+  ary_moments(ary, &memo);
+
+  return DBL2NUM(moments_skewness(&memo, options.population));
+}
+
+/* call-seq:
+ *    ary.kurtosis(population: false, skip_na: false)
+ *
+ * Calculate an excess kurtosis of the values in `ary`.
+ * This method scan values in `ary` only once,
+ * and does not cache the values on memory.
+ *
+ * When the `population:` keyword parameter is `true`,
+ * the kurtosis is calculated as the biased estimator $g_2 = m_4 / m_2^2 - 3$.
+ * The default `population:` keyword parameter is `false`;
+ * this means the kurtosis is the sample excess kurtosis
+ * $G_2 = \frac{n-1}{(n-2)(n-3)} \left((n+1) g_2 + 6\right)$.
+ *
+ * @return [Float] A kurtosis value
+ */
+static VALUE
+ary_kurtosis(int argc, VALUE* argv, VALUE ary)
+{
+  struct variance_opts options;
+  struct enum_mean_variance_memo memo;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, 4, options.skip_na);
+  ary_moments(ary, &memo);
+
+  return DBL2NUM(moments_kurtosis(&memo, options.population));
+}
+
+/* call-seq:
+ *    ary.moments(upto: 4, population: false, skip_na: false)
+ *
+ * Calculate the mean, the variance, the skewness, and the kurtosis
+ * of the values in `ary` at once.
+ * The result array has `upto` elements in this order,
+ * so `ary.moments(upto: 2)` is equivalent to `ary.mean_variance`.
+ *
+ * This method scan values in `ary` only once,
+ * and does not cache the values on memory.
+ * See {#variance}, {#skewness}, and {#kurtosis} for
+ * the meaning of the `population:` keyword parameter.
+ *
+ * @return [Array<Float>] An array of the moment values
+ */
+static VALUE
+ary_moments_m(int argc, VALUE* argv, VALUE ary)
+{
+  struct moments_opts options;
+  struct enum_mean_variance_memo memo;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_moments_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, options.upto < 2 ? 2 : options.upto, options.skip_na);
+  ary_moments(ary, &memo);
+
+  return moments_result(&memo, options.upto, options.population);
+}
+
+/* call-seq:
+ *    enum.skewness(population: false, skip_na: false)
+ *
+ * Calculate a skewness of the values in `enum`.
+ * This method scan values in `enum` only once,
+ * and does not cache the values on memory.
+ *
+ * See Array#skewness for the meaning of the `population:` keyword parameter.
+ *
+ * @return [Float] A skewness value
+ */
+static VALUE
+enum_skewness(int argc, VALUE* argv, VALUE obj)
+{
+  struct variance_opts options;
+  struct enum_mean_variance_memo memo;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, 3, options.skip_na);
+  enum_moments(obj, &memo);
+
+  return DBL2NUM(moments_skewness(&memo, options.population));
+}
+
+/* call-seq:
+ *    enum.kurtosis(population: false, skip_na: false)
+ *
+ * Calculate an excess kurtosis of the values in `enum`.
+ * This method scan values in `enum` only once,
+ * and does not cache the values on memory.
+ *
+ * See Array#kurtosis for the meaning of the `population:` keyword parameter.
+ *
+ * @return [Float] A kurtosis value
+ */
+static VALUE
+enum_kurtosis(int argc, VALUE* argv, VALUE obj)
+{
+  struct variance_opts options;
+  struct enum_mean_variance_memo memo;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, 4, options.skip_na);
+  enum_moments(obj, &memo);
+
+  return DBL2NUM(moments_kurtosis(&memo, options.population));
+}
+
+/* call-seq:
+ *    enum.moments(upto: 4, population: false, skip_na: false)
+ *
+ * Calculate the mean, the variance, the skewness, and the kurtosis
+ * of the values in `enum` at once.
+ * The result array has `upto` elements in this order.
+ *
+ * This method scan values in `enum` only once,
+ * and does not cache the values on memory.
+ *
+ * @return [Array<Float>] An array of the moment values
+ */
+static VALUE
+enum_moments_m(int argc, VALUE* argv, VALUE obj)
+{
+  struct moments_opts options;
+  struct enum_mean_variance_memo memo;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_moments_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, options.upto < 2 ? 2 : options.upto, options.skip_na);
+  enum_moments(obj, &memo);
+
+  return moments_result(&memo, options.upto, options.population);
+}
+
+static int
+ary_percentile_sort_cmp(const void *ap, const void *bp, void *dummy)
+{
+  VALUE a = *(const VALUE *)ap, b = *(const VALUE *)bp;
+  VALUE cmp;
+
+  /* TODO: optimize */
+  cmp = rb_funcall(a, id_cmp, 1, b);
+  return rb_cmpint(cmp, a, b);
+}
+
+/* Return a sorted copy of ary, where NA values come first.
+ * The values are classified by an NA mask once, so that the comparisons
+ * in the sort do not test NA values.  If ary has NA values, the rest are
+ * left unsorted, because the percentiles are NaN, which the callers
+ * return by finding an NA value at the head. */
+static VALUE
+ary_percentile_make_sorted(VALUE ary)
+{
+  long n, i, na_count;
+  VALUE sorted, mask;
+  const char *p;
+
+  mask = ary_na_mask(ary, &na_count);
+  if (NIL_P(mask)) {
+    n = RARRAY_LEN(ary);
+    sorted = rb_ary_tmp_new(n);
+    for (i = 0; i < n; ++i) {
+      rb_ary_push(sorted, RARRAY_AREF(ary, i));
+    }
+  }
+  else {
+    /* The mask is never longer than ary */
+    n = RSTRING_LEN(mask);
+    p = RSTRING_PTR(mask);
+    sorted = rb_ary_tmp_new(n);
+    for (i = 0; i < n; ++i) {
+      if (p[i])
+        rb_ary_push(sorted, RARRAY_AREF(ary, i));
+    }
+    for (i = 0; i < n; ++i) {
+      if (!p[i])
+        rb_ary_push(sorted, RARRAY_AREF(ary, i));
+    }
+    RB_GC_GUARD(mask);
+    return sorted;
+  }
+
+  RARRAY_PTR_USE(sorted, ptr, {
+    ruby_qsort(ptr, n, sizeof(VALUE), ary_percentile_sort_cmp, NULL);
+  });
+  return sorted;
+}
+
+static inline VALUE
+ary_percentile_single_sorted(VALUE sorted, long n, double d)
+{
+  VALUE x0, x1;
+  double i, f;
+  long l;
+
+  assert(RB_TYPE_P(sorted, T_ARRAY));
+  assert(n == RARRAY_LEN(sorted));
+  assert(n > 0);
+
+  if (d < 0 || 100 < d) {
+    rb_raise(rb_eArgError, "percentile out of bounds");
+  }
+
+  if (is_na(RARRAY_AREF(sorted, 0))) {
+    return DBL2NUM(nan(""));
+  }
+
+  n = RARRAY_LEN(sorted);
+  if (n == 1) {
+    return RARRAY_AREF(sorted, 0);
+  }
+
+  d = (n - 1) * d / 100.0;
+  f = modf(d, &i);
+  l = (long)i;
+
+  x0 = RARRAY_AREF(sorted, l);
+  if (f == 0 || l == n - 1) {
+    return x0;
+  }
+
+  x0 = rb_funcall(x0, idSTAR, 1, DBL2NUM(1 - f));
+  x1 = RARRAY_AREF(sorted, l + 1);
+  x1 = rb_funcall(x1, idSTAR, 1, DBL2NUM(f));
+
+  return rb_funcall(x0, idPLUS, 1, x1);
+}
+
+static VALUE
+ary_percentile_single(VALUE ary, VALUE q)
+{
+  long n;
+  double d;
+  VALUE qf, sorted;
+
+  assert(RB_TYPE_P(ary, T_ARRAY));
+
+  n = RARRAY_LEN(ary);
+  assert(n > 0);
+
+  switch (TYPE(q)) {
+    case T_FIXNUM:
+      d = (double)FIX2LONG(q);
+      break;
+    case T_BIGNUM:
+      d = rb_big2dbl(q);
+      break;
+
+    case T_RATIONAL:
+      /* fall through */
+    default:
+      qf = NUM2DBL(q);
+      goto float_percentile;
+
+    case T_FLOAT:
+      qf = q;
+float_percentile:
+      d = RFLOAT_VALUE(qf);
+      break;
+  }
+
+  if (n == 1) {
+    return RARRAY_AREF(ary, 0);
+  }
+
+  sorted = ary_percentile_make_sorted(ary);
+
+  return ary_percentile_single_sorted(sorted, n, d);
+}
+
+/* The number of the sampled values per bucket of the parallel selection */
+#define PARALLEL_SELECT_OVERSAMPLING 32
+
+/* The workspace to select order statistics by multiple threads.
+ *
+ * The values in src are distributed into k buckets in dst by k - 1 splitters
+ * chosen from a sample of them, so that all the values in a bucket are less
+ * than or equal to the ones in the next bucket.  Then the order statistics
+ * are selected in each bucket independently. */
+struct parallel_select {
+  const double *src;
+  double *dst;
+  long n, k;
+  const long *ranks;
+  long nranks;
+  double *splitters;  /* k - 1 splitters, overwriting the sample */
+  long *offsets;      /* k * k offsets of the buckets for each chunk */
+  long *bounds;       /* k + 1 boundaries of the buckets in dst */
+};
+
+struct parallel_select_task {
+  struct parallel_select *ps;
+  long i;
+};
+
+/* Prepare ps to select the order statistics of ranks[0...nranks] in the
+ * buffer a of n values by multiple threads.  This returns 0 if the selection
+ * should run serially.  Otherwise the workspace is allocated in *work, which
+ * must be kept alive until the selection finishes. */
+static int
+parallel_select_prepare(struct parallel_select *ps, VALUE *work,
+                        const double *a, long n, const long *ranks, long nranks)
+{
+  long const k = parallel_chunk_count(n);
+  long const s = k * PARALLEL_SELECT_OVERSAMPLING;
+  char *p;
+
+  if (k <= 1)
+    return 0;
+
+  *work = rb_str_tmp_new((n + s) * (long)sizeof(double)
+                         + (k * k + k + 1) * (long)sizeof(long));
+  p = RSTRING_PTR(*work);
+
+  ps->src = a;
+  ps->n = n;
+  ps->k = k;
+  ps->ranks = ranks;
+  ps->nranks = nranks;
+  ps->dst = (double *)p;
+  ps->splitters = ps->dst + n;
+  ps->offsets = (long *)(ps->splitters + s);
+  ps->bounds = ps->offsets + k * k;
+  return 1;
+}
+
+static inline long
+parallel_select_bucket(const struct parallel_select *ps, double x)
+{
+  /* the number of the splitters less than or equal to x */
+  long lo = 0, hi = ps->k - 1;
+
+  while (lo < hi) {
+    long const mid = lo + (hi - lo) / 2;
+    if (ps->splitters[mid] <= x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void *
+parallel_select_count(void *ptr)
+{
+  struct parallel_select_task *task = (struct parallel_select_task *)ptr;
+  struct parallel_select *ps = task->ps;
+  long const lo = ps->n * task->i / ps->k, hi = ps->n * (task->i + 1) / ps->k;
+  long counts[PARALLELISM_MAX];
+  long j;
+
+  for (j = 0; j < ps->k; ++j)
+    counts[j] = 0;
+  for (j = lo; j < hi; ++j)
+    ++counts[parallel_select_bucket(ps, ps->src[j])];
+
+  memcpy(ps->offsets + task->i * ps->k, counts, ps->k * sizeof(long));
+  return NULL;
+}
+
+static void *
+parallel_select_scatter(void *ptr)
+{
+  struct parallel_select_task *task = (struct parallel_select_task *)ptr;
+  struct parallel_select *ps = task->ps;
+  long const lo = ps->n * task->i / ps->k, hi = ps->n * (task->i + 1) / ps->k;
+  long pos[PARALLELISM_MAX];
+  long j;
+
+  memcpy(pos, ps->offsets + task->i * ps->k, ps->k * sizeof(long));
+  for (j = lo; j < hi; ++j) {
+    double const x = ps->src[j];
+    ps->dst[pos[parallel_select_bucket(ps, x)]++] = x;
+  }
+  return NULL;
+}
+
+static void *
+parallel_select_bucket_ranks(void *ptr)
+{
+  struct parallel_select_task *task = (struct parallel_select_task *)ptr;
+  struct parallel_select *ps = task->ps;
+  long lo = ps->bounds[task->i];
+  long const hi = ps->bounds[task->i + 1];
+  long j;
+
+  for (j = 0; j < ps->nranks; ++j) {
+    long const r = ps->ranks[j];
+    if (r < lo)
+      continue;
+    if (r >= hi)
+      break;
+    dbl_select(ps->dst, lo, hi, r);
+    lo = r + 1;
+  }
+  return NULL;
+}
+
+/* Select the order statistics prepared by parallel_select_prepare, and
+ * return the buffer in which they are placed at their ranks. */
+static double *
+parallel_select_run(struct parallel_select *ps)
+{
+  struct parallel_select_task tasks[PARALLELISM_MAX];
+  long const k = ps->k, s = k * PARALLEL_SELECT_OVERSAMPLING;
+  double *const sample = ps->splitters;
+  long i, b, pos;
+
+  /* Choose the splitters from the evenly spaced sample */
+  for (i = 0; i < s; ++i)
+    sample[i] = ps->src[ps->n / s * i];
+  ruby_qsort(sample, s, sizeof(double), dbl_cmp, NULL);
+  for (i = 1; i < k; ++i)
+    ps->splitters[i - 1] = sample[i * PARALLEL_SELECT_OVERSAMPLING];
+
+  for (i = 0; i < k; ++i) {
+    tasks[i].ps = ps;
+    tasks[i].i = i;
+  }
+  parallel_run(parallel_select_count, tasks, sizeof(tasks[0]), k);
+
+  /* Turn the counts into the offsets of the buckets in dst */
+  for (b = 0, pos = 0; b < k; ++b) {
+    ps->bounds[b] = pos;
+    for (i = 0; i < k; ++i) {
+      long const c = ps->offsets[i*k + b];
+      ps->offsets[i*k + b] = pos;
+      pos += c;
+    }
+  }
+  ps->bounds[k] = pos;
+
+  parallel_run(parallel_select_scatter, tasks, sizeof(tasks[0]), k);
+  parallel_run(parallel_select_bucket_ranks, tasks, sizeof(tasks[0]), k);
+  return ps->dst;
+}
+
+struct nogvl_percentiles_args {
+  double *p;
+  long n;
+  const double *qs;
+  double *out;
+  long m;
+  const long *ranks;
+  long nranks;
+  struct parallel_select *ps;
+};
+
+static void *
+nogvl_percentiles(void *ptr)
+{
+  struct nogvl_percentiles_args *args = (struct nogvl_percentiles_args *)ptr;
+  const double *a = args->p;
+
+  if (args->ps != NULL)
+    a = parallel_select_run(args->ps);
+  else
+    dbl_select_ranks(args->p, args->n, args->ranks, args->nranks);
+  dbl_interpolate_percentiles(a, args->n, args->qs, args->out, args->m);
+  return NULL;
+}
+
+/* Calculate the percentile(s) q of the values in the native buffer buf
+ * without the GVL.  q is a number or an array of numbers. */
+static VALUE
+dbl_buffer_percentile(VALUE buf, VALUE q)
+{
+  struct nogvl_percentiles_args args;
+  struct parallel_select ps;
+  VALUE qs, tmp, rtmp, work = Qnil, res;
+  double *qd;
+  long *ranks;
+  long i;
+
+  qs = rb_check_convert_type(q, T_ARRAY, "Array", "to_ary");
+  args.m = NIL_P(qs) ? 1 : RARRAY_LEN(qs);
+  qd = ALLOCV_N(double, tmp, 2*args.m);
+  for (i = 0; i < args.m; ++i) {
+    qd[i] = NUM2DBL(NIL_P(qs) ? q : RARRAY_AREF(qs, i));
+    if (qd[i] < 0 || 100 < qd[i]) {
+      rb_raise(rb_eArgError, "percentile out of bounds");
+    }
+  }
+  args.qs = qd;
+  args.out = qd + args.m;
+
+  args.p = DBL_BUFFER_PTR(buf);
+  args.n = DBL_BUFFER_LEN(buf);
+  ranks = ALLOCV_N(long, rtmp, 2*args.m);
+  args.ranks = ranks;
+  args.nranks = dbl_percentile_ranks(args.n, qd, args.m, ranks);
+  args.ps = NULL;
+  if (parallel_select_prepare(&ps, &work, args.p, args.n, args.ranks, args.nranks))
+    args.ps = &ps;
+  call_without_gvl(nogvl_percentiles, &args);
+
+  if (NIL_P(qs))
+    res = DBL2NUM(args.out[0]);
+  else {
+    res = rb_ary_new_capa(args.m);
+    for (i = 0; i < args.m; ++i)
+      rb_ary_push(res, DBL2NUM(args.out[i]));
+  }
+
+  ALLOCV_END(rtmp);
+  ALLOCV_END(tmp);
+  RB_GC_GUARD(buf);
+  RB_GC_GUARD(work);
+  return res;
+}
+
+static VALUE
+ary_percentile(VALUE ary, VALUE q)
+{
+  long n, m, i;
+  double d;
+  VALUE qf, qs, sorted, res;
+
+  n = RARRAY_LEN(ary);
+  if (n == 0) {
+    rb_raise(rb_eArgError, "unable to compute percentile(s) for an empty array");
+  }
+
+  sorted = ary_numeric_snapshot(ary, 0);
+  if (!NIL_P(sorted)) {
+    return dbl_buffer_percentile(sorted, q);
+  }
+
+  qs = rb_check_convert_type(q, T_ARRAY, "Array", "to_ary");
+  if (NIL_P(qs)) {
+    return ary_percentile_single(ary, q);
+  }
+
+  m = RARRAY_LEN(qs);
+  res = rb_ary_new_capa(m);
+
+  if (m == 1) {
+    q = RARRAY_AREF(qs, 0);
+    rb_ary_push(res, ary_percentile_single(ary, q));
+  }
+  else {
+    sorted = ary_percentile_make_sorted(ary);
+
+    for (i = 0; i < m; ++i) {
+      VALUE x;
+
+      q = RARRAY_AREF(qs, i);
+      switch (TYPE(q)) {
+        case T_FIXNUM:
+          d = (double)FIX2LONG(q);
+          break;
+        case T_BIGNUM:
+          d = rb_big2dbl(q);
+          break;
+
+        case T_RATIONAL:
+          /* fall through */
+        default:
+          qf = NUM2DBL(q);
+          goto float_percentile;
+
+        case T_FLOAT:
+          qf = q;
+float_percentile:
+          d = RFLOAT_VALUE(qf);
+          break;
+      }
+
+      x = ary_percentile_single_sorted(sorted, n, d);
+      rb_ary_push(res, x);
+    }
+  }
+
+  return res;
+}
+
+struct weighted_percentiles_args {
+  double *p;  /* (value, weight) pairs */
+  long n;
+  const double *qs;
+  double *out;
+  long m;
+};
+
+/* Return the value at the position pos in the sorted values repeated by
+ * their weights.  The weights in p must have been accumulated. */
+static double
+weighted_value_at(const double *p, long n, double pos)
+{
+  long lo = 0, hi = n - 1;
+
+  while (lo < hi) {
+    long const mid = lo + (hi - lo) / 2;
+    if (p[2*mid + 1] > pos)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return p[2*lo];
+}
+
+/* Calculate the weighted percentiles by sorting the (value, weight) pairs
+ * once.  The weights are treated as frequency weights, so the percentiles
+ * are interpolated in the same way as the unweighted ones. */
+static void *
+weighted_percentiles(void *ptr)
+{
+  struct weighted_percentiles_args *args = (struct weighted_percentiles_args *)ptr;
+  double *p = args->p;
+  long const n = args->n;
+  double w;
+  long i;
+
+  for (i = 0; i < n; ++i) {
+    if (isnan(p[2*i])) {
+      for (i = 0; i < args->m; ++i)
+        args->out[i] = NAN;
+      return NULL;
+    }
+  }
+
+  /* dbl_cmp compares the values at the heads of the pairs */
+  ruby_qsort(p, n, 2*sizeof(double), dbl_cmp, NULL);
+  for (i = 1; i < n; ++i)
+    p[2*i + 1] += p[2*i - 1];
+  w = p[2*n - 1];
+
+  for (i = 0; i < args->m; ++i) {
+    double h = (w - 1) * args->qs[i] / 100.0, l, f, a;
+
+    if (h < 0)
+      h = 0;
+    f = modf(h, &l);
+    a = weighted_value_at(p, n, l);
+    if (f == 0)
+      args->out[i] = a;
+    else
+      args->out[i] = a * (1 - f) + weighted_value_at(p, n, l + 1) * f;
+  }
+
+  return NULL;
+}
+
+static VALUE
+ary_weighted_percentile(VALUE ary, VALUE weights, VALUE q)
+{
+  struct weighted_percentiles_args args;
+  VALUE qs, tmp, buf, res;
+  double *qd;
+  long i;
+
+  qs = rb_check_convert_type(q, T_ARRAY, "Array", "to_ary");
+  args.m = NIL_P(qs) ? 1 : RARRAY_LEN(qs);
+  qd = ALLOCV_N(double, tmp, 2*args.m);
+  for (i = 0; i < args.m; ++i) {
+    qd[i] = NUM2DBL(NIL_P(qs) ? q : RARRAY_AREF(qs, i));
+    if (qd[i] < 0 || 100 < qd[i]) {
+      rb_raise(rb_eArgError, "percentile out of bounds");
+    }
+  }
+  args.qs = qd;
+  args.out = qd + args.m;
+
+  buf = ary_weighted_snapshot(ary, weights, 0, 1);
+  args.p = DBL_BUFFER_PTR(buf);
+  args.n = DBL_BUFFER_LEN(buf) / 2;
+  if (args.n == 0) {
+    rb_raise(rb_eArgError, "unable to compute percentile(s) for an empty array");
+  }
+  call_without_gvl_if_large(weighted_percentiles, &args, args.n);
+
+  if (NIL_P(qs))
+    res = DBL2NUM(args.out[0]);
+  else {
+    res = rb_ary_new_capa(args.m);
+    for (i = 0; i < args.m; ++i)
+      rb_ary_push(res, DBL2NUM(args.out[i]));
+  }
+
+  ALLOCV_END(tmp);
+  RB_GC_GUARD(buf);
+  return res;
+}
+
+/* call-seq:
+ *    ary.percentile(q, weights: nil, key: nil, index: nil) -> float
+ *
+ * Calculate specified percentiles of the values in `ary`.
+ *
+ * @param [Number, Array] percentile or array of percentiles to compute,
+ *   which must be between 0 and 100 inclusive.
+ * @param [Array<Numeric>] weights  An optional array of non-negative weights
+ *   of the values.  The percentiles are the same as the ones of the array
+ *   in which each value is repeated by its weight.
+ * @param [Object] key  Calculate with the values of `row[key]` of the rows
+ *                      in `ary`.
+ * @param [Integer] index  Calculate with the values of `row[index]` of the
+ *                         rows in `ary`.
+ *
+ * @return [Float, Array] A percentile value(s)
+ */
+static VALUE
+ary_percentile_m(int argc, VALUE *argv, VALUE ary)
+{
+  VALUE q, kwargs, weights;
+
+  rb_scan_args(argc, argv, "1:", &q, &kwargs);
+  ary = ary_extract_field(ary, &kwargs);
+  weights = ary_extract_weights(ary, &kwargs);
+  if (!NIL_P(kwargs)) {
+    /* raise ArgumentError for the unknown keywords */
+    rb_get_kwargs(kwargs, &id_key, 0, 0, NULL);
+  }
+
+  if (!NIL_P(weights))
+    return ary_weighted_percentile(ary, weights, q);
+  return ary_percentile(ary, q);
+}
+
+struct nogvl_median_args {
+  double *p;
+  long n;
+  struct parallel_select *ps;
+  double median;
+};
+
+static void *
+nogvl_median(void *ptr)
+{
+  struct nogvl_median_args *args = (struct nogvl_median_args *)ptr;
+  double *a = args->p;
+  long const n = args->n;
+  long const k = n / 2;
+
+  if (args->ps != NULL) {
+    /* the ranks k - 1 and k have been selected */
+    a = parallel_select_run(args->ps);
+    args->median = n % 2 == 1 ? a[k] : (a[k - 1] + a[k]) / 2.0;
+    return NULL;
+  }
+
+  dbl_select(a, 0, n, k);
+  if (n % 2 == 1) {
+    args->median = a[k];
+  }
+  else {
+    /* a[k-1] is the largest value in a[0...k] */
+    double x0 = a[0];
+    long i;
+    for (i = 1; i < k; ++i) {
+      if (x0 < a[i])
+        x0 = a[i];
+    }
+    args->median = (x0 + a[k]) / 2.0;
+  }
+  return NULL;
+}
+
+/* Calculate the median of the values in the non-empty native buffer buf
+ * without the GVL. */
+static VALUE
+dbl_buffer_median(VALUE buf)
+{
+  struct nogvl_median_args args;
+  struct parallel_select ps;
+  VALUE work = Qnil;
+  long ranks[2];
+
+  args.p = DBL_BUFFER_PTR(buf);
+  args.n = DBL_BUFFER_LEN(buf);
+  assert(args.n > 0);
+
+  ranks[0] = args.n / 2 - 1;
+  ranks[1] = args.n / 2;
+  args.ps = NULL;
+  if (parallel_select_prepare(&ps, &work, args.p, args.n,
+                              args.n % 2 == 1 ? ranks + 1 : ranks,
+                              args.n % 2 == 1 ? 1 : 2))
+    args.ps = &ps;
+  call_without_gvl(nogvl_median, &args);
+  RB_GC_GUARD(buf);
+  RB_GC_GUARD(work);
+  return DBL2NUM(args.median);
+}
+
+/* call-seq:
+ *    ary.median(weights: nil) -> float
+ *
+ * Calculate a median of the values in `ary`.
+ *
+ * @param [Array<Numeric>] weights  An optional array of non-negative weights
+ *   of the values.
+ *
+ * @return [Float] A median value
+ */
+static VALUE
+ary_median(int argc, VALUE *argv, VALUE ary)
+{
+  long n;
+  VALUE kwargs, weights, sorted, a0, a1;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  weights = ary_extract_weights(ary, &kwargs);
+  if (!NIL_P(kwargs)) {
+    /* raise ArgumentError for the unknown keywords */
+    rb_get_kwargs(kwargs, &id_weights, 0, 0, NULL);
+  }
+
+  if (!NIL_P(weights)) {
+    if (RARRAY_LEN(ary) == 0)
+      goto return_nan;
+    return ary_weighted_percentile(ary, weights, DBL2NUM(50));
+  }
+
+  n = RARRAY_LEN(ary);
+  switch (n) {
+    case 0:
+      goto return_nan;
+    case 1:
+      return RARRAY_AREF(ary, 0);
+    case 2:
+      a0 = RARRAY_AREF(ary, 0);
+      a1 = RARRAY_AREF(ary, 1);
+      goto mean_two;
+    default:
+      break;
+  }
+
+  sorted = ary_numeric_snapshot(ary, 0);
+  if (!NIL_P(sorted)) {
+    return dbl_buffer_median(sorted);
+  }
+
+  sorted = ary_percentile_make_sorted(ary);
+
+  a0 = RARRAY_AREF(sorted, 0);
+  if (is_na(a0)) {
+return_nan:
+    return DBL2NUM(nan(""));
+  }
+
+  a1 = RARRAY_AREF(sorted, n / 2);
+  if (n % 2 == 1) {
+    return a1;
+  }
+  else {
+    a0 = RARRAY_AREF(sorted, n / 2 - 1);
+
+mean_two:
+    a0 = rb_funcall(a0, idPLUS, 1, a1); /* TODO: optimize */
+    if (RB_INTEGER_TYPE_P(a0) || RB_FLOAT_TYPE_P(a0) || RB_TYPE_P(a0, T_RATIONAL)) {
+      double d = NUM2DBL(a0);
+      return DBL2NUM(d / 2.0);
+    }
+
+    return rb_funcall(a0, idDIV, 1, DBL2NUM(2.0));
+  }
+}
+
+struct describe_memo {
+  struct enum_mean_variance_memo mv;
+  long na_count;
+  /* The sum is calculated in the same way as ary_calculate_sum: it is kept
+   * exact in n, v, ra, and r while the values are Integer or Rational, and
+   * continued by Kahan's summation in f and c after a Float appears. */
+  int exact;
+  wide_int n;
+  VALUE v;
+  struct rational_acc ra;
+  VALUE r;
+  double f, c;
+  VALUE min, max;
+  double min_x, max_x;
+  VALUE buf;
+};
+
+static void
+describe_memo_init(struct describe_memo *memo, VALUE buf)
+{
+  mean_variance_memo_init(&memo->mv, 2, 1);
+  memo->na_count = 0;
+  memo->exact = 1;
+  memo->n = 0;
+  memo->v = INT2FIX(0);
+  rational_acc_init(&memo->ra);
+  memo->r = Qundef;
+  memo->f = memo->c = 0.0;
+  memo->min = memo->max = Qnil;
+  memo->min_x = memo->max_x = 0.0;
+  memo->buf = buf;
+}
+
+static VALUE
+describe_exact_sum(const struct describe_memo *memo)
+{
+  VALUE v = wide_int_flush(memo->n, memo->v);
+  VALUE const r = rational_acc_flush(&memo->ra, memo->r);
+
+  if (r != Qundef)
+    v = rb_rational_plus(r, v);
+  return v;
+}
+
+static void
+describe_iter(VALUE e, struct describe_memo *memo)
+{
+  double x;
+
+  if (memo->mv.block_given)
+    e = rb_yield(e);
+  if (is_na_cached(e, &memo->mv.na)) {
+    ++memo->na_count;
+    return;
+  }
+
+  x = value_to_dbl(e);
+  if (memo->exact) {
+    if (FIXNUM_P(e) || RB_TYPE_P(e, T_BIGNUM))
+      wide_int_add(&memo->n, &memo->v, e);
+    else if (RB_TYPE_P(e, T_RATIONAL))
+      rational_acc_add(&memo->ra, &memo->r, e);
+    else {
+      memo->f = NUM2DBL(describe_exact_sum(memo));
+      memo->exact = 0;
+    }
+  }
+  if (!memo->exact)
+    kahan_add(&memo->f, &memo->c, x);
+
+  if (memo->mv.n == 0 || x < memo->min_x) {
+    memo->min = e;
+    memo->min_x = x;
+  }
+  if (memo->mv.n == 0 || x > memo->max_x) {
+    memo->max = e;
+    memo->max_x = x;
+  }
+
+  mean_variance_update(&memo->mv, x);
+
+  if (!NIL_P(memo->buf))
+    dbl_buffer_push(memo->buf, x);
+}
+
+static VALUE
+enum_describe_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  ENUM_WANT_SVALUE();
+  describe_iter(e, (struct describe_memo *)args);
+  return Qnil;
+}
+
+static VALUE
+describe_extract_percentiles(int argc, VALUE *argv)
+{
+  VALUE kwargs, qs;
+  long i;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+
+  qs = Qundef;
+  if (!NIL_P(kwargs)) {
+    ID kwarg_keys[1];
+    kwarg_keys[0] = id_percentiles;
+    rb_get_kwargs(kwargs, kwarg_keys, 0, 1, &qs);
+  }
+
+  if (qs == Qundef) {
+    qs = rb_ary_new_capa(3);
+    rb_ary_push(qs, INT2FIX(25));
+    rb_ary_push(qs, INT2FIX(50));
+    rb_ary_push(qs, INT2FIX(75));
+    return qs;
+  }
+
+  qs = rb_check_convert_type(qs, T_ARRAY, "Array", "to_ary");
+  if (NIL_P(qs)) {
+    rb_raise(rb_eTypeError, "percentiles must be an array of numbers");
+  }
+
+  for (i = 0; i < RARRAY_LEN(qs); ++i) {
+    double const d = NUM2DBL(RARRAY_AREF(qs, i));
+    if (d < 0 || 100 < d) {
+      rb_raise(rb_eArgError, "percentile out of bounds");
+    }
+  }
+
+  return qs;
+}
+
+static VALUE
+describe_result(struct describe_memo *memo, VALUE qs)
+{
+  long const count = (long)memo->mv.n;
+  long const m = RARRAY_LEN(qs);
+  VALUE sum, percentiles;
+  long i;
+
+  if (memo->exact)
+    sum = describe_exact_sum(memo);
+  else
+    sum = DBL2NUM(memo->f);
+
+  percentiles = rb_hash_new();
+  if (m > 0) {
+    VALUE tmp;
+    double *q = ALLOCV_N(double, tmp, 2*m);
+    double *out = q + m;
+
+    for (i = 0; i < m; ++i) {
+      q[i] = NUM2DBL(RARRAY_AREF(qs, i));
+      out[i] = NAN;
+    }
+    if (count > 0) {
+      assert(DBL_BUFFER_LEN(memo->buf) == count);
+      dbl_percentiles(DBL_BUFFER_PTR(memo->buf), count, q, out, m);
+    }
+    for (i = 0; i < m; ++i) {
+      rb_hash_aset(percentiles, RARRAY_AREF(qs, i), DBL2NUM(out[i]));
+    }
+
+    ALLOCV_END(tmp);
+  }
+  rb_obj_freeze(percentiles);
+
+  return rb_obj_freeze(rb_struct_new(cSummary,
+                                     LONG2NUM(count),
+                                     LONG2NUM(memo->na_count),
+                                     sum,
+                                     DBL2NUM(moments_mean(&memo->mv)),
+                                     DBL2NUM(moments_variance(&memo->mv, 0)),
+                                     memo->min,
+                                     memo->max,
+                                     percentiles));
+}
+
+/* call-seq:
+ *    ary.describe(percentiles: [25, 50, 75]) -> summary
+ *
+ * Calculate the descriptive statistics of the values in `ary` at once.
+ *
+ * The count, the NA count, the sum, the mean, the variance, the minimum,
+ * and the maximum are calculated in one scan of `ary`.
+ * NAs, `nil` and NaN, are skipped and only counted.
+ * The sum is exact as `sum` while the values are Integer or Rational.
+ * The percentiles are calculated from one native buffer of the values
+ * by selecting only the order statistics they need, instead of sorting.
+ *
+ * @param [Array<Numeric>] percentiles  The percentiles to compute,
+ *   which must be between 0 and 100 inclusive.
+ *
+ * @return [EnumerableStatistics::Summary] The frozen summary struct.
+ */
+static VALUE
+ary_describe(int argc, VALUE *argv, VALUE ary)
+{
+  struct describe_memo memo;
+  VALUE qs, buf = Qnil;
+  long i;
+
+  qs = describe_extract_percentiles(argc, argv);
+  if (RARRAY_LEN(qs) > 0)
+    buf = dbl_buffer_new(RARRAY_LEN(ary));
+
+  describe_memo_init(&memo, buf);
+  for (i = 0; i < RARRAY_LEN(ary); ++i) {
+    describe_iter(RARRAY_AREF(ary, i), &memo);
+  }
+
+  RB_GC_GUARD(buf);
+  return describe_result(&memo, qs);
+}
+
+/* call-seq:
+ *    enum.describe(percentiles: [25, 50, 75]) -> summary
+ *
+ * Calculate the descriptive statistics of the values in `enum` at once.
+ * See Array#describe for the details.
+ *
+ * @return [EnumerableStatistics::Summary] The frozen summary struct.
+ */
+static VALUE
+enum_describe(int argc, VALUE *argv, VALUE obj)
+{
+  struct describe_memo memo;
+  VALUE qs, buf = Qnil;
+
+  qs = describe_extract_percentiles(argc, argv);
+  if (RARRAY_LEN(qs) > 0)
+    buf = dbl_buffer_new(16);
+
+  describe_memo_init(&memo, buf);
+  rb_block_call(obj, id_each, 0, 0, enum_describe_i, (VALUE)&memo);
+
+  RB_GC_GUARD(buf);
+  return describe_result(&memo, qs);
+}
+
+struct value_counts_opts {
+  int normalize_p;
+  int sort_p;
+  int ascending_p;
+  int dropna_p;
+};
+
+static inline void
+value_counts_extract_opts(VALUE kwargs, struct value_counts_opts *opts)
+{
+  assert(opts != NULL);
+
+  /* default values */
+  opts->normalize_p = 0;
+  opts->sort_p = 1;
+  opts->ascending_p = 0;
+  opts->dropna_p = 1;
+
+  if (!NIL_P(kwargs)) {
+    enum { kw_normalize, kw_sort, kw_ascending, kw_dropna };
+    ID kwarg_keys[4];
+    VALUE kwarg_vals[4];
+
+    kwarg_keys[kw_normalize] = id_normalize;
+    kwarg_keys[kw_sort]      = id_sort;
+    kwarg_keys[kw_ascending] = id_ascending;
+    kwarg_keys[kw_dropna]    = id_dropna;
+
+    rb_get_kwargs(kwargs, kwarg_keys, 0, 4, kwarg_vals);
+    opts->normalize_p = (kwarg_vals[kw_normalize] != Qundef) && RTEST(kwarg_vals[kw_normalize]);
+    opts->sort_p      = (kwarg_vals[kw_sort]      != Qundef) && RTEST(kwarg_vals[kw_sort]);
+    opts->ascending_p = (kwarg_vals[kw_ascending] != Qundef) && RTEST(kwarg_vals[kw_ascending]);
+    opts->dropna_p    = (kwarg_vals[kw_dropna]    != Qundef) && RTEST(kwarg_vals[kw_dropna]);
+  }
+}
+
+static int
+value_counts_result_to_assoc_array_i(VALUE key, VALUE val, VALUE ary)
+{
+  VALUE assoc = rb_ary_tmp_new(2);
+  rb_ary_push(assoc, key);
+  rb_ary_push(assoc, val);
+  rb_ary_push(ary, assoc);
+  return ST_CONTINUE;
+}
+
+static int
+value_counts_sort_cmp_asc(const void *ap, const void *bp, void *dummy)
+{
+  VALUE a = *(const VALUE *)ap, b = *(const VALUE *)bp;
+  VALUE av, bv, cmp;
+
+  av = RARRAY_AREF(a, 1);
+  bv = RARRAY_AREF(b, 1);
+
+  /* TODO: optimize */
+  cmp = rb_funcall(av, id_cmp, 1, bv);
+  return rb_cmpint(cmp, av, bv);
+}
+
+static int
+value_counts_sort_cmp_desc(const void *ap, const void *bp, void *dummy)
+{
+  VALUE a = *(const VALUE *)ap, b = *(const VALUE *)bp;
+  VALUE av, bv, cmp;
+
+  av = RARRAY_AREF(a, 1);
+  bv = RARRAY_AREF(b, 1);
+
+  /* TODO: optimize */
+  cmp = rb_funcall(bv, id_cmp, 1, av);
+  return rb_cmpint(cmp, bv, av);
+}
+
+static VALUE
+value_counts_sort_result(VALUE result, const int dropna_p, const int ascending_p)
+{
+  VALUE na_count = Qundef, ary, sorted;
+  long i;
+
+  if (RHASH_SIZE(result) < 1) {
+    return result;
+  }
+
+  if (!dropna_p) {
+    na_count = rb_hash_lookup2(result, Qnil, Qundef);
+    if (na_count != Qundef) {
+      rb_hash_delete(result, Qnil);
+    }
+  }
+
+  const long len = (long)RHASH_SIZE(result);
+  ary = rb_ary_tmp_new(len);
+  rb_hash_foreach(result, value_counts_result_to_assoc_array_i, ary);
+  if (ascending_p) {
+    RARRAY_PTR_USE(ary, ptr, {
+      ruby_qsort(ptr, RARRAY_LEN(ary), sizeof(VALUE),
+                 value_counts_sort_cmp_asc, NULL);
+    });
+  }
+  else {
+    RARRAY_PTR_USE(ary, ptr, {
+      ruby_qsort(ptr, RARRAY_LEN(ary), sizeof(VALUE),
+                 value_counts_sort_cmp_desc, NULL);
+    });
+  }
+
+#ifdef HAVE_RB_HASH_NEW_WITH_SIZE
+  sorted = rb_hash_new_with_size(len);
+#else
+  sorted = rb_hash_new();
+#endif
+
+  if (na_count != Qundef && ascending_p) {
+    rb_hash_aset(sorted, Qnil, na_count);
+  }
+
+  for (i = 0; i < len; ++i) {
+    VALUE a = RARRAY_AREF(ary, i);
+    VALUE k = RARRAY_AREF(a, 0);
+    VALUE v = RARRAY_AREF(a, 1);
+    rb_hash_aset(sorted, k, v);
+  }
+
+  if (na_count != Qundef && !ascending_p) {
+    rb_hash_aset(sorted, Qnil, na_count);
+  }
+
+  return sorted;
+}
+
+struct value_counts_normalize_params {
+  VALUE result;
+  long total;
+};
+
+static int
+value_counts_normalize_i(VALUE key, VALUE val, VALUE arg)
+{
+  struct value_counts_normalize_params *params = (struct value_counts_normalize_params *)arg;
+  double new_val;
+
+  new_val = NUM2DBL(val) / params->total;
+  rb_hash_aset(params->result, key, DBL2NUM(new_val));
+
+  return ST_CONTINUE;
+}
+
+struct value_counts_memo {
+  int dropna_p;
+  long total;
+  long na_count;
+  VALUE result;
+  struct na_cache na;
+};
+
+static VALUE
+any_value_counts(VALUE kwargs, VALUE obj,
+                 void (* counter)(VALUE, struct value_counts_memo *))
+{
+  struct value_counts_opts opts;
+  struct value_counts_memo memo;
+
+  value_counts_extract_opts(kwargs, &opts);
+
+  memo.result = rb_hash_new();
+  memo.total = 0;
+  memo.na_count = 0;
+  memo.dropna_p = opts.dropna_p;
+  na_cache_init(&memo.na);
+
+  if (!opts.dropna_p) {
+    rb_hash_aset(memo.result, Qnil, INT2FIX(0)); // reserve the room for NA
+  }
+
+  counter(obj, &memo);
+
+  if (!opts.dropna_p) {
+    if (memo.na_count == 0)
+      rb_hash_delete(memo.result, Qnil);
+    else
+      rb_hash_aset(memo.result, Qnil, LONG2NUM(memo.na_count));
+  }
+
+  if (opts.sort_p) {
+    memo.result = value_counts_sort_result(memo.result, opts.dropna_p, opts.ascending_p);
+  }
+
+  if (opts.normalize_p) {
+    struct value_counts_normalize_params params;
+    params.result = memo.result;
+    params.total = memo.total - (opts.dropna_p ? memo.na_count : 0);
+    rb_hash_foreach(memo.result, value_counts_normalize_i, (VALUE)&params);
+  }
+
+  return memo.result;
+}
+
+static VALUE
+enum_value_counts_without_sort_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  struct value_counts_memo *memo = (struct value_counts_memo *)args;
+
+  ENUM_WANT_SVALUE();
+
+  if (is_na_cached(e, &memo->na)) {
+    ++memo->na_count;
+  }
+  else {
+    VALUE cnt = rb_hash_lookup2(memo->result, e, INT2FIX(0));
+    rb_hash_aset(memo->result, e, rb_int_plus(cnt, INT2FIX(1)));
+  }
+
+  ++memo->total;
+
+  return Qnil;
+}
+
+static void
+enum_value_counts_without_sort(VALUE obj, struct value_counts_memo *memo)
+{
+  rb_block_call(obj, id_each, 0, 0, enum_value_counts_without_sort_i, (VALUE)memo);
+}
+
+static VALUE
+enum_value_counts(int argc, VALUE* argv, VALUE obj)
+{
+  VALUE kwargs;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  return any_value_counts(kwargs, obj, enum_value_counts_without_sort);
+}
+
+static void
+ary_value_counts_without_sort(VALUE ary, struct value_counts_memo *memo)
+{
+  const VALUE zero = INT2FIX(0);
+  const VALUE one = INT2FIX(1);
+  long i, na_count = 0;
+  long const n = RARRAY_LEN(ary);
+
+  for (i = 0; i < n; ++i) {
+    VALUE val = RARRAY_AREF(ary, i);
+
+    if (is_na_cached(val, &memo->na)) {
+      ++na_count;
+    }
+    else {
+      VALUE cnt = rb_hash_lookup2(memo->result, val, zero);
+      rb_hash_aset(memo->result, val, rb_int_plus(cnt, one));
+    }
+  }
+
+  memo->total = n;
+  memo->na_count = na_count;
+}
+
+/* call-seq:
+ *    ary.value_counts(normalize: false, sort: true, ascending: false, dropna: true, key: nil, index: nil) -> hash
+ *
+ * Returns a hash that contains the counts of values in `ary`.
+ *
+ * This method treats `nil` and NaN, the objects who respond `true` to `nan?`,
+ * as the same thing, and stores the count of them as the value for `nil`.
+ *
+ * @param [false,true] normalize  If `true`, the result contains the relative
+ *                                frequencies of the unique values.
+ * @param [true,false] sort  Sort by values.
+ * @param [false,true] ascending  Sort in ascending order.
+ * @param [true,false] dropna  Don't include counts of NAs.
+ * @param [Object] key  Count the values of `row[key]` of the rows in `ary`.
+ * @param [Integer] index  Count the values of `row[index]` of the rows in `ary`.
+ *
+ * @return [Hash] A hash consists of the counts of the values
+ */
+static VALUE
+ary_value_counts(int argc, VALUE* argv, VALUE ary)
+{
+  VALUE kwargs;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  ary = ary_extract_field(ary, &kwargs);
+  return any_value_counts(kwargs, ary, ary_value_counts_without_sort);
+}
+
+static int
+hash_value_counts_without_sort_i(VALUE key, VALUE val, VALUE arg)
+{
+  struct value_counts_memo *memo = (struct value_counts_memo *)arg;
+
+  if (is_na_cached(val, &memo->na)) {
+    ++memo->na_count;
+
+    if (memo->dropna_p) {
+      return ST_CONTINUE;
+    }
+  }
+  else {
+    VALUE cnt = rb_hash_lookup2(memo->result, val, INT2FIX(0));
+    rb_hash_aset(memo->result, val, rb_int_plus(cnt, INT2FIX(1)));
+  }
+
+  return ST_CONTINUE;
+}
+
+static void
+hash_value_counts_without_sort(VALUE hash, struct value_counts_memo *memo)
+{
+  rb_hash_foreach(hash, hash_value_counts_without_sort_i, (VALUE)memo);
+  memo->total = RHASH_SIZE(hash);
+}
+
+/* call-seq:
+ *    hash.value_counts(normalize: false, sort: true, ascending: false, dropna: true) -> hash
+ *
+ * Returns a hash that contains the counts of values in `hash`.
+ *
+ * This method treats `nil` and NaN, the objects who respond `true` to `nan?`,
+ * as the same thing, and stores the count of them as the value for `nil`.
+ *
+ * @param [false,true] normalize  If `true`, the result contains the relative
+ *                                frequencies of the unique values.
+ * @param [true,false] sort  Sort by values.
+ * @param [false,true] ascending  Sort in ascending order.
+ * @param [true,false] dropna  Don't include counts of NAs.
+ *
+ * @return [Hash] A hash consists of the counts of the values
+ */
+static VALUE
+hash_value_counts(int argc, VALUE* argv, VALUE hash)
+{
+  VALUE kwargs;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  return any_value_counts(kwargs, hash, hash_value_counts_without_sort);
+}
+
+/* The accumulator of a group in group_stats.  It is stored in a hidden
+ * String, which is the first element of a hidden Array for the group key
+ * in the hash of groups.  The rest of the Array are the minimum and the
+ * maximum values, and the sum spilled from n, so that they are marked.
+ * The sum is kept exact while all the values are Integer, in the same
+ * way as describe. */
+struct group_stats_accumulator {
+  struct enum_mean_variance_memo mv;
+  double min_x, max_x;
+  /* The wide_int sum is copied in and out by memcpy, because the buffer
+   * of a String is not aligned for int128_t. */
+  char n[sizeof(wide_int)];
+  int int_p;
+};
+
+enum {
+  GROUP_STATS_ACC,
+  GROUP_STATS_MIN,
+  GROUP_STATS_MAX,
+  GROUP_STATS_SUM,
+  GROUP_STATS_ENTRY_LEN
+};
+
+struct group_stats_memo {
+  VALUE by, value;
+  int by_call_p, value_call_p;
+  int skip_na;
+  VALUE groups;
+  struct na_cache na;
+};
+
+/* Look up the field key of the item e.  A Symbol key names a method of
+ * the item if the item is not a Hash or a Struct and responds to it. */
+static inline VALUE
+group_stats_field(VALUE e, VALUE key, int call_p)
+{
+  if (call_p)
+    return rb_funcall(key, id_call, 1, e);
+  if (SYMBOL_P(key) && !RB_TYPE_P(e, T_HASH) && !RB_TYPE_P(e, T_STRUCT) &&
+      rb_respond_to(e, SYM2ID(key)))
+    return rb_funcall(e, SYM2ID(key), 0);
+  return field_value(e, key, 0, 0);
+}
+
+static VALUE
+enum_group_stats_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+{
+  struct group_stats_memo *memo = (struct group_stats_memo *)args;
+  struct group_stats_accumulator *acc;
+  VALUE key, v, entry, buf;
+  double x;
+
+  ENUM_WANT_SVALUE();
+
+  key = group_stats_field(e, memo->by, memo->by_call_p);
+  v = (memo->value == Qundef) ? e : group_stats_field(e, memo->value, memo->value_call_p);
+  if (memo->skip_na && is_na_cached(v, &memo->na))
+    return Qnil;
+
+  x = value_to_dbl(v);
+
+  entry = rb_hash_lookup2(memo->groups, key, Qundef);
+  if (entry == Qundef) {
+    buf = rb_str_tmp_new(sizeof(struct group_stats_accumulator));
+    acc = (struct group_stats_accumulator *)RSTRING_PTR(buf);
+    mean_variance_memo_init(&acc->mv, 2, 0);
+    acc->mv.block_given = 0;
+    acc->min_x = acc->max_x = x;
+    memset(acc->n, 0, sizeof(acc->n));
+    acc->int_p = 1;
+    entry = rb_ary_tmp_new(GROUP_STATS_ENTRY_LEN);
+    rb_ary_push(entry, buf);
+    rb_ary_push(entry, v);
+    rb_ary_push(entry, v);
+    rb_ary_push(entry, INT2FIX(0));
+    rb_hash_aset(memo->groups, key, entry);
+  }
+  else {
+    acc = (struct group_stats_accumulator *)RSTRING_PTR(RARRAY_AREF(entry, GROUP_STATS_ACC));
+    /* NaN sticks once it appears */
+    if (isnan(acc->min_x))
+      ;
+    else if (isnan(x)) {
+      acc->min_x = acc->max_x = x;
+      rb_ary_store(entry, GROUP_STATS_MIN, v);
+      rb_ary_store(entry, GROUP_STATS_MAX, v);
+    }
+    else {
+      if (x < acc->min_x) {
+        acc->min_x = x;
+        rb_ary_store(entry, GROUP_STATS_MIN, v);
+      }
+      if (x > acc->max_x) {
+        acc->max_x = x;
+        rb_ary_store(entry, GROUP_STATS_MAX, v);
+      }
+    }
+  }
+
+  if (acc->int_p && RB_INTEGER_TYPE_P(v)) {
+    VALUE sum = RARRAY_AREF(entry, GROUP_STATS_SUM);
+    wide_int n;
+    memcpy(&n, acc->n, sizeof(n));
+    wide_int_add(&n, &sum, v);
+    memcpy(acc->n, &n, sizeof(n));
+    rb_ary_store(entry, GROUP_STATS_SUM, sum);
+  }
+  else
+    acc->int_p = 0;
+
+  mean_variance_update(&acc->mv, x);
+
+  return Qnil;
+}
+
+struct group_stats_result_arg {
+  VALUE stats;
+  int population;
+  VALUE result;
+};
+
+static int
+group_stats_result_i(VALUE key, VALUE entry, VALUE arg)
+{
+  struct group_stats_result_arg *rarg = (struct group_stats_result_arg *)arg;
+  const struct group_stats_accumulator *acc =
+    (const struct group_stats_accumulator *)RSTRING_PTR(RARRAY_AREF(entry, GROUP_STATS_ACC));
+  long const n = RARRAY_LEN(rarg->stats);
+  VALUE res = rb_hash_new();
+  wide_int sum;
+  long i;
+
+  memcpy(&sum, acc->n, sizeof(sum));
+
+  for (i = 0; i < n; ++i) {
+    VALUE const stat = RARRAY_AREF(rarg->stats, i);
+    ID const id = SYM2ID(stat);
+    VALUE v;
+
+    if (id == id_count)
+      v = SIZET2NUM(acc->mv.n);
+    else if (id == id_sum)
+      v = acc->int_p ? wide_int_flush(sum, RARRAY_AREF(entry, GROUP_STATS_SUM)) : DBL2NUM(acc->mv.f);
+    else if (id == id_mean)
+      v = DBL2NUM(moments_mean(&acc->mv));
+    else if (id == id_variance)
+      v = DBL2NUM(moments_variance(&acc->mv, rarg->population));
+    else if (id == id_stdev)
+      v = DBL2NUM(sqrt(moments_variance(&acc->mv, rarg->population)));
+    else if (id == id_min)
+      v = RARRAY_AREF(entry, GROUP_STATS_MIN);
+    else
+      v = RARRAY_AREF(entry, GROUP_STATS_MAX);
+
+    rb_hash_aset(res, stat, v);
+  }
+
+  rb_hash_aset(rarg->result, key, res);
+  return ST_CONTINUE;
+}
+
+static VALUE
+group_stats_check_stats(VALUE stats)
+{
+  long i, n;
+
+  if (stats == Qundef)
+    return rb_ary_new_from_args(5, ID2SYM(id_count), ID2SYM(id_mean), ID2SYM(id_variance),
+                                ID2SYM(id_min), ID2SYM(id_max));
+
+  stats = rb_Array(stats);
+  n = RARRAY_LEN(stats);
+  for (i = 0; i < n; ++i) {
+    VALUE const stat = RARRAY_AREF(stats, i);
+    ID id;
+
+    if (!SYMBOL_P(stat)) {
+      rb_raise(rb_eTypeError, "stats must be Symbols (%"PRIsVALUE" given)", stat);
+    }
+
+    id = SYM2ID(stat);
+    if (id != id_count && id != id_sum && id != id_mean && id != id_variance &&
+        id != id_stdev && id != id_min && id != id_max) {
+      rb_raise(rb_eArgError, "unknown statistic: %"PRIsVALUE, stat);
+    }
+  }
+
+  return stats;
+}
+
+/* call-seq:
+ *    enum.group_stats(by:, value: nil, stats: [:count, :mean, :variance, :min, :max], population: false, skip_na: false) -> hash
+ *
+ * Calculate statistics of the values in each group of the items in `enum`.
+ *
+ * The items are scanned only once, and only an accumulator of the count,
+ * the sum, the mean, the variance, the minimum, and the maximum is kept for
+ * each group, so the values of a group are not collected into an array.
+ *
+ * As in `describe`, the minimum and the maximum are the values themselves,
+ * and the sum is an Integer while all the values of a group are Integer.
+ * The other statistics are Float.
+ *
+ * ```ruby
+ * requests.group_stats(by: :endpoint, value: :latency, stats: [:count, :mean, :stdev])
+ * # => {"/users" => {count: 120, mean: 12.3, stdev: 4.5}, ...}
+ * ```
+ *
+ * @param [Object] by  The key of the groups.  If it responds to `call`,
+ *   the group key of an item is the result of `by.call(item)`.
+ *   If `by` is a Symbol, and the item is not a Hash or a Struct and
+ *   responds to the method `by`, it is `item.public_send(by)`.
+ *   Otherwise, it is `item[by]`.
+ * @param [Object] value  The value of an item, which is looked up in the
+ *   same way as `by`.  If `nil`, the item itself is the value.
+ * @param [Array<Symbol>] stats  The statistics to calculate.  The available
+ *   ones are `:count`, `:sum`, `:mean`, `:variance`, `:stdev`, `:min`, and `:max`.
+ * @param [false,true] population  If `true`, the variance is calculated as
+ *   a population variance.
+ * @param [false,true] skip_na  If `true`, NA values are not counted.
+ *
+ * @return [Hash] A hash of the group keys and the hashes of the statistics
+ */
+static VALUE
+enum_group_stats(int argc, VALUE *argv, VALUE obj)
+{
+  enum { kw_by, kw_value, kw_stats, kw_population, kw_skip_na };
+  ID kwarg_keys[5];
+  VALUE kwargs, kwarg_vals[5];
+  struct group_stats_memo memo;
+  struct group_stats_result_arg rarg;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+
+  kwarg_keys[kw_by]         = id_by;
+  kwarg_keys[kw_value]      = id_value;
+  kwarg_keys[kw_stats]      = id_stats;
+  kwarg_keys[kw_population] = id_population;
+  kwarg_keys[kw_skip_na]    = id_skip_na;
+
+  rb_get_kwargs(kwargs, kwarg_keys, 1, 4, kwarg_vals);
+
+  memo.by = kwarg_vals[kw_by];
+  memo.by_call_p = rb_respond_to(memo.by, id_call);
+  memo.value = NIL_P(kwarg_vals[kw_value]) ? Qundef : kwarg_vals[kw_value];
+  memo.value_call_p = memo.value != Qundef && rb_respond_to(memo.value, id_call);
+  memo.skip_na = (kwarg_vals[kw_skip_na] != Qundef) && RTEST(kwarg_vals[kw_skip_na]);
+  memo.groups = rb_hash_new();
+  na_cache_init(&memo.na);
+
+  rarg.stats = group_stats_check_stats(kwarg_vals[kw_stats]);
+  rarg.population = (kwarg_vals[kw_population] != Qundef) && RTEST(kwarg_vals[kw_population]);
+  rarg.result = rb_hash_new();
+
+  rb_block_call(obj, id_each, 0, 0, enum_group_stats_i, (VALUE)&memo);
+  rb_hash_foreach(memo.groups, group_stats_result_i, (VALUE)&rarg);
+
+  RB_GC_GUARD(rarg.stats);
+  return rarg.result;
+}
+
+/* The values of a Hash, or the results of the block called with each
+ * pair, are passed to the accumulator in memo.  The block is called
+ * with the key and the value as two arguments, so that no Array is
+ * allocated for each pair. */
+struct hash_values_arg {
+  int block_given;
+  void *memo;
+};
+
+static inline VALUE
+hash_values_value(VALUE key, VALUE value, const struct hash_values_arg *arg)
+{
+  if (arg->block_given)
+    return rb_yield_values(2, key, value);
+  return value;
+}
+
+static int
+hash_sum_values_i(VALUE key, VALUE value, VALUE data)
+{
+  struct hash_values_arg *arg = (struct hash_values_arg *)data;
+  sum_iter(hash_values_value(key, value, arg), (struct enum_sum_memo *)arg->memo);
+  return ST_CONTINUE;
+}
+
+static int
+hash_mean_variance_values_i(VALUE key, VALUE value, VALUE data)
+{
+  struct hash_values_arg *arg = (struct hash_values_arg *)data;
+  mean_variance_iter(hash_values_value(key, value, arg),
+                     (struct enum_mean_variance_memo *)arg->memo);
+  return ST_CONTINUE;
+}
+
+static int
+hash_collect_values_i(VALUE key, VALUE value, VALUE data)
+{
+  struct hash_values_arg *arg = (struct hash_values_arg *)data;
+  rb_ary_push((VALUE)arg->memo, hash_values_value(key, value, arg));
+  return ST_CONTINUE;
+}
+
+static void
+hash_sum_values_count(VALUE hash, VALUE init, int skip_na, VALUE *sum_ptr, long *count_ptr)
+{
+  struct enum_sum_memo memo;
+  struct hash_values_arg arg;
+
+  enum_sum_memo_init(&memo, init, skip_na);
+  arg.block_given = memo.block_given;
+  arg.memo = &memo;
+  memo.block_given = 0;
+  rb_hash_foreach(hash, hash_sum_values_i, (VALUE)&arg);
+
+  *sum_ptr = enum_sum_memo_result(&memo);
+  if (count_ptr)
+    *count_ptr = memo.count;
+}
+
+/* call-seq:
+ *    hash.sum_values(init=0, skip_na: false) -> number
+ *    hash.sum_values(init=0, skip_na: false) { |key, value| ... } -> number
+ *
+ * Calculate the sum of the values in `hash`, or the results of the block
+ * called with each key and value.
+ * This is equivalent to `hash.values.sum`, but does not create any
+ * intermediate arrays.
+ *
+ * @return [Number] A summation value
+ */
+static VALUE
+hash_sum_values(int argc, VALUE *argv, VALUE hash)
+{
+  VALUE sum, init, opts;
+
+  if (rb_scan_args(argc, argv, "01:", &init, &opts) == 0) {
+    init = LONG2FIX(0);
+  }
+
+  hash_sum_values_count(hash, init, opt_skip_na(opts), &sum, NULL);
+  return sum;
+}
+
+/* call-seq:
+ *    hash.mean_values(skip_na: false) -> number
+ *    hash.mean_values(skip_na: false) { |key, value| ... } -> number
+ *
+ * Calculate the mean of the values in `hash`, or the results of the block
+ * called with each key and value.
+ *
+ * @return [Number] A mean value
+ */
+static VALUE
+hash_mean_values(int argc, VALUE *argv, VALUE hash)
+{
+  VALUE sum, opts, mean = DBL2NUM(0.0);
+  long n;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+
+  hash_sum_values_count(hash, DBL2NUM(0.0), opt_skip_na(opts), &sum, &n);
+  if (n > 0)
+    calculate_and_set_mean(&mean, sum, n);
+  return mean;
+}
+
+/* call-seq:
+ *    hash.variance_values(population: false, skip_na: false) -> number
+ *    hash.variance_values(population: false, skip_na: false) { |key, value| ... } -> number
+ *
+ * Calculate the variance of the values in `hash`, or the results of the
+ * block called with each key and value.
+ *
+ * @return [Number] A variance value
+ */
+static VALUE
+hash_variance_values(int argc, VALUE *argv, VALUE hash)
+{
+  struct variance_opts options;
+  struct enum_mean_variance_memo memo;
+  struct hash_values_arg arg;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+
+  mean_variance_memo_init(&memo, 2, options.skip_na);
+  memo.allow_complex = 1;
+  arg.block_given = memo.block_given;
+  arg.memo = &memo;
+  memo.block_given = 0;
+  rb_hash_foreach(hash, hash_mean_variance_values_i, (VALUE)&arg);
+
+  if (memo.n < 2)
+    return DBL2NUM(NAN);
+  return DBL2NUM(memo.m2 / (double)(memo.n - (options.population ? 0 : 1)));
+}
+
+/* call-seq:
+ *    hash.percentile_values(q) -> float or array
+ *    hash.percentile_values(q) { |key, value| ... } -> float or array
+ *
+ * Calculate the specified percentiles of the values in `hash`, or the
+ * results of the block called with each key and value, in the same way
+ * as `Array#percentile`.
+ *
+ * @param [Number, Array] percentile or array of percentiles to compute,
+ *   which must be between 0 and 100 inclusive.
+ *
+ * @return [Float, Array] A percentile value(s)
+ */
+static VALUE
+hash_percentile_values(VALUE hash, VALUE q)
+{
+  struct hash_values_arg arg;
+  VALUE values = rb_ary_new_capa(RHASH_SIZE(hash));
+
+  arg.block_given = rb_block_given_p();
+  arg.memo = (void *)values;
+  rb_hash_foreach(hash, hash_collect_values_i, (VALUE)&arg);
+
+  return ary_percentile(values, q);
+}
+
+/* Rolling window statistics
+ *
+ * The values are copied into a native buffer, in which NA values are NaN,
+ * and the statistics of each window are written into a native output
+ * buffer, which is converted to the result array at last. */
+
+enum rolling_stat {
+  ROLLING_SUM,
+  ROLLING_MEAN,
+  ROLLING_VARIANCE,
+  ROLLING_STDEV
+};
+
+struct rolling_opts {
+  long window;
+  long min_periods;
+  int population;
+};
+
+static void
+rolling_extract_opts(VALUE window, VALUE kwargs, int population_p, struct rolling_opts *opts)
+{
+  enum { kw_min_periods, kw_population };
+  ID kwarg_keys[2];
+  VALUE kwarg_vals[2];
+
+  if (!RB_INTEGER_TYPE_P(window)) {
+    rb_raise(rb_eTypeError, "window must be an Integer (%"PRIsVALUE" given)", rb_obj_class(window));
+  }
+  opts->window = NUM2LONG(window);
+  if (opts->window < 1) {
+    rb_raise(rb_eArgError, "window must be positive");
+  }
+  opts->min_periods = opts->window;
+  opts->population = 0;
+
+  if (!NIL_P(kwargs)) {
+    kwarg_keys[kw_min_periods] = id_min_periods;
+    kwarg_keys[kw_population]  = id_population;
+
+    rb_get_kwargs(kwargs, kwarg_keys, 0, population_p ? 2 : 1, kwarg_vals);
+    if (kwarg_vals[kw_min_periods] != Qundef && !NIL_P(kwarg_vals[kw_min_periods])) {
+      opts->min_periods = NUM2LONG(kwarg_vals[kw_min_periods]);
+      if (opts->min_periods < 0 || opts->window < opts->min_periods) {
+        rb_raise(rb_eArgError, "min_periods must be between 0 and window");
+      }
+    }
+    if (population_p && kwarg_vals[kw_population] != Qundef) {
+      opts->population = RTEST(kwarg_vals[kw_population]);
+    }
+  }
+}
+
+/* Copy the values in ary into a native buffer, storing NA values as NaN.
+ * The values are passed to the block if it is given. */
+static VALUE
+ary_rolling_values(VALUE ary)
+{
+  int const block_given = rb_block_given_p();
+  long const n = RARRAY_LEN(ary);
+  VALUE buf = dbl_buffer_new(n);
+  long i;
+  struct na_cache na;
+
+  na_cache_init(&na);
+  for (i = 0; i < n && i < RARRAY_LEN(ary); ++i) {
+    VALUE e = RARRAY_AREF(ary, i);
+    if (block_given)
+      e = rb_yield(e);
+    DBL_BUFFER_PTR(buf)[i] = is_na_cached(e, &na) ? NAN : value_to_dbl(e);
+  }
+  rb_str_set_len(buf, i * (long)sizeof(double));
+
+  return buf;
+}
+
+static VALUE
+dbl_buffer_to_ary(const double *p, long n)
+{
+  VALUE res = rb_ary_new_capa(n);
+  long i;
+
+  for (i = 0; i < n; ++i)
+    rb_ary_push(res, DBL2NUM(p[i]));
+
+  return res;
+}
+
+struct rolling_moments_args {
+  const double *p;
+  long n;
+  struct rolling_opts opts;
+  enum rolling_stat stat;
+  double *out;
+};
+
+/* The mean and m2 of a window are the moments of the values shifted by
+ * the first value added to the empty window, so that the updates do not
+ * lose the precision on values with a large offset.  The sum f is of the
+ * values as they are. */
+struct rolling_window {
+  long count;
+  double shift, mean, m2, f, c;
+};
+
+static inline void
+rolling_window_add(struct rolling_window *w, double x)
+{
+  double delta;
+
+  if (w->count == 0)
+    w->shift = x;
+  kahan_add(&w->f, &w->c, x);
+  x -= w->shift;
+  delta = x - w->mean;
+
+  ++w->count;
+  w->mean += delta / w->count;
+  w->m2 += delta * (x - w->mean);
+}
+
+static inline void
+rolling_window_remove(struct rolling_window *w, double x)
+{
+  double delta;
+
+  if (--w->count == 0) {
+    w->shift = w->mean = w->m2 = w->f = w->c = 0.0;
+    return;
+  }
+
+  kahan_add(&w->f, &w->c, -x);
+  x -= w->shift;
+  delta = x - w->mean;
+  w->mean -= delta / w->count;
+  w->m2 -= delta * (x - w->mean);
+}
+
+/* Recalculate the window p[0...n] from scratch to discard the rounding
+ * errors accumulated by the removals. */
+static void
+rolling_window_reset(struct rolling_window *w, const double *p, long n)
+{
+  long i;
+
+  w->count = 0;
+  w->shift = w->mean = w->m2 = w->f = w->c = 0.0;
+  for (i = 0; i < n; ++i) {
+    if (!isnan(p[i]))
+      rolling_window_add(w, p[i]);
+  }
+}
+
+/* Slide the window by adding the incoming value and removing the outgoing
+ * one with the Welford updates.  The window is recalculated every
+ * `window` steps, so the drift is bounded and the cost is still O(n). */
+static void *
+rolling_moments(void *ptr)
+{
+  struct rolling_moments_args *args = (struct rolling_moments_args *)ptr;
+  const double *p = args->p;
+  long const window = args->opts.window;
+  long const ddof = args->opts.population ? 0 : 1;
+  struct rolling_window w;
+  long i;
+
+  rolling_window_reset(&w, p, 0);
+
+  for (i = 0; i < args->n; ++i) {
+    double v;
+
+    if (i >= window && (i - window + 1) % window == 0) {
+      rolling_window_reset(&w, p + i - window + 1, window);
+    }
+    else {
+      if (!isnan(p[i]))
+        rolling_window_add(&w, p[i]);
+      if (i >= window && !isnan(p[i - window]))
+        rolling_window_remove(&w, p[i - window]);
+    }
+
+    if (w.count < args->opts.min_periods) {
+      v = NAN;
+    }
+    else {
+      switch (args->stat) {
+        case ROLLING_SUM:
+          v = w.f;
+          break;
+        case ROLLING_MEAN:
+          v = w.count > 0 ? w.shift + w.mean : NAN;
+          break;
+        default:
+          v = w.count > ddof ? (w.m2 > 0 ? w.m2 : 0.0) / (w.count - ddof) : NAN;
+          if (args->stat == ROLLING_STDEV)
+            v = sqrt(v);
+          break;
+      }
+    }
+    args->out[i] = v;
+  }
+
+  return NULL;
+}
+
+static VALUE
+ary_rolling_moments(int argc, VALUE *argv, VALUE ary, enum rolling_stat stat)
+{
+  struct rolling_moments_args args;
+  VALUE window, kwargs, values, out, res;
+
+  rb_scan_args(argc, argv, "1:", &window, &kwargs);
+  rolling_extract_opts(window, kwargs, stat >= ROLLING_VARIANCE, &args.opts);
+  args.stat = stat;
+
+  values = ary_rolling_values(ary);
+  args.p = DBL_BUFFER_PTR(values);
+  args.n = DBL_BUFFER_LEN(values);
+  out = dbl_buffer_new(args.n);
+  args.out = DBL_BUFFER_PTR(out);
+
+  call_without_gvl_if_large(rolling_moments, &args, args.n);
+  res = dbl_buffer_to_ary(args.out, args.n);
+
+  RB_GC_GUARD(values);
+  RB_GC_GUARD(out);
+  return res;
+}
+
+/* call-seq:
+ *    ary.rolling_sum(window, min_periods: window) -> array
+ *    ary.rolling_sum(window, min_periods: window) { |x| ... } -> array
+ *
+ * Calculate the sums of the values in the rolling windows of `ary`.
+ *
+ * The i-th element of the result is the statistic of the window that
+ * ends at the i-th value of `ary`, `ary[i-window+1..i]`.  NA values are
+ * skipped, and the result is NaN for the windows with fewer values than
+ * `min_periods`.  Each window is updated from the previous one,
+ * so the calculation takes O(n) time regardless of `window`.
+ *
+ * If a block is given, the values are the results of the block called
+ * with each element of `ary`.
+ *
+ * @param [Integer] window  The number of values in a window.
+ * @param [Integer] min_periods  The minimum number of non-NA values in
+ *   a window to calculate the statistic.
+ *
+ * @return [Array<Float>] The sums of the windows
+ */
+static VALUE
+ary_rolling_sum(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_rolling_moments(argc, argv, ary, ROLLING_SUM);
+}
+
+/* call-seq:
+ *    ary.rolling_mean(window, min_periods: window) -> array
+ *    ary.rolling_mean(window, min_periods: window) { |x| ... } -> array
+ *
+ * Calculate the means of the values in the rolling windows of `ary`.
+ * See `rolling_sum` for the windows.
+ *
+ * @return [Array<Float>] The means of the windows
+ */
+static VALUE
+ary_rolling_mean(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_rolling_moments(argc, argv, ary, ROLLING_MEAN);
+}
+
+/* call-seq:
+ *    ary.rolling_variance(window, min_periods: window, population: false) -> array
+ *    ary.rolling_variance(window, min_periods: window, population: false) { |x| ... } -> array
+ *
+ * Calculate the variances of the values in the rolling windows of `ary`.
+ * See `rolling_sum` for the windows, and `variance` for `population:`.
+ *
+ * @return [Array<Float>] The variances of the windows
+ */
+static VALUE
+ary_rolling_variance(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_rolling_moments(argc, argv, ary, ROLLING_VARIANCE);
+}
+
+/* call-seq:
+ *    ary.rolling_stdev(window, min_periods: window, population: false) -> array
+ *    ary.rolling_stdev(window, min_periods: window, population: false) { |x| ... } -> array
+ *
+ * Calculate the standard deviations of the values in the rolling windows
+ * of `ary`.  See `rolling_sum` for the windows, and `variance` for
+ * `population:`.
+ *
+ * @return [Array<Float>] The standard deviations of the windows
+ */
+static VALUE
+ary_rolling_stdev(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_rolling_moments(argc, argv, ary, ROLLING_STDEV);
+}
+
+struct rolling_order_value {
+  double x;
+  long i;
+};
+
+struct rolling_percentile_args {
+  const double *p;
+  long n;
+  struct rolling_opts opts;
+  double q;
+  struct rolling_order_value *order;  /* n values sorted with their indices */
+  long *ranks;                        /* n ranks of the values in order */
+  long *tree;                         /* n + 1 counts of the Fenwick tree */
+  double *out;
+};
+
+static inline void
+fenwick_add(long *tree, long m, long r, long d)
+{
+  for (++r; r <= m; r += r & -r)
+    tree[r] += d;
+}
+
+/* Return the rank of the k-th (0-origin) smallest value in the tree. */
+static inline long
+fenwick_kth(const long *tree, long m, long k)
+{
+  long pos = 0, step = 1;
+
+  while (step * 2 <= m)
+    step *= 2;
+  for (; step > 0; step /= 2) {
+    if (pos + step <= m && tree[pos + step] <= k) {
+      pos += step;
+      k -= tree[pos];
+    }
+  }
+
+  return pos;
+}
+
+static int
+rolling_order_value_cmp(const void *ap, const void *bp, void *dummy)
+{
+  const struct rolling_order_value *a = ap, *b = bp;
+  if (a->x != b->x)
+    return (a->x > b->x) - (a->x < b->x);
+  return (a->i > b->i) - (a->i < b->i);
+}
+
+/* Calculate the percentile of each window by keeping the ranks of the
+ * values in the window in a Fenwick tree over the ranks of all the values.
+ * The values are ranked by sorting them once, then each step inserts and
+ * deletes a rank and selects the order statistics in O(log n) time.
+ *
+ * A window including NA is NaN, and the percentile is interpolated
+ * in the same way as ary_percentile_single_sorted. */
+static void *
+rolling_percentile(void *ptr)
+{
+  struct rolling_percentile_args *args = (struct rolling_percentile_args *)ptr;
+  const double *p = args->p;
+  long const n = args->n, window = args->opts.window;
+  long i, m, count = 0, na_count = 0;
+
+  for (i = m = 0; i < n; ++i) {
+    if (!isnan(p[i])) {
+      args->order[m].x = p[i];
+      args->order[m].i = i;
+      ++m;
+    }
+  }
+  ruby_qsort(args->order, m, sizeof(struct rolling_order_value),
+             rolling_order_value_cmp, NULL);
+  for (i = 0; i < m; ++i)
+    args->ranks[args->order[i].i] = i;
+  for (i = 0; i <= m; ++i)
+    args->tree[i] = 0;
+
+  for (i = 0; i < n; ++i) {
+    double h, l, f, x;
+
+    if (isnan(p[i]))
+      ++na_count;
+    else {
+      fenwick_add(args->tree, m, args->ranks[i], 1);
+      ++count;
+    }
+    if (i >= window) {
+      if (isnan(p[i - window]))
+        --na_count;
+      else {
+        fenwick_add(args->tree, m, args->ranks[i - window], -1);
+        --count;
+      }
+    }
+
+    if (na_count > 0 || count == 0 || count < args->opts.min_periods) {
+      args->out[i] = NAN;
+      continue;
+    }
+
+    h = (count - 1) * args->q / 100.0;
+    f = modf(h, &l);
+    x = args->order[fenwick_kth(args->tree, m, (long)l)].x;
+    if (f != 0 && (long)l != count - 1) {
+      double const x1 = args->order[fenwick_kth(args->tree, m, (long)l + 1)].x;
+      x = x * (1 - f) + x1 * f;
+    }
+    args->out[i] = x;
+  }
+
+  return NULL;
+}
+
+static VALUE
+ary_rolling_percentile_q(VALUE ary, VALUE window, VALUE q, VALUE kwargs)
+{
+  struct rolling_percentile_args args;
+  VALUE values, order, ranks, tree, out, res;
+
+  rolling_extract_opts(window, kwargs, 0, &args.opts);
+  args.q = NUM2DBL(q);
+  if (args.q < 0 || 100 < args.q) {
+    rb_raise(rb_eArgError, "percentile out of bounds");
+  }
+
+  values = ary_rolling_values(ary);
+  args.p = DBL_BUFFER_PTR(values);
+  args.n = DBL_BUFFER_LEN(values);
+
+  order = rb_str_tmp_new(args.n * (long)sizeof(struct rolling_order_value));
+  ranks = rb_str_tmp_new(args.n * (long)sizeof(long));
+  tree = rb_str_tmp_new((args.n + 1) * (long)sizeof(long));
+  out = dbl_buffer_new(args.n);
+  args.order = (struct rolling_order_value *)RSTRING_PTR(order);
+  args.ranks = (long *)RSTRING_PTR(ranks);
+  args.tree = (long *)RSTRING_PTR(tree);
+  args.out = DBL_BUFFER_PTR(out);
+
+  call_without_gvl_if_large(rolling_percentile, &args, args.n);
+  res = dbl_buffer_to_ary(args.out, args.n);
+
+  RB_GC_GUARD(values);
+  RB_GC_GUARD(order);
+  RB_GC_GUARD(ranks);
+  RB_GC_GUARD(tree);
+  RB_GC_GUARD(out);
+  return res;
+}
+
+/* call-seq:
+ *    ary.rolling_median(window, min_periods: window) -> array
+ *    ary.rolling_median(window, min_periods: window) { |x| ... } -> array
+ *
+ * Calculate the medians of the values in the rolling windows of `ary`.
+ * See `rolling_percentile`.
+ *
+ * @return [Array<Float>] The medians of the windows
+ */
+static VALUE
+ary_rolling_median(int argc, VALUE *argv, VALUE ary)
+{
+  VALUE window, kwargs;
+
+  rb_scan_args(argc, argv, "1:", &window, &kwargs);
+  return ary_rolling_percentile_q(ary, window, DBL2NUM(50), kwargs);
+}
+
+/* call-seq:
+ *    ary.rolling_percentile(window, q, min_periods: window) -> array
+ *    ary.rolling_percentile(window, q, min_periods: window) { |x| ... } -> array
+ *
+ * Calculate the percentiles of the values in the rolling windows of `ary`.
+ * See `rolling_sum` for the windows.
+ *
+ * Unlike the other rolling statistics, a window including NA values is NaN,
+ * as `percentile` of such an array is.  The values are ranked by sorting
+ * them once, and each window is updated in O(log n) time, so the calculation
+ * takes O(n log n) time regardless of `window`.
+ *
+ * If a block is given, the values are the results of the block called
+ * with each element of `ary`.
+ *
+ * @param [Integer] window  The number of values in a window.
+ * @param [Number] q  The percentile to compute, which must be between
+ *   0 and 100 inclusive.
+ * @param [Integer] min_periods  The minimum number of values in a window
+ *   to calculate the percentile.
+ *
+ * @return [Array<Float>] The percentiles of the windows
+ */
+static VALUE
+ary_rolling_percentile(int argc, VALUE *argv, VALUE ary)
+{
+  VALUE window, q, kwargs;
+
+  rb_scan_args(argc, argv, "2:", &window, &q, &kwargs);
+  return ary_rolling_percentile_q(ary, window, q, kwargs);
+}
+
+/* Exponentially weighted moving statistics
+ *
+ * The mean and the variance are updated by the recurrences
+ *
+ *   diff = x - mean
+ *   mean = mean + alpha * diff
+ *   var  = (1 - alpha) * (var + alpha * diff * diff)
+ *
+ * starting from the first value (Finch, 2009).  NA values do not update
+ * them. */
+
+struct ewm_state {
+  double alpha;
+  long count;
+  double mean, var;
+};
+
+static inline void
+ewm_update(struct ewm_state *st, double x)
+{
+  double diff, incr;
+
+  if (isnan(x))
+    return;
+
+  if (st->count++ == 0) {
+    st->mean = x;
+    st->var = 0.0;
+    return;
+  }
+
+  diff = x - st->mean;
+  incr = st->alpha * diff;
+  st->mean += incr;
+  st->var = (1 - st->alpha) * (st->var + diff * incr);
+}
+
+/* Calculate the smoothing factor from one of `alpha:`, `halflife:`, and
+ * `span:` in kwargs. */
+static double
+ewm_extract_alpha(VALUE kwargs)
+{
+  enum { kw_alpha, kw_halflife, kw_span };
+  ID kwarg_keys[3];
+  VALUE kwarg_vals[3];
+  double alpha;
+  int i, given = 0;
+
+  kwarg_keys[kw_alpha]    = id_alpha;
+  kwarg_keys[kw_halflife] = id_halflife;
+  kwarg_keys[kw_span]     = id_span;
+
+  if (!NIL_P(kwargs)) {
+    rb_get_kwargs(kwargs, kwarg_keys, 0, 3, kwarg_vals);
+    for (i = 0; i < 3; ++i)
+      given += (kwarg_vals[i] != Qundef);
+  }
+  if (given != 1) {
+    rb_raise(rb_eArgError, "exactly one of `alpha`, `halflife`, and `span` must be given");
+  }
+
+  if (kwarg_vals[kw_alpha] != Qundef) {
+    alpha = NUM2DBL(kwarg_vals[kw_alpha]);
+    if (!(0 < alpha && alpha <= 1)) {
+      rb_raise(rb_eArgError, "alpha must be in (0, 1]");
+    }
+  }
+  else if (kwarg_vals[kw_halflife] != Qundef) {
+    double const halflife = NUM2DBL(kwarg_vals[kw_halflife]);
+    if (!(0 < halflife)) {
+      rb_raise(rb_eArgError, "halflife must be positive");
+    }
+    alpha = 1 - exp(-log(2.0) / halflife);
+  }
+  else {
+    double const span = NUM2DBL(kwarg_vals[kw_span]);
+    if (!(1 <= span)) {
+      rb_raise(rb_eArgError, "span must be greater than or equal to 1");
+    }
+    alpha = 2 / (span + 1);
+  }
+
+  return alpha;
+}
+
+struct ewm_args {
+  const double *p;
+  long n;
+  double alpha;
+  int variance_p;
+  double *out;
+};
+
+static void *
+ewm_series(void *ptr)
+{
+  struct ewm_args *args = (struct ewm_args *)ptr;
+  struct ewm_state st;
+  long i;
+
+  st.alpha = args->alpha;
+  st.count = 0;
+  st.mean = st.var = 0.0;
+
+  for (i = 0; i < args->n; ++i) {
+    ewm_update(&st, args->p[i]);
+    if (st.count == 0)
+      args->out[i] = NAN;
+    else
+      args->out[i] = args->variance_p ? st.var : st.mean;
+  }
+
+  return NULL;
+}
+
+static VALUE
+ary_ewm(int argc, VALUE *argv, VALUE ary, int variance_p)
+{
+  struct ewm_args args;
+  VALUE kwargs, values, out, res;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  args.alpha = ewm_extract_alpha(kwargs);
+  args.variance_p = variance_p;
+
+  values = ary_rolling_values(ary);
+  args.p = DBL_BUFFER_PTR(values);
+  args.n = DBL_BUFFER_LEN(values);
+  out = dbl_buffer_new(args.n);
+  args.out = DBL_BUFFER_PTR(out);
+
+  call_without_gvl_if_large(ewm_series, &args, args.n);
+  res = dbl_buffer_to_ary(args.out, args.n);
+
+  RB_GC_GUARD(values);
+  RB_GC_GUARD(out);
+  return res;
+}
+
+/* call-seq:
+ *    ary.ewm_mean(alpha: nil, halflife: nil, span: nil) -> array
+ *    ary.ewm_mean(alpha: nil, halflife: nil, span: nil) { |x| ... } -> array
+ *
+ * Calculate the exponentially weighted moving means of the values in `ary`.
+ *
+ * The i-th element of the result is the mean after the i-th value is
+ * added.  The smoothing factor is specified by exactly one of `alpha:`,
+ * `halflife:`, and `span:`.  NA values are skipped, and the result is
+ * NaN until the first non-NA value appears.
+ *
+ * If a block is given, the values are the results of the block called
+ * with each element of `ary`.
+ *
+ * @param [Float] alpha  The smoothing factor in (0, 1].
+ * @param [Float] halflife  The number of values after which a weight
+ *   decays to the half, for `alpha = 1 - exp(-log(2) / halflife)`.
+ * @param [Float] span  The span for `alpha = 2 / (span + 1)`.
+ *
+ * @return [Array<Float>] The moving means
+ */
+static VALUE
+ary_ewm_mean(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_ewm(argc, argv, ary, 0);
+}
+
+/* call-seq:
+ *    ary.ewm_variance(alpha: nil, halflife: nil, span: nil) -> array
+ *    ary.ewm_variance(alpha: nil, halflife: nil, span: nil) { |x| ... } -> array
+ *
+ * Calculate the exponentially weighted moving variances of the values in
+ * `ary`.  See `ewm_mean` for the parameters.
+ *
+ * @return [Array<Float>] The moving variances
+ */
+static VALUE
+ary_ewm_variance(int argc, VALUE *argv, VALUE ary)
+{
+  return ary_ewm(argc, argv, ary, 1);
+}
+
+/* EnumerableStatistics::EWMAccumulator
+ *
+ * An accumulator of the exponentially weighted moving mean and variance
+ * that are updated by one value at a time. */
+
+static size_t
+ewm_accumulator_memsize(const void *ptr)
+{
+  return sizeof(struct ewm_state);
+}
+
+static const rb_data_type_t ewm_accumulator_type = {
+  "EnumerableStatistics::EWMAccumulator",
+  { NULL, RUBY_TYPED_DEFAULT_FREE, ewm_accumulator_memsize, },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static struct ewm_state *
+ewm_accumulator_get(VALUE obj)
+{
+  return (struct ewm_state *)rb_check_typeddata(obj, &ewm_accumulator_type);
+}
+
+static VALUE
+ewm_accumulator_alloc(VALUE klass)
+{
+  struct ewm_state *st;
+  VALUE obj = TypedData_Make_Struct(klass, struct ewm_state, &ewm_accumulator_type, st);
+  st->alpha = 1.0;
+  st->count = 0;
+  st->mean = st->var = 0.0;
+  return obj;
+}
+
+/* call-seq:
+ *    EWMAccumulator.new(alpha: nil, halflife: nil, span: nil)
+ *
+ * Create an accumulator with the smoothing factor specified in the same
+ * way as `Array#ewm_mean`.
+ */
+static VALUE
+ewm_accumulator_initialize(int argc, VALUE *argv, VALUE self)
+{
+  struct ewm_state *st = ewm_accumulator_get(self);
+  VALUE kwargs;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  st->alpha = ewm_extract_alpha(kwargs);
+  st->count = 0;
+  st->mean = st->var = 0.0;
+
+  return self;
+}
+
+/* call-seq:
+ *    acc.update(x) -> acc
+ *    acc << x -> acc
+ *
+ * Update the mean and the variance by the value x.  NA values are ignored.
+ */
+static VALUE
+ewm_accumulator_update(VALUE self, VALUE x)
+{
+  struct ewm_state *st = ewm_accumulator_get(self);
+
+  rb_check_frozen(self);
+  if (!is_na(x))
+    ewm_update(st, value_to_dbl(x));
+
+  return self;
+}
+
+/* call-seq:
+ *    acc.count -> integer
+ *
+ * @return [Integer] The number of the values added so far
+ */
+static VALUE
+ewm_accumulator_count(VALUE self)
+{
+  return LONG2NUM(ewm_accumulator_get(self)->count);
+}
+
+/* call-seq:
+ *    acc.alpha -> float
+ *
+ * @return [Float] The smoothing factor
+ */
+static VALUE
+ewm_accumulator_alpha(VALUE self)
+{
+  return DBL2NUM(ewm_accumulator_get(self)->alpha);
+}
+
+/* call-seq:
+ *    acc.mean -> float
+ *
+ * @return [Float] The current mean, or NaN if no value has been added
+ */
+static VALUE
+ewm_accumulator_mean(VALUE self)
+{
+  struct ewm_state *st = ewm_accumulator_get(self);
+  return DBL2NUM(st->count == 0 ? NAN : st->mean);
+}
+
+/* call-seq:
+ *    acc.variance -> float
+ *
+ * @return [Float] The current variance, or NaN if no value has been added
+ */
+static VALUE
+ewm_accumulator_variance(VALUE self)
+{
+  struct ewm_state *st = ewm_accumulator_get(self);
+  return DBL2NUM(st->count == 0 ? NAN : st->var);
+}
+
+/* call-seq:
+ *    acc.stdev -> float
+ *
+ * @return [Float] The current standard deviation
+ */
+static VALUE
+ewm_accumulator_stdev(VALUE self)
+{
+  struct ewm_state *st = ewm_accumulator_get(self);
+  return DBL2NUM(st->count == 0 ? NAN : sqrt(st->var));
+}
+
+static VALUE
+ewm_accumulator_init_copy(VALUE self, VALUE other)
+{
+  rb_obj_init_copy(self, other);
+  *ewm_accumulator_get(self) = *ewm_accumulator_get(other);
+  return self;
+}
+
+static long
+histogram_edge_bin_index(VALUE edge, VALUE rb_x, int left_p)
+{
+  double x, y;
+  long lo, hi, mid;
+
+  x = NUM2DBL(rb_x);
+
+  lo = -1;
+  hi = RARRAY_LEN(edge);
+
+  if (left_p) {
+    while (hi - lo > 1) {
+      mid = lo + (hi - lo)/2;
+      y = NUM2DBL(RARRAY_AREF(edge, mid));
+      if (y <= x) {
+        lo = mid;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+  else {
+    while (hi - lo > 1) {
+      mid = lo + (hi - lo)/2;
+      y = NUM2DBL(RARRAY_AREF(edge, mid));
+      if (y < x) {
+        lo = mid;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    return hi - 1;
+  }
+}
 
-mean_two:
-    a0 = rb_funcall(a0, idPLUS, 1, a1); /* TODO: optimize */
-    if (RB_INTEGER_TYPE_P(a0) || RB_FLOAT_TYPE_P(a0) || RB_TYPE_P(a0, T_RATIONAL)) {
-      double d = NUM2DBL(a0);
-      return DBL2NUM(d / 2.0);
+static long
+histogram_edge_bin_index_dbl(const double *edge, long n_edges, double x, int left_p)
+{
+  long lo, hi, mid;
+
+  lo = -1;
+  hi = n_edges;
+
+  if (left_p) {
+    while (hi - lo > 1) {
+      mid = lo + (hi - lo)/2;
+      if (edge[mid] <= x) {
+        lo = mid;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+  else {
+    while (hi - lo > 1) {
+      mid = lo + (hi - lo)/2;
+      if (edge[mid] < x) {
+        lo = mid;
+      }
+      else {
+        hi = mid;
+      }
     }
+    return hi - 1;
+  }
+}
 
-    return rb_funcall(a0, idDIV, 1, DBL2NUM(2.0));
+struct nogvl_histogram_args {
+  const double *p;
+  long n;
+  const double *edge;
+  long n_edges;
+  int left_p;
+  long *counts;
+};
+
+static void *
+nogvl_histogram(void *ptr)
+{
+  struct nogvl_histogram_args *args = (struct nogvl_histogram_args *)ptr;
+  long const n_bins = args->n_edges - 1;
+  long i;
+
+  for (i = 0; i < args->n; ++i) {
+    long const bi = histogram_edge_bin_index_dbl(args->edge, args->n_edges,
+                                                 args->p[i], args->left_p);
+    if (0 <= bi && bi < n_bins) {
+      ++args->counts[bi];
+    }
+  }
+  return NULL;
+}
+
+/* Count the n values in p for each bin without the GVL. */
+static void
+histogram_counts_push_buffer(VALUE bin_weights, VALUE edge, const double *p, long n, int left_p)
+{
+  struct nogvl_histogram_args args;
+  VALUE tmp;
+  double *edge_dbl;
+  long i;
+
+  args.n_edges = RARRAY_LEN(edge);
+  if (args.n_edges < 2)
+    return;
+
+  args.counts = (long *)ALLOCV(tmp, args.n_edges * (sizeof(double) + sizeof(long)));
+  edge_dbl = (double *)(args.counts + args.n_edges);
+  for (i = 0; i < args.n_edges; ++i) {
+    edge_dbl[i] = NUM2DBL(RARRAY_AREF(edge, i));
+    args.counts[i] = 0;
+  }
+
+  args.p = p;
+  args.n = n;
+  args.edge = edge_dbl;
+  args.left_p = left_p;
+  call_without_gvl(nogvl_histogram, &args);
+
+  for (i = 0; i < args.n_edges - 1; ++i) {
+    rb_ary_store(bin_weights, i, LONG2NUM(args.counts[i]));
+  }
+
+  ALLOCV_END(tmp);
+}
+
+static void
+histogram_weights_push_values(VALUE bin_weights, VALUE edge, VALUE values, VALUE weight_array, int left_p)
+{
+  const VALUE one = INT2FIX(1);
+  long bi, i, n, n_bins, weighted = 0;
+  VALUE x, cur;
+
+  assert(RB_TYPE_P(edge, T_ARRAY));
+  assert(RB_TYPE_P(values, T_ARRAY));
+
+  n = RARRAY_LEN(values);
+  n_bins = RARRAY_LEN(edge) - 1;
+
+  if (! NIL_P(weight_array)) {
+    assert(RB_TYPE_P(weight_array, T_ARRAY));
+    assert(RARRAY_LEN(weight_array) == n);
+    weighted = 1;
+  }
+
+  for (i = 0; i < n; ++i) {
+    x = RARRAY_AREF(values, i);
+
+    VALUE w;
+    if (weighted) {
+      w = RARRAY_AREF(weight_array, i);
+      if (RB_TYPE_P(w, T_COMPLEX)) {
+        VALUE imag = RCOMPLEX(w)->imag;
+        if (! RTEST(f_zero_p(imag))) {
+          goto type_error;
+        }
+      }
+      else if (rb_obj_is_kind_of(w, rb_cNumeric)) {
+        if (!RTEST(f_real_p(w))) {
+          goto type_error;
+        }
+      }
+      else {
+        goto type_error;
+      }
+    }
+    else {
+      w = one;
+    }
+
+    bi = histogram_edge_bin_index(edge, x, left_p);
+
+    if (0 <= bi && bi < n_bins) {
+      cur = rb_ary_entry(bin_weights, bi);
+      if (NIL_P(cur)) {
+        cur = w;
+      }
+      else {
+        cur = rb_funcall(cur, idPLUS, 1, w);
+      }
+
+      rb_ary_store(bin_weights, bi, cur);
+    }
+  }
+  return;
+
+type_error:
+      rb_raise(rb_eTypeError, "weight array must have only real numbers");
+}
+
+static inline long
+sturges(long n)
+{
+  if (n == 0) return 1L;
+  return (long)(ceil(log2(n)) + 1);
+}
+
+static VALUE
+ary_histogram_calculate_edge_lo_hi(const double lo, const double hi, const long nbins, const int left_p)
+{
+  VALUE edge;
+  double bw, lbw, start, step, divisor, r;
+  long i, len;
+
+  if (hi == lo) {
+    start = hi;
+    step = 1;
+    divisor = 1;
+    len = 1;
+  }
+  else {
+    bw = (hi - lo) / nbins;
+    lbw = log10(bw);
+    if (lbw >= 0) {
+      step = pow(10, floor(lbw));
+      r = bw / step;
+      if (r <= 1.1) {
+        /* do nothing */
+      }
+      else if (r <= 2.2) {
+        step *= 2;
+      }
+      else if (r <= 5.5) {
+        step *= 5;
+      }
+      else {
+        step *= 10;
+      }
+      divisor = 1.0;
+      start = step * floor(lo / step);
+      len = (long)ceil((hi - start) / step);
+    }
+    else {
+      divisor = pow(10, -floor(lbw));
+      r = bw * divisor;
+      if (r <= 1.1) {
+        /* do nothing */
+      }
+      else if (r <= 2.2) {
+        divisor /= 2;
+      }
+      else if (r <= 5.5) {
+        divisor /= 5;
+      }
+      else {
+        divisor /= 10;
+      }
+      step = 1.0;
+      start = floor(lo * divisor);
+      len = (long)ceil(hi * divisor - start);
+    }
+  }
+
+  if (left_p) {
+    while (lo < start/divisor) {
+      start -= step;
+    }
+    while ((start + (len - 1)*step)/divisor <= hi) {
+      ++len;
+    }
+  }
+  else {
+    while (lo <= start/divisor) {
+      start -= step;
+    }
+    while ((start + (len - 1)*step)/divisor < hi) {
+      ++len;
+    }
+  }
+
+  edge = rb_ary_new_capa(len);
+  for (i = 0; i < len; ++i) {
+    rb_ary_push(edge, DBL2NUM(start/divisor));
+    start += step;
+  }
+
+  return edge;
+}
+
+/* The number of bins for n values specified by arg0 */
+static long
+histogram_nbins(VALUE arg0, long n)
+{
+  long nbins;
+
+  if (NIL_P(arg0)) {
+    arg0 = sym_auto;
+  }
+
+  if (RB_TYPE_P(arg0, T_SYMBOL)) {
+    if (arg0 != sym_auto && arg0 != sym_sturges) {
+      rb_raise(rb_eArgError, "Unknown method to calculate bin width: %+"PRIsVALUE, arg0);
+    }
+    else {
+      nbins = sturges(n);
+    }
+  }
+  else {
+    nbins = NUM2LONG(arg0);
+  }
+
+  if (n == 0 && nbins < 0) {
+    rb_raise(rb_eArgError, "nbins must be >= 0 for an empty array, got %ld", nbins);
+  }
+  else if (n > 0 && nbins < 1) {
+    rb_raise(rb_eArgError, "nbins must be >= 1 for a non-empty array, got %ld", nbins);
   }
-}
 
-struct value_counts_opts {
-  int normalize_p;
-  int sort_p;
-  int ascending_p;
-  int dropna_p;
-};
+  return nbins;
+}
 
-static inline void
-value_counts_extract_opts(VALUE kwargs, struct value_counts_opts *opts)
+static VALUE
+ary_histogram_calculate_edge(VALUE ary, VALUE arg0, const int left_p)
 {
-  assert(opts != NULL);
+  long n, nbins;
+  VALUE minmax;
+  VALUE edge = Qnil;
+  double lo, hi;
 
-  /* default values */
-  opts->normalize_p = 0;
-  opts->sort_p = 1;
-  opts->ascending_p = 0;
-  opts->dropna_p = 1;
+  Check_Type(ary, T_ARRAY);
+  n = RARRAY_LEN(ary);
 
-  if (!NIL_P(kwargs)) {
-    enum { kw_normalize, kw_sort, kw_ascending, kw_dropna };
-    static ID kwarg_keys[4];
-    VALUE kwarg_vals[4];
+  nbins = histogram_nbins(arg0, n);
+  if (n == 0) {
+    edge = rb_ary_new_capa(1);
+    rb_ary_push(edge, DBL2NUM(0.0));
+    return edge;
+  }
 
-    if (!kwarg_keys[0]) {
-      kwarg_keys[kw_normalize] = rb_intern("normalize");
-      kwarg_keys[kw_sort]      = rb_intern("sort");
-      kwarg_keys[kw_ascending] = rb_intern("ascending");
-      kwarg_keys[kw_dropna]    = rb_intern("dropna");
-    }
+  minmax = rb_funcall(ary, rb_intern("minmax"), 0);
+  lo = NUM2DBL(RARRAY_AREF(minmax, 0));
+  hi = NUM2DBL(RARRAY_AREF(minmax, 1));
 
-    rb_get_kwargs(kwargs, kwarg_keys, 0, 4, kwarg_vals);
-    opts->normalize_p = (kwarg_vals[kw_normalize] != Qundef) && RTEST(kwarg_vals[kw_normalize]);
-    opts->sort_p      = (kwarg_vals[kw_sort]      != Qundef) && RTEST(kwarg_vals[kw_sort]);
-    opts->ascending_p = (kwarg_vals[kw_ascending] != Qundef) && RTEST(kwarg_vals[kw_ascending]);
-    opts->dropna_p    = (kwarg_vals[kw_dropna]    != Qundef) && RTEST(kwarg_vals[kw_dropna]);
-  }
+  edge = ary_histogram_calculate_edge_lo_hi(lo, hi, nbins, left_p);
+
+  return edge;
 }
 
-static int
-value_counts_result_to_assoc_array_i(VALUE key, VALUE val, VALUE ary)
+static VALUE
+check_histogram_edges(VALUE edges)
 {
-  VALUE assoc = rb_ary_tmp_new(2);
-  rb_ary_push(assoc, key);
-  rb_ary_push(assoc, val);
-  rb_ary_push(ary, assoc);
-  return ST_CONTINUE;
+  if (edges == Qundef) return Qnil;
+  return rb_check_convert_type(edges, T_ARRAY, "Array", "to_ary");
 }
 
 static int
-value_counts_sort_cmp_asc(const void *ap, const void *bp, void *dummy)
+check_histogram_left_p(VALUE closed)
 {
-  VALUE a = *(const VALUE *)ap, b = *(const VALUE *)bp;
-  VALUE av, bv, cmp;
-
-  av = RARRAY_AREF(a, 1);
-  bv = RARRAY_AREF(b, 1);
-
-  /* TODO: optimize */
-  cmp = rb_funcall(av, id_cmp, 1, bv);
-  return rb_cmpint(cmp, av, bv);
+  int left_p = (closed != sym_right);
+  if (left_p && closed != Qundef && closed != sym_left) {
+    rb_raise(rb_eArgError, "invalid value for :closed keyword "
+        "(%"PRIsVALUE" for :left or :right)", closed);
+  }
+  return left_p;
 }
 
-static int
-value_counts_sort_cmp_desc(const void *ap, const void *bp, void *dummy)
+/* call-seq:
+ *    ary.histogram(nbins=:auto, weight: nil, closed: :left, key: nil, index: nil)
+ *
+ * @param [Integer] nbins  The approximate number of bins
+ * @params [Array<Numeric>] weights
+ *   An optional weight array, that has the same length as the receiver.
+ *   `weight[i]` means the weight value of the i-th element in the receiver.
+ * @params [Array<Numeric>] edges
+ *   An optional edge array, that specify the bin edges.
+ *   This array must be sorted.
+ * @param [:left, :right] closed
+ *   If :left (the default), the bin interval are left-closed.
+ *   If :right, the bin interval are right-closed.
+ * @param [Object] key  Use the values of `row[key]` of the rows in the receiver.
+ * @param [Integer] index  Use the values of `row[index]` of the rows in the receiver.
+ *
+ * @return [EnumerableStatistics::Histogram] The histogram struct.
+ */
+static VALUE
+ary_histogram(int argc, VALUE *argv, VALUE ary)
 {
-  VALUE a = *(const VALUE *)ap, b = *(const VALUE *)bp;
-  VALUE av, bv, cmp;
+  VALUE arg0, kwargs, bin_weights;
+  long n_bin_weights, i;
 
-  av = RARRAY_AREF(a, 1);
-  bv = RARRAY_AREF(b, 1);
+  VALUE weight_array = Qnil;
+  VALUE edges = Qnil;
+  int left_p = 1;
 
-  /* TODO: optimize */
-  cmp = rb_funcall(bv, id_cmp, 1, av);
-  return rb_cmpint(cmp, bv, av);
-}
+  rb_scan_args(argc, argv, "01:", &arg0, &kwargs);
+  ary = ary_extract_field(ary, &kwargs);
 
-static VALUE
-value_counts_sort_result(VALUE result, const int dropna_p, const int ascending_p)
-{
-  VALUE na_count = Qundef, ary, sorted;
-  long i;
+  if (!NIL_P(kwargs)) {
+    enum { kw_weights, kw_edges, kw_closed };
+    ID kwarg_keys[3];
+    VALUE kwarg_vals[3];
 
-  if (RHASH_SIZE(result) < 1) {
-    return result;
-  }
+    kwarg_keys[kw_weights] = id_weights;
+    kwarg_keys[kw_edges]   = id_edges;
+    kwarg_keys[kw_closed]  = id_closed;
 
-  if (!dropna_p) {
-    na_count = rb_hash_lookup2(result, Qnil, Qundef);
-    if (na_count != Qundef) {
-      rb_hash_delete(result, Qnil);
-    }
+    rb_get_kwargs(kwargs, kwarg_keys, 0, 3, kwarg_vals);
+
+    weight_array = check_weight_array(kwarg_vals[kw_weights], RARRAY_LEN(ary));
+    edges = check_histogram_edges(kwarg_vals[kw_edges]);
+    left_p = check_histogram_left_p(kwarg_vals[kw_closed]);
   }
 
-  const long len = (long)RHASH_SIZE(result);
-  ary = rb_ary_tmp_new(len);
-  rb_hash_foreach(result, value_counts_result_to_assoc_array_i, ary);
-  if (ascending_p) {
-    RARRAY_PTR_USE(ary, ptr, {
-      ruby_qsort(ptr, RARRAY_LEN(ary), sizeof(VALUE),
-                 value_counts_sort_cmp_asc, NULL);
-    });
+  if (NIL_P(edges)) {
+    edges = ary_histogram_calculate_edge(ary, arg0, left_p);
   }
-  else {
-    RARRAY_PTR_USE(ary, ptr, {
-      ruby_qsort(ptr, RARRAY_LEN(ary), sizeof(VALUE),
-                 value_counts_sort_cmp_desc, NULL);
-    });
+  else if (! NIL_P(arg0)) {
+    rb_raise(rb_eArgError, "Unable to use both `nbins` and `edges` together");
   }
 
-#ifdef HAVE_RB_HASH_NEW_WITH_SIZE
-  sorted = rb_hash_new_with_size(len);
-#else
-  sorted = rb_hash_new();
-#endif
-
-  if (na_count != Qundef && ascending_p) {
-    rb_hash_aset(sorted, Qnil, na_count);
+  n_bin_weights = RARRAY_LEN(edges) - 1;
+  bin_weights = rb_ary_new_capa(n_bin_weights);
+  for (i = 0; i < n_bin_weights; ++i) {
+    rb_ary_store(bin_weights, i, INT2FIX(0));
   }
 
-  for (i = 0; i < len; ++i) {
-    VALUE a = RARRAY_AREF(ary, i);
-    VALUE k = RARRAY_AREF(a, 0);
-    VALUE v = RARRAY_AREF(a, 1);
-    rb_hash_aset(sorted, k, v);
+  if (NIL_P(weight_array)) {
+    int const flags = NUMERIC_SNAPSHOT_FIXNUM | NUMERIC_SNAPSHOT_NAN;
+    VALUE buf = ary_numeric_snapshot(ary, flags);
+    if (!NIL_P(buf)) {
+      histogram_counts_push_buffer(bin_weights, edges,
+                                   DBL_BUFFER_PTR(buf), DBL_BUFFER_LEN(buf), left_p);
+      RB_GC_GUARD(buf);
+      goto finish;
+    }
   }
 
-  if (na_count != Qundef && !ascending_p) {
-    rb_hash_aset(sorted, Qnil, na_count);
-  }
+  histogram_weights_push_values(bin_weights, edges, ary, weight_array, left_p);
 
-  return sorted;
+finish:
+  return rb_struct_new(cHistogram, edges, bin_weights,
+                       left_p ? sym_left : sym_right,
+                       Qfalse);
 }
 
-struct value_counts_normalize_params {
-  VALUE result;
-  long total;
+/* EnumerableStatistics::NumericBuffer
+ *
+ * A frozen buffer of native double values.  It is shareable among Ractors,
+ * so the values can be passed to other Ractors without copying them.
+ * It can have a validity bitmap, whose invalid slots are NA values. */
+
+struct numeric_buffer {
+  VALUE owner;  /* the buffer owning ptr, or nil if this buffer owns it */
+  double *ptr;
+  long len;
+  uint64_t *validity;    /* the bitmap of the owner, or NULL */
+  long validity_offset;  /* the bit offset of ptr[0] in validity */
 };
 
-static int
-value_counts_normalize_i(VALUE key, VALUE val, VALUE arg)
+static void
+numeric_buffer_mark(void *ptr)
 {
-  struct value_counts_normalize_params *params = (struct value_counts_normalize_params *)arg;
-  double new_val;
+  struct numeric_buffer *nb = (struct numeric_buffer *)ptr;
+  rb_gc_mark(nb->owner);
+}
 
-  new_val = NUM2DBL(val) / params->total;
-  rb_hash_aset(params->result, key, DBL2NUM(new_val));
+static void
+numeric_buffer_free(void *ptr)
+{
+  struct numeric_buffer *nb = (struct numeric_buffer *)ptr;
+  if (NIL_P(nb->owner)) {
+    ruby_xfree(nb->ptr);
+    ruby_xfree(nb->validity);
+  }
+  ruby_xfree(nb);
+}
 
-  return ST_CONTINUE;
+static size_t
+numeric_buffer_memsize(const void *ptr)
+{
+  const struct numeric_buffer *nb = (const struct numeric_buffer *)ptr;
+  size_t size = sizeof(*nb);
+  if (NIL_P(nb->owner)) {
+    size += nb->len * sizeof(double);
+    if (nb->validity)
+      size += (nb->len + 63) / 64 * sizeof(uint64_t);
+  }
+  return size;
 }
 
-struct value_counts_memo {
-  int dropna_p;
-  long total;
-  long na_count;
-  VALUE result;
+#ifndef RUBY_TYPED_FROZEN_SHAREABLE
+# define RUBY_TYPED_FROZEN_SHAREABLE 0
+#endif
+
+static const rb_data_type_t numeric_buffer_type = {
+  "EnumerableStatistics::NumericBuffer",
+  { numeric_buffer_mark, numeric_buffer_free, numeric_buffer_memsize, },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
 };
 
+static struct numeric_buffer *
+numeric_buffer_get(VALUE obj)
+{
+  return (struct numeric_buffer *)rb_check_typeddata(obj, &numeric_buffer_type);
+}
+
 static VALUE
-any_value_counts(int argc, VALUE *argv, VALUE obj,
-                 void (* counter)(VALUE, struct value_counts_memo *))
+numeric_buffer_alloc(VALUE klass, struct numeric_buffer **nb_ptr)
 {
-  VALUE kwargs;
-  struct value_counts_opts opts;
-  struct value_counts_memo memo;
+  struct numeric_buffer *nb;
+  VALUE obj = TypedData_Make_Struct(klass, struct numeric_buffer,
+                                    &numeric_buffer_type, nb);
+  nb->owner = Qnil;
+  nb->ptr = NULL;
+  nb->len = 0;
+  nb->validity = NULL;
+  nb->validity_offset = 0;
+  *nb_ptr = nb;
+  return obj;
+}
 
-  rb_scan_args(argc, argv, "0:", &kwargs);
-  value_counts_extract_opts(kwargs, &opts);
+/* Call func with arg without the GVL if the buffer of n values is long
+ * enough, or simply call it otherwise. */
+static void
+numeric_buffer_call(void *(*func)(void *), void *arg, long n)
+{
+  call_without_gvl_if_large(func, arg, n);
+}
 
-  memo.result = rb_hash_new();
-  memo.total = 0;
-  memo.na_count = 0;
-  memo.dropna_p = opts.dropna_p;
+static inline int
+numeric_buffer_valid_p(const struct numeric_buffer *nb, long i)
+{
+  long const b = nb->validity_offset + i;
+  return nb->validity == NULL || ((nb->validity[b / 64] >> (b % 64)) & 1);
+}
 
-  if (!opts.dropna_p) {
-    rb_hash_aset(memo.result, Qnil, INT2FIX(0)); // reserve the room for NA
-  }
+/* Copy the values into a native buffer that can be reordered.
+ * This returns nil if any value is NaN or invalid. */
+static VALUE
+numeric_buffer_copy(const struct numeric_buffer *nb)
+{
+  VALUE buf = dbl_buffer_new(nb->len);
+  double *p = DBL_BUFFER_PTR(buf);
+  long i, pos = 0, start, end;
 
-  counter(obj, &memo);
+  if (nb->validity != NULL) {
+    if (!validity_next_run(nb->validity, nb->validity_offset, nb->len, &pos, &start, &end))
+      return nb->len == 0 ? buf : Qnil;
+    if (start != 0 || end != nb->len)
+      return Qnil;
+  }
 
-  if (!opts.dropna_p) {
-    if (memo.na_count == 0)
-      rb_hash_delete(memo.result, Qnil);
-    else
-      rb_hash_aset(memo.result, Qnil, LONG2NUM(memo.na_count));
+  for (i = 0; i < nb->len; ++i) {
+    if (isnan(nb->ptr[i]))
+      return Qnil;
+    p[i] = nb->ptr[i];
   }
+  rb_str_set_len(buf, nb->len * (long)sizeof(double));
 
-  if (opts.sort_p) {
-    memo.result = value_counts_sort_result(memo.result, opts.dropna_p, opts.ascending_p);
+  return buf;
+}
+
+/* Copy the values in the valid slots into a native buffer. */
+static VALUE
+numeric_buffer_valid_values(const struct numeric_buffer *nb)
+{
+  VALUE buf = dbl_buffer_new(nb->len);
+  double *p = DBL_BUFFER_PTR(buf);
+  long n = 0, pos = 0, start, end;
+
+  while (validity_next_run(nb->validity, nb->validity_offset, nb->len, &pos, &start, &end)) {
+    memcpy(p + n, nb->ptr + start, (end - start) * sizeof(double));
+    n += end - start;
   }
+  rb_str_set_len(buf, n * (long)sizeof(double));
 
-  if (opts.normalize_p) {
-    struct value_counts_normalize_params params;
-    params.result = memo.result;
-    params.total = memo.total - (opts.dropna_p ? memo.na_count : 0);
-    rb_hash_foreach(memo.result, value_counts_normalize_i, (VALUE)&params);
+  return buf;
+}
+
+/* Pack the validity bitmap given as a String, in which the bit of the i-th
+ * slot is bit (i % 8) of byte (i / 8), into words. */
+static uint64_t *
+validity_from_str(VALUE str, long n)
+{
+  long const nbytes = (n + 7) / 8, nwords = (n + 63) / 64;
+  const unsigned char *s;
+  uint64_t *words;
+  long i;
+
+  StringValue(str);
+  if (RSTRING_LEN(str) < nbytes) {
+    rb_raise(rb_eArgError, "validity bitmap too short (%ld bytes for %ld values)",
+             RSTRING_LEN(str), n);
   }
 
-  return memo.result;
+  s = (const unsigned char *)RSTRING_PTR(str);
+  words = ALLOC_N(uint64_t, nwords > 0 ? nwords : 1);
+  for (i = 0; i < nwords; ++i)
+    words[i] = 0;
+  for (i = 0; i < nbytes; ++i)
+    words[i / 8] |= (uint64_t)s[i] << (i % 8 * 8);
+  if (n % 64 != 0)
+    words[nwords - 1] &= ((uint64_t)1 << (n % 64)) - 1;
+
+  return words;
 }
 
+/* call-seq:
+ *    EnumerableStatistics::NumericBuffer.new(values, validity: nil) -> buffer
+ *
+ * Create a frozen buffer of the values converted to Float.
+ * `nil` in `values` is stored as NaN, so that it can be skipped by
+ * the `skip_na:` keyword parameter.
+ *
+ * `validity:` is a String of a bitmap in the layout of Apache Arrow, whose
+ * bit (i % 8) of byte (i / 8) is 0 if the i-th value is NA.  The NA values
+ * are treated as `nil`, without testing the values in the valid slots,
+ * and the statistics skip them a 64-bit word at a time.
+ *
+ * The buffer is shareable, so it can be passed to other Ractors by
+ * reference:
+ *
+ * ```ruby
+ * buf = EnumerableStatistics::NumericBuffer.new(values)
+ * rs = 4.times.map do |i|
+ *   Ractor.new(buf.slice(i * buf.size / 4, buf.size / 4)) do |shard|
+ *     shard.mean_variance
+ *   end
+ * end
+ * rs.map(&:take)
+ * ```
+ *
+ * @param [Array<Numeric>] values
+ *
+ * @return [EnumerableStatistics::NumericBuffer] A new buffer
+ */
 static VALUE
-enum_value_counts_without_sort_i(RB_BLOCK_CALL_FUNC_ARGLIST(e, args))
+numeric_buffer_s_new(int argc, VALUE *argv, VALUE klass)
 {
-  struct value_counts_memo *memo = (struct value_counts_memo *)args;
+  struct numeric_buffer *nb;
+  VALUE obj, values, opts, validity = Qundef;
+  long n, i;
 
-  ENUM_WANT_SVALUE();
+  rb_scan_args(argc, argv, "1:", &values, &opts);
+  if (!NIL_P(opts))
+    rb_get_kwargs(opts, &id_validity, 0, 1, &validity);
 
-  if (is_na(e)) {
-    ++memo->na_count;
-  }
-  else {
-    VALUE cnt = rb_hash_lookup2(memo->result, e, INT2FIX(0));
-    rb_hash_aset(memo->result, e, rb_int_plus(cnt, INT2FIX(1)));
-  }
+  values = rb_convert_type(values, T_ARRAY, "Array", "to_ary");
+  n = RARRAY_LEN(values);
 
-  ++memo->total;
+  obj = numeric_buffer_alloc(klass, &nb);
+  if (validity != Qundef && !NIL_P(validity))
+    nb->validity = validity_from_str(validity, n);
+  nb->ptr = ALLOC_N(double, n > 0 ? n : 1);
+  for (i = 0; i < n && i < RARRAY_LEN(values); ++i) {
+    VALUE const e = RARRAY_AREF(values, i);
+    if (!numeric_buffer_valid_p(nb, i))
+      nb->ptr[i] = NAN;
+    else if (RB_FLOAT_TYPE_P(e))
+      nb->ptr[i] = RFLOAT_VALUE(e);
+    else if (FIXNUM_P(e))
+      nb->ptr[i] = FIX2LONG(e);
+    else if (NIL_P(e))
+      nb->ptr[i] = NAN;
+    else
+      nb->ptr[i] = NUM2DBL(e);
+    nb->len = i + 1;
+  }
 
-  return Qnil;
+  return rb_obj_freeze(obj);
 }
 
-static void
-enum_value_counts_without_sort(VALUE obj, struct value_counts_memo *memo)
+/* call-seq:
+ *    buf.size -> integer
+ *
+ * @return [Integer] The number of values in `buf`
+ */
+static VALUE
+numeric_buffer_size(VALUE self)
 {
-  rb_block_call(obj, id_each, 0, 0, enum_value_counts_without_sort_i, (VALUE)memo);
+  return LONG2NUM(numeric_buffer_get(self)->len);
 }
 
+/* call-seq:
+ *    buf[index] -> float or nil
+ *
+ * @return [Float, nil] The value at `index`, or `nil` if `index` is out of range
+ *   or the slot is invalid
+ */
 static VALUE
-enum_value_counts(int argc, VALUE* argv, VALUE obj)
+numeric_buffer_aref(VALUE self, VALUE index)
 {
-  return any_value_counts(argc, argv, obj, enum_value_counts_without_sort);
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  long i = NUM2LONG(index);
+
+  if (i < 0)
+    i += nb->len;
+  if (i < 0 || nb->len <= i || !numeric_buffer_valid_p(nb, i))
+    return Qnil;
+  return DBL2NUM(nb->ptr[i]);
 }
 
-static void
-ary_value_counts_without_sort(VALUE ary, struct value_counts_memo *memo)
+/* call-seq:
+ *    buf.slice(start, length) -> buffer
+ *
+ * Return a buffer of at most `length` values from `start`.
+ * The values are shared with `buf` without copying.
+ * The result is an instance of the class of `buf`.
+ *
+ * @return [EnumerableStatistics::NumericBuffer] A slice of `buf`
+ */
+static VALUE
+numeric_buffer_slice(VALUE self, VALUE start, VALUE length)
 {
-  const VALUE zero = INT2FIX(0);
-  const VALUE one = INT2FIX(1);
-  long i, na_count = 0;
-  long const n = RARRAY_LEN(ary);
-
-  for (i = 0; i < n; ++i) {
-    VALUE val = RARRAY_AREF(ary, i);
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  struct numeric_buffer *slice;
+  long beg = NUM2LONG(start), len = NUM2LONG(length);
+  VALUE obj;
+
+  if (beg < 0)
+    beg += nb->len;
+  if (beg < 0 || nb->len < beg) {
+    rb_raise(rb_eIndexError, "index %ld out of buffer", NUM2LONG(start));
+  }
+  if (len < 0) {
+    rb_raise(rb_eArgError, "negative length (%ld)", len);
+  }
+  if (len > nb->len - beg)
+    len = nb->len - beg;
+
+  obj = numeric_buffer_alloc(rb_obj_class(self), &slice);
+  slice->owner = NIL_P(nb->owner) ? self : nb->owner;
+  slice->ptr = nb->ptr + beg;
+  slice->len = len;
+  slice->validity = nb->validity;
+  slice->validity_offset = nb->validity_offset + beg;
+
+  return rb_obj_freeze(obj);
+}
 
-    if (is_na(val)) {
-      ++na_count;
-    }
-    else {
-      VALUE cnt = rb_hash_lookup2(memo->result, val, zero);
-      rb_hash_aset(memo->result, val, rb_int_plus(cnt, one));
-    }
-  }
+/* call-seq:
+ *    buf.to_a -> array
+ *
+ * @return [Array<Float, nil>] The values in `buf`, where the invalid slots are `nil`
+ */
+static VALUE
+numeric_buffer_to_a(VALUE self)
+{
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  VALUE ary = rb_ary_new_capa(nb->len);
+  long i;
 
-  memo->total = n;
-  memo->na_count = na_count;
+  for (i = 0; i < nb->len; ++i)
+    rb_ary_push(ary, numeric_buffer_valid_p(nb, i) ? DBL2NUM(nb->ptr[i]) : Qnil);
+  return ary;
 }
 
 /* call-seq:
- *    ary.value_counts(normalize: false, sort: true, ascending: false, dropna: true) -> hash
- *
- * Returns a hash that contains the counts of values in `ary`.
- *
- * This method treats `nil` and NaN, the objects who respond `true` to `nan?`,
- * as the same thing, and stores the count of them as the value for `nil`.
+ *    buf.sum(skip_na: false) -> float
  *
- * @param [false,true] normalize  If `true`, the result contains the relative
- *                                frequencies of the unique values.
- * @param [true,false] sort  Sort by values.
- * @param [false,true] ascending  Sort in ascending order.
- * @param [true,false] dropna  Don't include counts of NAs.
+ * Calculate the sum of the values in `buf` by Kahan's algorithm.
  *
- * @return [Hash] A hash consists of the counts of the values
+ * @return [Float] A summation value
  */
 static VALUE
-ary_value_counts(int argc, VALUE* argv, VALUE ary)
+numeric_buffer_sum(int argc, VALUE *argv, VALUE self)
 {
-  return any_value_counts(argc, argv, ary, ary_value_counts_without_sort);
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  struct nogvl_sum_args args;
+  VALUE opts;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+
+  args.p = nb->ptr;
+  args.n = nb->len;
+  args.nchunks = parallel_chunk_count(nb->len);
+  args.validity = nb->validity;
+  args.validity_offset = nb->validity_offset;
+  args.skip_na = opt_skip_na(opts);
+  args.f = args.c = 0.0;
+  numeric_buffer_call(nogvl_sum, &args, nb->len);
+  RB_GC_GUARD(self);
+
+  return DBL2NUM(args.f);
 }
 
-static int
-hash_value_counts_without_sort_i(VALUE key, VALUE val, VALUE arg)
+static void
+numeric_buffer_moments(VALUE self, struct enum_mean_variance_memo *memo)
 {
-  struct value_counts_memo *memo = (struct value_counts_memo *)arg;
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  struct nogvl_moments_args args;
+
+  args.p = nb->ptr;
+  args.n = nb->len;
+  args.nchunks = parallel_chunk_count(nb->len);
+  args.validity = nb->validity;
+  args.validity_offset = nb->validity_offset;
+  args.memo = memo;
+  numeric_buffer_call(nogvl_moments, &args, nb->len);
+  RB_GC_GUARD(self);
+}
 
-  if (is_na(val)) {
-    ++memo->na_count;
+static void
+numeric_buffer_mean_variance(int argc, VALUE *argv, VALUE self, VALUE *mean_ptr, VALUE *variance_ptr)
+{
+  struct enum_mean_variance_memo memo;
+  struct variance_opts options;
+  VALUE opts;
+  size_t ddof;
 
-    if (memo->dropna_p) {
-      return ST_CONTINUE;
-    }
-  }
-  else {
-    VALUE cnt = rb_hash_lookup2(memo->result, val, INT2FIX(0));
-    rb_hash_aset(memo->result, val, rb_int_plus(cnt, INT2FIX(1)));
-  }
+  rb_scan_args(argc, argv, "0:", &opts);
+  get_variance_opts(opts, &options);
+  ddof = options.population ? 0 : 1;
 
-  return ST_CONTINUE;
+  mean_variance_memo_init(&memo, 2, options.skip_na);
+  numeric_buffer_moments(self, &memo);
+
+  SET_MEAN(DBL2NUM(memo.n > 0 ? memo.f / memo.n : 0.0));
+  SET_VARIANCE(DBL2NUM(memo.n >= 2 ? memo.m2 / (memo.n - ddof) : NAN));
 }
 
-static void
-hash_value_counts_without_sort(VALUE hash, struct value_counts_memo *memo)
+/* call-seq:
+ *    buf.mean(skip_na: false) -> float
+ *
+ * @return [Float] A mean value of the values in `buf`
+ */
+static VALUE
+numeric_buffer_mean(int argc, VALUE *argv, VALUE self)
 {
-  rb_hash_foreach(hash, hash_value_counts_without_sort_i, (VALUE)memo);
-  memo->total = RHASH_SIZE(hash);
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  struct nogvl_sum_args args;
+  VALUE opts;
+  long n;
+
+  rb_scan_args(argc, argv, "0:", &opts);
+
+  args.p = nb->ptr;
+  args.n = nb->len;
+  args.nchunks = parallel_chunk_count(nb->len);
+  args.validity = nb->validity;
+  args.validity_offset = nb->validity_offset;
+  args.skip_na = opt_skip_na(opts);
+  args.f = args.c = 0.0;
+  args.na_count = 0;
+  numeric_buffer_call(nogvl_sum, &args, nb->len);
+  RB_GC_GUARD(self);
+
+  n = nb->len - args.na_count;
+  return DBL2NUM(n > 0 ? args.f / n : 0.0);
 }
 
 /* call-seq:
- *    hash.value_counts(normalize: false, sort: true, ascending: false, dropna: true) -> hash
- *
- * Returns a hash that contains the counts of values in `hash`.
+ *    buf.variance(population: false, skip_na: false) -> float
  *
- * This method treats `nil` and NaN, the objects who respond `true` to `nan?`,
- * as the same thing, and stores the count of them as the value for `nil`.
+ * @return [Float] A variance of the values in `buf`
+ */
+static VALUE
+numeric_buffer_variance(int argc, VALUE *argv, VALUE self)
+{
+  VALUE variance;
+  numeric_buffer_mean_variance(argc, argv, self, NULL, &variance);
+  return variance;
+}
+
+/* call-seq:
+ *    buf.stdev(population: false, skip_na: false) -> float
  *
- * @param [false,true] normalize  If `true`, the result contains the relative
- *                                frequencies of the unique values.
- * @param [true,false] sort  Sort by values.
- * @param [false,true] ascending  Sort in ascending order.
- * @param [true,false] dropna  Don't include counts of NAs.
+ * @return [Float] A standard deviation of the values in `buf`
+ */
+static VALUE
+numeric_buffer_stdev(int argc, VALUE *argv, VALUE self)
+{
+  VALUE variance;
+  numeric_buffer_mean_variance(argc, argv, self, NULL, &variance);
+  return sqrt_value(variance);
+}
+
+/* call-seq:
+ *    buf.mean_variance(population: false, skip_na: false) -> [mean, variance]
  *
- * @return [Hash] A hash consists of the counts of the values
+ * @return [Array<Float>] A mean and a variance of the values in `buf`
  */
 static VALUE
-hash_value_counts(int argc, VALUE* argv, VALUE hash)
+numeric_buffer_mean_variance_m(int argc, VALUE *argv, VALUE self)
 {
-  return any_value_counts(argc, argv, hash, hash_value_counts_without_sort);
+  VALUE mean, variance;
+  numeric_buffer_mean_variance(argc, argv, self, &mean, &variance);
+  return rb_assoc_new(mean, variance);
 }
 
-static long
-histogram_edge_bin_index(VALUE edge, VALUE rb_x, int left_p)
+/* call-seq:
+ *    buf.median -> float
+ *
+ * @return [Float] A median of the values in `buf`, or NaN if any of them is NaN
+ */
+static VALUE
+numeric_buffer_median(VALUE self)
 {
-  double x, y;
-  long lo, hi, mid;
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  VALUE buf;
 
-  x = NUM2DBL(rb_x);
+  if (nb->len == 0)
+    return DBL2NUM(NAN);
 
-  lo = -1;
-  hi = RARRAY_LEN(edge);
+  buf = numeric_buffer_copy(nb);
+  if (NIL_P(buf))
+    return DBL2NUM(NAN);
+  return dbl_buffer_median(buf);
+}
 
-  if (left_p) {
-    while (hi - lo > 1) {
-      mid = lo + (hi - lo)/2;
-      y = NUM2DBL(RARRAY_AREF(edge, mid));
-      if (y <= x) {
-        lo = mid;
-      }
-      else {
-        hi = mid;
-      }
-    }
-    return lo;
+/* call-seq:
+ *    buf.percentile(q) -> float or array
+ *
+ * @param [Number, Array] percentile or array of percentiles to compute,
+ *   which must be between 0 and 100 inclusive.
+ *
+ * @return [Float, Array] A percentile value(s), which are NaN if any value in `buf` is NaN
+ */
+static VALUE
+numeric_buffer_percentile(VALUE self, VALUE q)
+{
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  VALUE buf;
+
+  if (nb->len == 0) {
+    rb_raise(rb_eArgError, "unable to compute percentile(s) for an empty buffer");
   }
-  else {
-    while (hi - lo > 1) {
-      mid = lo + (hi - lo)/2;
-      y = NUM2DBL(RARRAY_AREF(edge, mid));
-      if (y < x) {
-        lo = mid;
-      }
-      else {
-        hi = mid;
-      }
-    }
-    return hi - 1;
+
+  buf = numeric_buffer_copy(nb);
+  if (NIL_P(buf)) {
+    /* all the percentiles are NaN, as the ones of a single NaN */
+    buf = dbl_buffer_new(1);
+    dbl_buffer_push(buf, NAN);
   }
+  return dbl_buffer_percentile(buf, q);
 }
 
-static void
-histogram_weights_push_values(VALUE bin_weights, VALUE edge, VALUE values, VALUE weight_array, int left_p)
+/* call-seq:
+ *    buf.histogram(nbins=:auto, edges: nil, closed: :left)
+ *
+ * Calculate a histogram of the values in `buf` in the same way as
+ * `Array#histogram`.  NaN values are not counted in any bin.
+ *
+ * @return [EnumerableStatistics::Histogram] The histogram struct.
+ */
+static VALUE
+numeric_buffer_histogram(int argc, VALUE *argv, VALUE self)
 {
-  const VALUE one = INT2FIX(1);
-  long bi, i, n, n_bins, weighted = 0;
-  VALUE x, cur;
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  VALUE arg0, kwargs, edges = Qnil, bin_weights, buf = Qnil;
+  const double *p = nb->ptr;
+  long n = nb->len, n_bin_weights, i;
+  int left_p = 1;
 
-  assert(RB_TYPE_P(edge, T_ARRAY));
-  assert(RB_TYPE_P(values, T_ARRAY));
+  rb_scan_args(argc, argv, "01:", &arg0, &kwargs);
 
-  n = RARRAY_LEN(values);
-  n_bins = RARRAY_LEN(edge) - 1;
+  if (!NIL_P(kwargs)) {
+    enum { kw_edges, kw_closed };
+    ID kwarg_keys[2];
+    VALUE kwarg_vals[2];
 
-  if (! NIL_P(weight_array)) {
-    assert(RB_TYPE_P(weight_array, T_ARRAY));
-    assert(RARRAY_LEN(weight_array) == n);
-    weighted = 1;
+    kwarg_keys[kw_edges]  = id_edges;
+    kwarg_keys[kw_closed] = id_closed;
+
+    rb_get_kwargs(kwargs, kwarg_keys, 0, 2, kwarg_vals);
+
+    edges = check_histogram_edges(kwarg_vals[kw_edges]);
+    left_p = check_histogram_left_p(kwarg_vals[kw_closed]);
   }
 
-  for (i = 0; i < n; ++i) {
-    x = RARRAY_AREF(values, i);
+  if (nb->validity != NULL) {
+    buf = numeric_buffer_valid_values(nb);
+    p = DBL_BUFFER_PTR(buf);
+    n = DBL_BUFFER_LEN(buf);
+  }
 
-    VALUE w;
-    if (weighted) {
-      w = RARRAY_AREF(weight_array, i);
-      if (RB_TYPE_P(w, T_COMPLEX)) {
-        VALUE imag = RCOMPLEX(w)->imag;
-        if (! RTEST(f_zero_p(imag))) {
-          goto type_error;
-        }
-      }
-      else if (rb_obj_is_kind_of(w, rb_cNumeric)) {
-        if (!RTEST(f_real_p(w))) {
-          goto type_error;
-        }
-      }
-      else {
-        goto type_error;
-      }
+  if (NIL_P(edges)) {
+    long const nbins = histogram_nbins(arg0, n);
+    double lo = NAN, hi = NAN;
+
+    for (i = 0; i < n; ++i) {
+      double const x = p[i];
+      if (isnan(x))
+        continue;
+      if (isnan(lo) || x < lo)
+        lo = x;
+      if (isnan(hi) || x > hi)
+        hi = x;
+    }
+
+    if (isnan(lo)) {
+      edges = rb_ary_new_capa(1);
+      rb_ary_push(edges, DBL2NUM(0.0));
     }
     else {
-      w = one;
+      edges = ary_histogram_calculate_edge_lo_hi(lo, hi, nbins, left_p);
     }
+  }
+  else if (! NIL_P(arg0)) {
+    rb_raise(rb_eArgError, "Unable to use both `nbins` and `edges` together");
+  }
+
+  n_bin_weights = RARRAY_LEN(edges) - 1;
+  bin_weights = rb_ary_new_capa(n_bin_weights);
+  for (i = 0; i < n_bin_weights; ++i) {
+    rb_ary_store(bin_weights, i, INT2FIX(0));
+  }
+
+  histogram_counts_push_buffer(bin_weights, edges, p, n, left_p);
+  RB_GC_GUARD(self);
+  RB_GC_GUARD(buf);
+
+  return rb_struct_new(cHistogram, edges, bin_weights,
+                       left_p ? sym_left : sym_right,
+                       Qfalse);
+}
+
+static void
+numeric_buffer_value_counts_without_sort(VALUE self, struct value_counts_memo *memo)
+{
+  const struct numeric_buffer *nb = numeric_buffer_get(self);
+  const VALUE zero = INT2FIX(0);
+  const VALUE one = INT2FIX(1);
+  long i, pos = 0, start, end, valid = 0;
 
-    bi = histogram_edge_bin_index(edge, x, left_p);
+  while (validity_next_run(nb->validity, nb->validity_offset, nb->len, &pos, &start, &end)) {
+    for (i = start; i < end; ++i) {
+      double const x = nb->ptr[i];
 
-    if (0 <= bi && bi < n_bins) {
-      cur = rb_ary_entry(bin_weights, bi);
-      if (NIL_P(cur)) {
-        cur = w;
+      if (isnan(x)) {
+        ++memo->na_count;
       }
       else {
-        cur = rb_funcall(cur, idPLUS, 1, w);
+        VALUE const val = DBL2NUM(x);
+        VALUE cnt = rb_hash_lookup2(memo->result, val, zero);
+        rb_hash_aset(memo->result, val, rb_int_plus(cnt, one));
       }
-
-      rb_ary_store(bin_weights, bi, cur);
     }
+    valid += end - start;
   }
-  return;
 
-type_error:
-      rb_raise(rb_eTypeError, "weight array must have only real numbers");
+  memo->total = nb->len;
+  memo->na_count += nb->len - valid;
 }
 
-static inline long
-sturges(long n)
+/* call-seq:
+ *    buf.value_counts(normalize: false, sort: true, ascending: false, dropna: true) -> hash
+ *
+ * Returns a hash that contains the counts of the values in `buf` in the
+ * same way as `Array#value_counts`.  NaN values and invalid slots are
+ * counted as `nil`.
+ *
+ * @return [Hash] A hash consists of the counts of the values
+ */
+static VALUE
+numeric_buffer_value_counts(int argc, VALUE *argv, VALUE self)
 {
-  if (n == 0) return 1L;
-  return (long)(ceil(log2(n)) + 1);
+  VALUE kwargs;
+
+  rb_scan_args(argc, argv, "0:", &kwargs);
+  return any_value_counts(kwargs, self, numeric_buffer_value_counts_without_sort);
 }
 
-static VALUE
-ary_histogram_calculate_edge_lo_hi(const double lo, const double hi, const long nbins, const int left_p)
+/* Covariance and correlation matrices
+ *
+ * The columns are unboxed once into a column-major native buffer, and
+ * centered by their means.  The cross-products of the centered columns are
+ * calculated by a kernel blocked into tiles of CROSS_TILE_COLS columns and
+ * CROSS_BLOCK_ROWS rows, so that the rows of a pair of tiles are reused
+ * from the cache.  Each pair of tiles is a work item that writes its own
+ * entries, so the items are distributed to the threads without changing
+ * the order of the additions of any entry. */
+
+#define CROSS_TILE_COLS 16
+#define CROSS_BLOCK_ROWS 512
+
+struct nogvl_cross_product_args {
+  double *x;     /* the columns, which are centered in place */
+  long n, k;     /* the number of the rows and the columns */
+  int skip_na;
+  double *means;
+  char *has_na;  /* whether each column has NaN */
+  double *out;   /* the k x k cross-products */
+  struct comoment *na_pairs; /* the k x k co-moments with skip_na, or NULL */
+  long first, stride; /* the work items processed by a thread */
+};
+
+static inline double
+cross_block_dot(const double *a, const double *b, long n)
 {
-  VALUE edge;
-  double bw, lbw, start, step, divisor, r;
-  long i, len;
+  double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+  long i;
 
-  if (hi == lo) {
-    start = hi;
-    step = 1;
-    divisor = 1;
-    len = 1;
+  for (i = 0; i + 4 <= n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
   }
-  else {
-    bw = (hi - lo) / nbins;
-    lbw = log10(bw);
-    if (lbw >= 0) {
-      step = pow(10, floor(lbw));
-      r = bw / step;
-      if (r <= 1.1) {
-        /* do nothing */
-      }
-      else if (r <= 2.2) {
-        step *= 2;
-      }
-      else if (r <= 5.5) {
-        step *= 5;
-      }
-      else {
-        step *= 10;
+  for (; i < n; ++i)
+    s0 += a[i] * b[i];
+
+  return (s0 + s1) + (s2 + s3);
+}
+
+static void *
+cross_product_chunk(void *ptr)
+{
+  struct nogvl_cross_product_args *args = (struct nogvl_cross_product_args *)ptr;
+  long const n = args->n, k = args->k;
+  long const ntiles = (k + CROSS_TILE_COLS - 1) / CROSS_TILE_COLS;
+  long ti, tj, item = 0;
+
+  for (ti = 0; ti < ntiles; ++ti) {
+    for (tj = ti; tj < ntiles; ++tj, ++item) {
+      long const i0 = ti * CROSS_TILE_COLS, i1 = i0 + CROSS_TILE_COLS < k ? i0 + CROSS_TILE_COLS : k;
+      long const j0 = tj * CROSS_TILE_COLS, j1 = j0 + CROSS_TILE_COLS < k ? j0 + CROSS_TILE_COLS : k;
+      long r0, i, j;
+
+      if (item % args->stride != args->first)
+        continue;
+
+      for (r0 = 0; r0 < n; r0 += CROSS_BLOCK_ROWS) {
+        long const len = r0 + CROSS_BLOCK_ROWS < n ? CROSS_BLOCK_ROWS : n - r0;
+        for (i = i0; i < i1; ++i) {
+          const double *const xi = args->x + i * n + r0;
+          for (j = (j0 > i ? j0 : i); j < j1; ++j)
+            args->out[i * k + j] += cross_block_dot(xi, args->x + j * n + r0, len);
+        }
       }
-      divisor = 1.0;
-      start = step * floor(lo / step);
-      len = (long)ceil((hi - start) / step);
     }
-    else {
-      divisor = pow(10, -floor(lbw));
-      r = bw * divisor;
-      if (r <= 1.1) {
-        /* do nothing */
-      }
-      else if (r <= 2.2) {
-        divisor /= 2;
-      }
-      else if (r <= 5.5) {
-        divisor /= 5;
-      }
-      else {
-        divisor /= 10;
+  }
+
+  return NULL;
+}
+
+/* Recalculate the co-moments of the pairs of the columns with NaN by
+ * skipping the rows with NaN in either column.  A pair is a work item. */
+static void *
+cross_na_pairs_chunk(void *ptr)
+{
+  struct nogvl_cross_product_args *args = (struct nogvl_cross_product_args *)ptr;
+  long const n = args->n, k = args->k;
+  long i, j, r, item = 0;
+
+  for (i = 0; i < k; ++i) {
+    for (j = i; j < k; ++j) {
+      const double *const x = args->x + i * n, *const y = args->x + j * n;
+      struct comoment cm;
+
+      if (!args->has_na[i] && !args->has_na[j])
+        continue;
+      if (item++ % args->stride != args->first)
+        continue;
+
+      comoment_init(&cm);
+      for (r = 0; r < n; ++r) {
+        if (isnan(x[r]) || isnan(y[r]))
+          continue;
+        comoment_update(&cm, x[r], y[r]);
       }
-      step = 1.0;
-      start = floor(lo * divisor);
-      len = (long)ceil(hi * divisor - start);
+      args->na_pairs[i * k + j] = args->na_pairs[j * k + i] = cm;
+      args->out[i * k + j] = cm.cxy;
     }
   }
 
-  if (left_p) {
-    while (lo < start/divisor) {
-      start -= step;
-    }
-    while ((start + (len - 1)*step)/divisor <= hi) {
-      ++len;
-    }
+  return NULL;
+}
+
+/* Run func on the items of args in nthreads threads. */
+static void
+cross_product_run(void *(*func)(void *), struct nogvl_cross_product_args *args, long nthreads)
+{
+  struct nogvl_cross_product_args chunks[PARALLELISM_MAX];
+  long i;
+
+  if (nthreads <= 1) {
+    args->first = 0;
+    args->stride = 1;
+    func(args);
+    return;
   }
-  else {
-    while (lo <= start/divisor) {
-      start -= step;
+
+  for (i = 0; i < nthreads; ++i) {
+    chunks[i] = *args;
+    chunks[i].first = i;
+    chunks[i].stride = nthreads;
+  }
+  parallel_run(func, chunks, sizeof(chunks[0]), nthreads);
+}
+
+static void *
+nogvl_cross_product(void *ptr)
+{
+  struct nogvl_cross_product_args *args = (struct nogvl_cross_product_args *)ptr;
+  long const n = args->n, k = args->k;
+  long const ntiles = (k + CROSS_TILE_COLS - 1) / CROSS_TILE_COLS;
+  long nthreads = parallel_chunk_count(n * k);
+  long i, j, r, na_items = 0;
+
+  /* Center the columns */
+  for (i = 0; i < k; ++i) {
+    double *const x = args->x + i * n;
+    double f = 0.0, c = 0.0;
+    long count = 0;
+
+    args->has_na[i] = 0;
+    for (r = 0; r < n; ++r) {
+      if (isnan(x[r])) {
+        args->has_na[i] = 1;
+        if (args->skip_na)
+          continue;
+      }
+      kahan_add(&f, &c, x[r]);
+      ++count;
     }
-    while ((start + (len - 1)*step)/divisor < hi) {
-      ++len;
+    args->means[i] = count > 0 ? f / count : NAN;
+    for (r = 0; r < n; ++r)
+      x[r] -= args->means[i];
+  }
+
+  for (i = 0; i < k * k; ++i)
+    args->out[i] = 0.0;
+
+  if (nthreads > ntiles * (ntiles + 1) / 2)
+    nthreads = ntiles * (ntiles + 1) / 2;
+  cross_product_run(cross_product_chunk, args, nthreads);
+
+  if (args->na_pairs != NULL) {
+    /* The pairs without NaN have all the rows */
+    for (i = 0; i < k * k; ++i)
+      args->na_pairs[i].n = (size_t)n;
+    for (i = 0; i < k; ++i) {
+      for (j = i; j < k; ++j) {
+        if (args->has_na[i] || args->has_na[j])
+          ++na_items;
+      }
     }
+    nthreads = parallel_chunk_count(n * na_items);
+    if (nthreads > na_items)
+      nthreads = na_items;
+    if (na_items > 0)
+      cross_product_run(cross_na_pairs_chunk, args, nthreads);
   }
 
-  edge = rb_ary_new_capa(len);
-  for (i = 0; i < len; ++i) {
-    rb_ary_push(edge, DBL2NUM(start/divisor));
-    start += step;
+  for (i = 0; i < k; ++i) {
+    for (j = 0; j < i; ++j)
+      args->out[i * k + j] = args->out[j * k + i];
   }
 
-  return edge;
+  return NULL;
 }
 
+/* Unbox the columns into a column-major native buffer.  NA values are
+ * stored as NaN. */
 static VALUE
-ary_histogram_calculate_edge(VALUE ary, VALUE arg0, const int left_p)
+columns_to_dbl_buffer(VALUE columns, long *n_ptr)
 {
-  long n, nbins;
-  VALUE minmax;
-  VALUE edge = Qnil;
-  double lo, hi;
-
-  Check_Type(ary, T_ARRAY);
-  n = RARRAY_LEN(ary);
+  long const k = RARRAY_LEN(columns);
+  long n = 0, i, r;
+  VALUE buf = Qnil;
+  double *p;
+
+  for (i = 0; i < k; ++i) {
+    VALUE const col = RARRAY_AREF(columns, i);
+    long len;
+
+    if (rb_typeddata_is_kind_of(col, &numeric_buffer_type))
+      len = numeric_buffer_get(col)->len;
+    else if (RB_TYPE_P(col, T_ARRAY))
+      len = RARRAY_LEN(col);
+    else
+      rb_raise(rb_eTypeError, "column must be an Array or a NumericBuffer (%"PRIsVALUE" given)",
+               rb_obj_class(col));
 
-  if (NIL_P(arg0)) {
-    arg0 = sym_auto;
+    if (i == 0)
+      n = len;
+    else if (len != n)
+      rb_raise(rb_eArgError, "columns must have the same length (%ld and %ld)", n, len);
   }
 
-  if (RB_TYPE_P(arg0, T_SYMBOL)) {
-    if (arg0 != sym_auto && arg0 != sym_sturges) {
-      rb_raise(rb_eArgError, "Unknown method to calculate bin width: %+"PRIsVALUE, arg0);
+  buf = dbl_buffer_new(k * n);
+  p = DBL_BUFFER_PTR(buf);
+  for (i = 0; i < k; ++i) {
+    VALUE const col = RARRAY_AREF(columns, i);
+    double *const x = p + i * n;
+
+    if (rb_typeddata_is_kind_of(col, &numeric_buffer_type)) {
+      const struct numeric_buffer *nb = numeric_buffer_get(col);
+      for (r = 0; r < n; ++r)
+        x[r] = numeric_buffer_valid_p(nb, r) ? nb->ptr[r] : NAN;
     }
     else {
-      nbins = sturges(n);
+      struct na_cache na;
+
+      na_cache_init(&na);
+      if (RARRAY_LEN(col) != n)
+        rb_raise(rb_eArgError, "column changed its length");
+      for (r = 0; r < n; ++r) {
+        VALUE const e = RARRAY_AREF(col, r);
+        x[r] = is_na_cached(e, &na) ? NAN : value_to_dbl(e);
+      }
     }
   }
-  else {
-    nbins = NUM2LONG(arg0);
-  }
-
-  if (n == 0 && nbins < 0) {
-    rb_raise(rb_eArgError, "nbins must be >= 0 for an empty array, got %ld", nbins);
-  }
-  else if (n > 0 && nbins < 1) {
-    rb_raise(rb_eArgError, "nbins must be >= 1 for a non-empty array, got %ld", nbins);
-  }
-  else if (n == 0) {
-    edge = rb_ary_new_capa(1);
-    rb_ary_push(edge, DBL2NUM(0.0));
-    return edge;
-  }
-
-  minmax = rb_funcall(ary, rb_intern("minmax"), 0);
-  lo = NUM2DBL(RARRAY_AREF(minmax, 0));
-  hi = NUM2DBL(RARRAY_AREF(minmax, 1));
-
-  edge = ary_histogram_calculate_edge_lo_hi(lo, hi, nbins, left_p);
+  rb_str_set_len(buf, k * n * (long)sizeof(double));
 
-  return edge;
+  *n_ptr = n;
+  return buf;
 }
 
-static VALUE
-check_histogram_weight_array(VALUE weight_array, const long ary_len)
+/* Calculate the cross-products of the centered columns into *out_buf.
+ * With skip_na, the entries of the pairs of the columns with NaN are
+ * recalculated by skipping the rows with NaN in either column in the
+ * same threads without the GVL, and the co-moments of all the pairs are
+ * stored in (*na_pairs_ptr)[i * k + j], whose n is the number of the rows
+ * for the pairs without NaN.  *na_pairs_ptr is NULL if no column has NaN. */
+static void
+columns_cross_product(VALUE columns, int skip_na, VALUE *out_buf, long *n_ptr,
+                      struct comoment **na_pairs_ptr, VALUE *na_pairs_buf)
 {
-  if (weight_array == Qundef) return Qnil;
+  struct nogvl_cross_product_args args;
+  long const k = RARRAY_LEN(columns);
+  VALUE buf, work;
+  long n, i;
 
-  weight_array = rb_check_convert_type(weight_array, T_ARRAY, "Array", "to_ary");
-  if (RARRAY_LEN(weight_array) != ary_len) {
-    rb_raise(rb_eArgError, "weight array must have the same number of items as the receiver array");
+  buf = columns_to_dbl_buffer(columns, &n);
+  work = rb_str_tmp_new(k * (long)(sizeof(double) + 1));
+  *out_buf = dbl_buffer_new(k * k);
+
+  args.x = DBL_BUFFER_PTR(buf);
+  args.n = n;
+  args.k = k;
+  args.skip_na = skip_na;
+  args.means = (double *)RSTRING_PTR(work);
+  args.has_na = RSTRING_PTR(work) + k * sizeof(double);
+  args.out = DBL_BUFFER_PTR(*out_buf);
+  args.na_pairs = NULL;
+  *na_pairs_buf = Qnil;
+  if (skip_na) {
+    *na_pairs_buf = rb_str_tmp_new(k * k * (long)sizeof(struct comoment));
+    args.na_pairs = (struct comoment *)RSTRING_PTR(*na_pairs_buf);
   }
+  call_without_gvl_if_large(nogvl_cross_product, &args, n * k);
+  rb_str_set_len(*out_buf, k * k * (long)sizeof(double));
 
-  return weight_array;
+  *na_pairs_ptr = NULL;
+  for (i = 0; i < k; ++i) {
+    if (args.has_na[i]) {
+      *na_pairs_ptr = args.na_pairs;
+      break;
+    }
+  }
+
+  RB_GC_GUARD(buf);
+  RB_GC_GUARD(work);
+  *n_ptr = n;
 }
 
 static VALUE
-check_histogram_edges(VALUE edges)
+dbl_matrix_to_ary(const double *p, long k)
 {
-  if (edges == Qundef) return Qnil;
-  return rb_check_convert_type(edges, T_ARRAY, "Array", "to_ary");
-}
+  VALUE res = rb_ary_new_capa(k);
+  long i;
 
-static int
-check_histogram_left_p(VALUE closed)
-{
-  int left_p = (closed != sym_right);
-  if (left_p && closed != Qundef && closed != sym_left) {
-    rb_raise(rb_eArgError, "invalid value for :closed keyword "
-        "(%"PRIsVALUE" for :left or :right)", closed);
-  }
-  return left_p;
+  for (i = 0; i < k; ++i)
+    rb_ary_push(res, dbl_buffer_to_ary(p + i * k, k));
+  return res;
 }
 
 /* call-seq:
- *    ary.histogram(nbins=:auto, weight: nil, closed: :left)
+ *    EnumerableStatistics.covariance_matrix(columns, population: false, skip_na: false) -> array
  *
- * @param [Integer] nbins  The approximate number of bins
- * @params [Array<Numeric>] weights
- *   An optional weight array, that has the same length as the receiver.
- *   `weight[i]` means the weight value of the i-th element in the receiver.
- * @params [Array<Numeric>] edges
- *   An optional edge array, that specify the bin edges.
- *   This array must be sorted.
- * @param [:left, :right] closed
- *   If :left (the default), the bin interval are left-closed.
- *   If :right, the bin interval are right-closed.
+ * Calculate the covariances of all the pairs of `columns`, each of which
+ * is an Array or an `EnumerableStatistics::NumericBuffer` of the same length.
+ * The i-th row of the result has the covariances of the i-th column and
+ * the columns, so the diagonal has the variances.
  *
- * @return [EnumerableStatistics::Histogram] The histogram struct.
+ * Each column is scanned once into a native buffer, and the cross-products
+ * are calculated by a cache-blocked kernel without the GVL, in threads
+ * as many as `EnumerableStatistics.parallelism`.
+ *
+ * When `skip_na:` is `true`, the covariance of a pair is calculated by
+ * skipping the rows that have an NA value in either column, as
+ * `Array#covariance(skip_na: true)`.  The pairs with NA values are
+ * recalculated by the same threads without the GVL.
+ *
+ * @param [Array<Array, EnumerableStatistics::NumericBuffer>] columns
+ *
+ * @return [Array<Array<Float>>] A covariance matrix
  */
 static VALUE
-ary_histogram(int argc, VALUE *argv, VALUE ary)
+es_covariance_matrix(int argc, VALUE *argv, VALUE mod)
 {
-  VALUE arg0, kwargs, bin_weights;
-  long n_bin_weights, i;
-
-  VALUE weight_array = Qnil;
-  VALUE edges = Qnil;
-  int left_p = 1;
-
-  rb_scan_args(argc, argv, "01:", &arg0, &kwargs);
-
-  if (!NIL_P(kwargs)) {
-    enum { kw_weights, kw_edges, kw_closed };
-    static ID kwarg_keys[3];
-    VALUE kwarg_vals[3];
+  struct variance_opts options;
+  struct comoment *na_pairs;
+  VALUE columns, opts, out, na_pairs_buf;
+  double *p;
+  long n, k, i;
+  size_t ddof;
 
-    if (!kwarg_keys[0]) {
-      kwarg_keys[kw_weights] = rb_intern("weights");
-      kwarg_keys[kw_edges]  = rb_intern("edges");
-      kwarg_keys[kw_closed] = rb_intern("closed");
-    }
+  rb_scan_args(argc, argv, "1:", &columns, &opts);
+  get_variance_opts(opts, &options);
+  ddof = options.population ? 0 : 1;
 
-    rb_get_kwargs(kwargs, kwarg_keys, 0, 3, kwarg_vals);
+  columns = rb_convert_type(columns, T_ARRAY, "Array", "to_ary");
+  columns_cross_product(columns, options.skip_na, &out, &n, &na_pairs, &na_pairs_buf);
 
-    weight_array = check_histogram_weight_array(kwarg_vals[kw_weights], RARRAY_LEN(ary));
-    edges = check_histogram_edges(kwarg_vals[kw_edges]);
-    left_p = check_histogram_left_p(kwarg_vals[kw_closed]);
+  k = RARRAY_LEN(columns);
+  p = DBL_BUFFER_PTR(out);
+  for (i = 0; i < k * k; ++i) {
+    if (na_pairs && na_pairs[i].n != (size_t)n)
+      p[i] = comoment_covariance(&na_pairs[i], ddof);
+    else
+      p[i] = n < 2 ? NAN : p[i] / (double)(n - (long)ddof);
   }
 
-  if (NIL_P(edges)) {
-    edges = ary_histogram_calculate_edge(ary, arg0, left_p);
-  }
-  else if (! NIL_P(arg0)) {
-    rb_raise(rb_eArgError, "Unable to use both `nbins` and `edges` together");
-  }
+  RB_GC_GUARD(na_pairs_buf);
+  return dbl_matrix_to_ary(p, k);
+}
 
-  n_bin_weights = RARRAY_LEN(edges) - 1;
-  bin_weights = rb_ary_new_capa(n_bin_weights);
-  for (i = 0; i < n_bin_weights; ++i) {
-    rb_ary_store(bin_weights, i, INT2FIX(0));
+/* call-seq:
+ *    EnumerableStatistics.correlation_matrix(columns, skip_na: false) -> array
+ *
+ * Calculate the Pearson correlation coefficients of all the pairs of
+ * `columns` in the same way as `EnumerableStatistics.covariance_matrix`.
+ * The coefficients of a constant column are NaN.
+ *
+ * @param [Array<Array, EnumerableStatistics::NumericBuffer>] columns
+ *
+ * @return [Array<Array<Float>>] A correlation matrix
+ */
+static VALUE
+es_correlation_matrix(int argc, VALUE *argv, VALUE mod)
+{
+  struct comoment *na_pairs;
+  VALUE columns, opts, out, na_pairs_buf, res;
+  double *p;
+  long n, k, i, j;
+
+  rb_scan_args(argc, argv, "1:", &columns, &opts);
+
+  columns = rb_convert_type(columns, T_ARRAY, "Array", "to_ary");
+  columns_cross_product(columns, opt_skip_na(opts), &out, &n, &na_pairs, &na_pairs_buf);
+
+  k = RARRAY_LEN(columns);
+  p = DBL_BUFFER_PTR(out);
+  res = rb_ary_new_capa(k);
+  for (i = 0; i < k; ++i) {
+    VALUE row = rb_ary_new_capa(k);
+    for (j = 0; j < k; ++j) {
+      double r;
+
+      if (na_pairs && na_pairs[i * k + j].n != (size_t)n) {
+        r = comoment_correlation(&na_pairs[i * k + j]);
+      }
+      else if (n < 2) {
+        r = NAN;
+      }
+      else {
+        r = p[i * k + j] / sqrt(p[i * k + i] * p[j * k + j]);
+        if (i == j && p[i * k + i] > 0)
+          r = 1.0;
+        else if (r > 1.0)
+          r = 1.0;
+        else if (r < -1.0)
+          r = -1.0;
+      }
+      rb_ary_push(row, DBL2NUM(r));
+    }
+    rb_ary_push(res, row);
   }
 
-  histogram_weights_push_values(bin_weights, edges, ary, weight_array, left_p);
-
-  return rb_struct_new(cHistogram, edges, bin_weights,
-                       left_p ? sym_left : sym_right,
-                       Qfalse);
+  RB_GC_GUARD(na_pairs_buf);
+  RB_GC_GUARD(out);
+  return res;
 }
 
 void
@@ -2526,6 +8886,10 @@ Init_extension(void)
 #ifdef HAVE_RB_EXT_RACTOR_SAFE
   rb_ext_ractor_safe(true);
 #endif
+#ifdef HAVE_RUBY_RACTOR_H
+  main_ractor = rb_funcall(rb_cRactor, rb_intern("current"), 0);
+  rb_gc_register_mark_object(main_ractor);
+#endif
 
   mEnumerableStatistics = rb_const_get_at(rb_cObject, rb_intern("EnumerableStatistics"));
 
@@ -2534,11 +8898,18 @@ Init_extension(void)
 
   rb_define_method(rb_mEnumerable, "sum", enum_sum, -1);
   rb_define_method(rb_mEnumerable, "mean_variance", enum_mean_variance_m, -1);
-  rb_define_method(rb_mEnumerable, "mean", enum_mean, 0);
+  rb_define_method(rb_mEnumerable, "mean", enum_mean, -1);
   rb_define_method(rb_mEnumerable, "variance", enum_variance, -1);
   rb_define_method(rb_mEnumerable, "mean_stdev", enum_mean_stdev, -1);
   rb_define_method(rb_mEnumerable, "stdev", enum_stdev, -1);
+  rb_define_method(rb_mEnumerable, "skewness", enum_skewness, -1);
+  rb_define_method(rb_mEnumerable, "kurtosis", enum_kurtosis, -1);
+  rb_define_method(rb_mEnumerable, "moments", enum_moments_m, -1);
   rb_define_method(rb_mEnumerable, "value_counts", enum_value_counts, -1);
+  rb_define_method(rb_mEnumerable, "describe", enum_describe, -1);
+  rb_define_method(rb_mEnumerable, "group_stats", enum_group_stats, -1);
+  rb_define_method(rb_mEnumerable, "cumsum", enum_cumsum, -1);
+  rb_define_method(rb_mEnumerable, "cumprod", enum_cumprod, -1);
 
   rb_define_method(rb_cArray, "sum", ary_sum, -1);
   rb_define_method(rb_cArray, "mean_variance", ary_mean_variance_m, -1);
@@ -2546,19 +8917,83 @@ Init_extension(void)
   rb_define_method(rb_cArray, "variance", ary_variance, -1);
   rb_define_method(rb_cArray, "mean_stdev", ary_mean_stdev, -1);
   rb_define_method(rb_cArray, "stdev", ary_stdev, -1);
-  rb_define_method(rb_cArray, "percentile", ary_percentile, 1);
-  rb_define_method(rb_cArray, "median", ary_median, 0);
+  rb_define_method(rb_cArray, "covariance", ary_covariance, -1);
+  rb_define_method(rb_cArray, "correlation", ary_correlation, -1);
+  rb_define_method(rb_cArray, "skewness", ary_skewness, -1);
+  rb_define_method(rb_cArray, "kurtosis", ary_kurtosis, -1);
+  rb_define_method(rb_cArray, "moments", ary_moments_m, -1);
+  rb_define_method(rb_cArray, "percentile", ary_percentile_m, -1);
+  rb_define_method(rb_cArray, "median", ary_median, -1);
   rb_define_method(rb_cArray, "value_counts", ary_value_counts, -1);
+  rb_define_method(rb_cArray, "describe", ary_describe, -1);
+  rb_define_method(rb_cArray, "cumsum", ary_cumsum, -1);
+  rb_define_method(rb_cArray, "cumprod", ary_cumprod, -1);
+  rb_define_method(rb_cArray, "rolling_sum", ary_rolling_sum, -1);
+  rb_define_method(rb_cArray, "rolling_mean", ary_rolling_mean, -1);
+  rb_define_method(rb_cArray, "rolling_variance", ary_rolling_variance, -1);
+  rb_define_method(rb_cArray, "rolling_stdev", ary_rolling_stdev, -1);
+  rb_define_method(rb_cArray, "rolling_median", ary_rolling_median, -1);
+  rb_define_method(rb_cArray, "rolling_percentile", ary_rolling_percentile, -1);
+  rb_define_method(rb_cArray, "ewm_mean", ary_ewm_mean, -1);
+  rb_define_method(rb_cArray, "ewm_variance", ary_ewm_variance, -1);
 
   rb_define_method(rb_cHash, "value_counts", hash_value_counts, -1);
+  rb_define_method(rb_cHash, "sum_values", hash_sum_values, -1);
+  rb_define_method(rb_cHash, "mean_values", hash_mean_values, -1);
+  rb_define_method(rb_cHash, "variance_values", hash_variance_values, -1);
+  rb_define_method(rb_cHash, "percentile_values", hash_percentile_values, 1);
 
   half_in_rational = nurat_s_new_internal(rb_cRational, INT2FIX(1), INT2FIX(2));
   rb_gc_register_mark_object(half_in_rational);
 
   cHistogram = rb_const_get_at(mEnumerableStatistics, rb_intern("Histogram"));
+  cSummary = rb_const_get_at(mEnumerableStatistics, rb_intern("Summary"));
 
   rb_define_method(rb_cArray, "histogram", ary_histogram, -1);
 
+  rb_define_module_function(mEnumerableStatistics, "gvl_release_threshold",
+                            es_get_gvl_release_threshold, 0);
+  rb_define_module_function(mEnumerableStatistics, "gvl_release_threshold=",
+                            es_set_gvl_release_threshold, 1);
+  rb_define_module_function(mEnumerableStatistics, "parallelism",
+                            es_get_parallelism, 0);
+  rb_define_module_function(mEnumerableStatistics, "parallelism=",
+                            es_set_parallelism, 1);
+  rb_define_module_function(mEnumerableStatistics, "covariance_matrix",
+                            es_covariance_matrix, -1);
+  rb_define_module_function(mEnumerableStatistics, "correlation_matrix",
+                            es_correlation_matrix, -1);
+
+  cEWMAccumulator = rb_define_class_under(mEnumerableStatistics, "EWMAccumulator", rb_cObject);
+  rb_define_alloc_func(cEWMAccumulator, ewm_accumulator_alloc);
+  rb_define_method(cEWMAccumulator, "initialize", ewm_accumulator_initialize, -1);
+  rb_define_method(cEWMAccumulator, "initialize_copy", ewm_accumulator_init_copy, 1);
+  rb_define_method(cEWMAccumulator, "update", ewm_accumulator_update, 1);
+  rb_define_method(cEWMAccumulator, "<<", ewm_accumulator_update, 1);
+  rb_define_method(cEWMAccumulator, "count", ewm_accumulator_count, 0);
+  rb_define_method(cEWMAccumulator, "alpha", ewm_accumulator_alpha, 0);
+  rb_define_method(cEWMAccumulator, "mean", ewm_accumulator_mean, 0);
+  rb_define_method(cEWMAccumulator, "variance", ewm_accumulator_variance, 0);
+  rb_define_method(cEWMAccumulator, "stdev", ewm_accumulator_stdev, 0);
+
+  cNumericBuffer = rb_define_class_under(mEnumerableStatistics, "NumericBuffer", rb_cObject);
+  rb_undef_alloc_func(cNumericBuffer);
+  rb_define_singleton_method(cNumericBuffer, "new", numeric_buffer_s_new, -1);
+  rb_define_method(cNumericBuffer, "size", numeric_buffer_size, 0);
+  rb_define_method(cNumericBuffer, "length", numeric_buffer_size, 0);
+  rb_define_method(cNumericBuffer, "[]", numeric_buffer_aref, 1);
+  rb_define_method(cNumericBuffer, "slice", numeric_buffer_slice, 2);
+  rb_define_method(cNumericBuffer, "to_a", numeric_buffer_to_a, 0);
+  rb_define_method(cNumericBuffer, "sum", numeric_buffer_sum, -1);
+  rb_define_method(cNumericBuffer, "mean", numeric_buffer_mean, -1);
+  rb_define_method(cNumericBuffer, "variance", numeric_buffer_variance, -1);
+  rb_define_method(cNumericBuffer, "stdev", numeric_buffer_stdev, -1);
+  rb_define_method(cNumericBuffer, "mean_variance", numeric_buffer_mean_variance_m, -1);
+  rb_define_method(cNumericBuffer, "median", numeric_buffer_median, 0);
+  rb_define_method(cNumericBuffer, "percentile", numeric_buffer_percentile, 1);
+  rb_define_method(cNumericBuffer, "histogram", numeric_buffer_histogram, -1);
+  rb_define_method(cNumericBuffer, "value_counts", numeric_buffer_value_counts, -1);
+
   void Init_array_extension(void);
   Init_array_extension();
 
@@ -2581,6 +9016,46 @@ Init_extension(void)
   id_closed = rb_intern("closed");
   id_edge = rb_intern("edge");
   id_skip_na = rb_intern("skip_na");
+  id_upto = rb_intern("upto");
+  id_percentiles = rb_intern("percentiles");
+  id_size = rb_intern("size");
+  id_last = rb_intern("last");
+  id_fdiv = rb_intern("fdiv");
+  id_normalize = rb_intern("normalize");
+  id_sort = rb_intern("sort");
+  id_ascending = rb_intern("ascending");
+  id_dropna = rb_intern("dropna");
+  id_weights = rb_intern("weights");
+  id_edges = rb_intern("edges");
+  id_key = rb_intern("key");
+  id_index = rb_intern("index");
+  id_aref = rb_intern("[]");
+  id_by = rb_intern("by");
+  id_value = rb_intern("value");
+  id_stats = rb_intern("stats");
+  id_call = rb_intern("call");
+  id_count = rb_intern("count");
+  id_mean = rb_intern("mean");
+  id_variance = rb_intern("variance");
+  id_stdev = rb_intern("stdev");
+  id_min = rb_intern("min");
+  id_max = rb_intern("max");
+  id_min_periods = rb_intern("min_periods");
+  id_alpha = rb_intern("alpha");
+  id_halflife = rb_intern("halflife");
+  id_span = rb_intern("span");
+  id_exact = rb_intern("exact");
+  id_quo = rb_intern("quo");
+  id_to_r = rb_intern("to_r");
+  id_bit_length = rb_intern("bit_length");
+  id_lshift = rb_intern("<<");
+  id_rshift = rb_intern(">>");
+  id_divmod = rb_intern("divmod");
+  id_odd_p = rb_intern("odd?");
+  id_algorithm = rb_intern("algorithm");
+  id_kahan = rb_intern("kahan");
+  id_pairwise = rb_intern("pairwise");
+  id_validity = rb_intern("validity");
 
   sym_auto = ID2SYM(rb_intern("auto"));
   sym_left = ID2SYM(rb_intern("left"));
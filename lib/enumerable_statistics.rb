@@ -1,3 +1,4 @@
 require_relative "enumerable_statistics/version"
 require_relative "enumerable_statistics/array_ext"
 require_relative "enumerable_statistics/histogram"
+require_relative "enumerable_statistics/summary"
@@ -0,0 +1,7 @@
+module EnumerableStatistics
+  class Summary < Struct.new(:count, :na_count, :sum, :mean, :variance, :min, :max, :percentiles)
+    def stdev
+      Math.sqrt(variance)
+    end
+  end
+end
@@ -0,0 +1,14 @@
+# Save the global settings of EnumerableStatistics before each test, and
+# restore them after it.  A test case that defines its own setup or
+# teardown must call super.
+module GlobalSettingsFixture
+  def setup
+    @threshold = EnumerableStatistics.gvl_release_threshold
+    @parallelism = EnumerableStatistics.parallelism
+  end
+
+  def teardown
+    EnumerableStatistics.gvl_release_threshold = @threshold
+    EnumerableStatistics.parallelism = @parallelism
+  end
+end
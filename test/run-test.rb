@@ -8,5 +8,6 @@ $LOAD_PATH.unshift(lib_dir)
 
 require "test/unit"
 require "enumerable/statistics"
+require_relative "helper"
 
 exit Test::Unit::AutoRunner.run(true, test_dir)
@@ -0,0 +1,51 @@
+class ArithProgressionTest < Test::Unit::TestCase
+  def assert_same_statistics(expected, actual, tolerance)
+    expected.zip(actual) do |e, a|
+      if e.nan?
+        assert_predicate(a, :nan?)
+      else
+        assert_in_delta(e, a, [e.abs * tolerance, tolerance].max)
+      end
+    end
+  end
+
+  def statistics(enum)
+    [enum.mean, *enum.mean_variance, enum.variance(population: true), enum.stdev]
+  end
+
+  data("inclusive range", 1..10)
+  data("exclusive range", 1...10)
+  data("negative range", -5..5)
+  data("single element", 3..3)
+  data("empty range", 5..1)
+  data("step", 1.step(100, 3))
+  data("negative step", 10.step(1, -3))
+  data("range with step", (1...10).step(3))
+  data("empty sequence", 1.step(0, 1))
+  def test_integer(enum)
+    assert_same_statistics(statistics(enum.to_a), statistics(enum), 0)
+    assert_equal(enum.to_a.sum, enum.sum)
+  end
+
+  data("float step", 1.0.step(2.0, 0.1))
+  data("exclusive float range with step", (1.0...2.0).step(0.1))
+  data("clamped last value", (0.0..1.0).step(0.3))
+  data("integer begin and float step", 1.step(2.0, 0.25))
+  data("negative float step", 5.0.step(-1.0, -0.7))
+  def test_float(enum)
+    assert_same_statistics(statistics(enum.to_a), statistics(enum), 1e-14)
+  end
+
+  def test_large_range
+    n = 10**9
+    assert_equal((n + 1) / 2.0, (1..n).mean)
+    assert_equal(n * (n + 1) / 12.0, (1..n).variance)
+    assert_equal((n**2 - 1) / 12.0, (1..n).variance(population: true))
+    assert_equal(9 * n * (n + 1) / 12.0, 1.step(3 * n - 2, 3).variance)
+    assert_equal(858.5, (10**20..10**20 + 100).variance)
+  end
+
+  def test_block
+    assert_equal(5.0, (1..4).mean { |x| x * 2 })
+  end
+end
@@ -0,0 +1,76 @@
+class ComplexStatisticsTest < Test::Unit::TestCase
+  def setup
+    @ary = Array.new(1000) { |i| Complex(Math.cos(i) + 1e3, Math.sin(i * 0.5) - 1e3) }
+  end
+
+  def reference_variance(ary, ddof)
+    mean = ary.map(&:to_c).inject(:+) / ary.size
+    ary.map { |x| (x - mean).abs2 }.sum / (ary.size - ddof)
+  end
+
+  def assert_complex_in_delta(expected, actual, delta)
+    assert_kind_of(Complex, actual)
+    assert_in_delta(expected.real, actual.real, delta)
+    assert_in_delta(expected.imag, actual.imag, delta)
+  end
+
+  def test_sum
+    expected = @ary.inject(:+)
+    assert_complex_in_delta(expected, @ary.sum, 1e-9)
+    assert_complex_in_delta(expected, @ary.each.sum, 1e-9)
+    assert_complex_in_delta(expected + 1.5, @ary.sum(1.5), 1e-9)
+  end
+
+  def test_sum_compensated
+    ary = [Complex(0.1, 0.1)] * 10
+    assert_equal(Complex(1.0, 1.0), ary.sum)
+    assert_equal(Complex(1.0, 1.0), ary.each.sum)
+    assert_equal(Complex(1.0, 1.0), ary.cumsum.last)
+  end
+
+  data("reals before complex", [[1, 2.5, Complex(1.0, -0.0), 3, 1r/2], Complex(8.0, -0.0)])
+  data("integer parts", [[Complex(1, 2), Complex(3, 4)], Complex(4, 6)])
+  data("mixed parts", [[Complex(1.0, 2.0), Complex(3, 4)], Complex(4.0, 6.0)])
+  data("complex init", [[Complex(1.0, 2.0)], Complex(1, 1), Complex(2.0, 3.0)])
+  def test_sum_types(data)
+    ary, *init, expected = data
+    [ary.sum(*init), ary.each.sum(*init)].each do |actual|
+      assert_equal(expected, actual)
+      assert_equal(expected.real.class, actual.real.class)
+      assert_equal(expected.imag.class, actual.imag.class)
+      assert_equal(1.0 / expected.imag, 1.0 / actual.imag) if expected.imag.is_a?(Float)
+    end
+  end
+
+  def test_mean
+    expected = @ary.inject(:+) / @ary.size
+    assert_complex_in_delta(expected, @ary.mean, 1e-9)
+    assert_complex_in_delta(expected, @ary.each.mean, 1e-9)
+  end
+
+  def test_variance
+    [[false, 1], [true, 0]].each do |population, ddof|
+      expected = reference_variance(@ary, ddof)
+      assert_in_delta(expected, @ary.variance(population: population), expected * 1e-9)
+      assert_in_delta(expected, @ary.each.variance(population: population), expected * 1e-9)
+      mean, variance = @ary.mean_variance(population: population)
+      assert_complex_in_delta(@ary.mean, mean, 1e-9)
+      assert_in_delta(expected, variance, expected * 1e-9)
+    end
+    assert_in_delta(Math.sqrt(reference_variance(@ary, 1)), @ary.stdev, 1e-9)
+  end
+
+  def test_variance_with_reals
+    assert_equal(2.5, [Complex(1.0, 1.0), 3].variance)
+    assert_equal(2.5, [3, Complex(1.0, 1.0)].variance)
+    assert_equal([Complex(0.5, 0.5), 0.5], [1.0, Complex(0.0, 1.0)].mean_variance(population: true))
+    assert_equal([Complex(2.0, 3.0), 4.0],
+                 [Complex(1.0, 2.0), nil, Complex(3.0, 4.0)].mean_variance(skip_na: true))
+    assert_equal(4.0, {a: Complex(1.0, 2.0), b: Complex(3.0, 4.0)}.variance_values)
+  end
+
+  def test_higher_moments
+    assert_raise(RangeError) { @ary.skewness }
+    assert_raise(RangeError) { @ary.moments }
+  end
+end
@@ -0,0 +1,100 @@
+class CovarianceMatrixTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def setup
+    super
+    @columns = Array.new(37) { |c| Array.new(1500) { rand * (c + 1) + c } }
+    @columns[5] = @columns[3].map { |x| -2 * x + 1 }
+  end
+
+  def assert_matrix_in_delta(expected, actual, delta)
+    assert_equal(expected.size, actual.size)
+    expected.zip(actual) do |e_row, a_row|
+      e_row.zip(a_row) do |e, a|
+        if e.nan?
+          assert_predicate(a, :nan?)
+        else
+          assert_in_delta(e, a, delta)
+        end
+      end
+    end
+  end
+
+  def pairwise(columns, method, **opts)
+    columns.map { |x| columns.map { |y| x.__send__(method, y, **opts) } }
+  end
+
+  def test_covariance_matrix
+    expected = pairwise(@columns, :covariance)
+    assert_matrix_in_delta(expected, EnumerableStatistics.covariance_matrix(@columns), 1e-9)
+    expected = pairwise(@columns, :covariance, population: true)
+    assert_matrix_in_delta(expected, EnumerableStatistics.covariance_matrix(@columns, population: true), 1e-9)
+  end
+
+  def test_correlation_matrix
+    actual = EnumerableStatistics.correlation_matrix(@columns)
+    assert_matrix_in_delta(pairwise(@columns, :correlation), actual, 1e-12)
+    assert_equal(Array.new(37, 1.0), Array.new(37) { |i| actual[i][i] })
+    assert_equal(-1.0, actual[3][5])
+    assert_equal(actual, actual.transpose)
+  end
+
+  def test_parallel
+    EnumerableStatistics.parallelism = 1
+    expected = EnumerableStatistics.covariance_matrix(@columns)
+    EnumerableStatistics.parallelism = 5
+    assert_equal(expected, EnumerableStatistics.covariance_matrix(@columns))
+  end
+
+  def test_skip_na
+    @columns[2] = @columns[2].dup.tap { |c| c[10] = nil }
+    @columns[7] = @columns[7].dup.tap { |c| c[11] = Float::NAN }
+    expected = pairwise(@columns, :covariance, skip_na: true)
+    assert_matrix_in_delta(expected, EnumerableStatistics.covariance_matrix(@columns, skip_na: true), 1e-9)
+    expected = pairwise(@columns, :correlation, skip_na: true)
+    assert_matrix_in_delta(expected, EnumerableStatistics.correlation_matrix(@columns, skip_na: true), 1e-12)
+
+    @columns[2][10] = Float::NAN
+    actual = EnumerableStatistics.covariance_matrix(@columns)
+    assert_predicate(actual[2][0], :nan?)
+    assert_predicate(actual[7][2], :nan?)
+    assert_not_predicate(actual[0][1], :nan?)
+  end
+
+  def test_skip_na_parallel
+    @columns[2] = @columns[2].dup.tap { |c| c[10] = nil }
+    @columns[7] = @columns[7].dup.tap { |c| c[11] = Float::NAN }
+    EnumerableStatistics.gvl_release_threshold = 0
+    EnumerableStatistics.parallelism = 1
+    expected = EnumerableStatistics.covariance_matrix(@columns, skip_na: true)
+    EnumerableStatistics.parallelism = 5
+    assert_equal(expected, EnumerableStatistics.covariance_matrix(@columns, skip_na: true))
+    assert_matrix_in_delta(pairwise(@columns, :covariance, skip_na: true), expected, 1e-9)
+  end
+
+  def test_numeric_buffer
+    buf = EnumerableStatistics::NumericBuffer.new([1, 2, 3, 4], validity: [0b1011].pack("C"))
+    expected = [[1, 2, nil, 4].covariance([1, 2, nil, 4], skip_na: true),
+                [1, 2, nil, 4].covariance([1, 2, 3, 5], skip_na: true)]
+    assert_equal(expected, EnumerableStatistics.covariance_matrix([buf, [1, 2, 3, 5]], skip_na: true)[0])
+  end
+
+  def test_degenerate
+    assert_equal([], EnumerableStatistics.covariance_matrix([]))
+    assert_equal([[1.0]], EnumerableStatistics.covariance_matrix([[1, 2, 3]]))
+    assert_predicate(EnumerableStatistics.covariance_matrix([[1]])[0][0], :nan?)
+    assert_predicate(EnumerableStatistics.correlation_matrix([[1, 2, 3], [1, 1, 1]])[0][1], :nan?)
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) do
+      EnumerableStatistics.covariance_matrix([[1, 2], [1]])
+    end
+    assert_raise(TypeError) do
+      EnumerableStatistics.correlation_matrix([1, 2])
+    end
+    assert_raise(TypeError) do
+      EnumerableStatistics.covariance_matrix([["a"]])
+    end
+  end
+end
@@ -0,0 +1,72 @@
+class CovarianceTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def two_pass(xs, ys, ddof = 1)
+    mx, my = xs.sum.fdiv(xs.size), ys.sum.fdiv(ys.size)
+    cxy = xs.zip(ys).sum { |x, y| (x - mx) * (y - my) }
+    cxx = xs.sum { |x| (x - mx)**2 }
+    cyy = ys.sum { |y| (y - my)**2 }
+    [cxy / (xs.size - ddof), cxy / Math.sqrt(cxx * cyy)]
+  end
+
+  data("floats", [Array.new(1000) { rand }, Array.new(1000) { rand }])
+  data("integers", [Array.new(100) { |i| i }, Array.new(100) { |i| i * 3 + rand(10) }])
+  data("offset", [Array.new(100) { 1e9 + rand }, Array.new(100) { -1e9 + rand }])
+  data("mixed", [[1, 2.5, 3r, 4, 5.5], [2.0, 1, 0.5, 3, 7]])
+  def test_covariance_and_correlation((xs, ys))
+    cov, cor = two_pass(xs, ys)
+    assert_in_delta(cov, xs.covariance(ys), cov.abs * 1e-9)
+    assert_in_delta(cov * (xs.size - 1) / xs.size, xs.covariance(ys, population: true), cov.abs * 1e-9)
+    assert_in_delta(cor, xs.correlation(ys), 1e-9)
+    assert_in_delta(cor, ys.correlation(xs), 1e-9)
+  end
+
+  def test_variance
+    xs = Array.new(100) { rand }
+    assert_in_delta(xs.variance, xs.covariance(xs), 1e-12)
+    assert_equal(1.0, xs.correlation(xs))
+    assert_equal(-1.0, xs.correlation(xs.map { |x| -2 * x + 1 }))
+  end
+
+  def test_degenerate
+    assert_predicate([].covariance([]), :nan?)
+    assert_predicate([1].covariance([2]), :nan?)
+    assert_predicate([1].correlation([2]), :nan?)
+    assert_predicate([1, 1, 1].correlation([1, 2, 3]), :nan?)
+    assert_equal(0.0, [1, 1, 1].covariance([1, 2, 3]))
+  end
+
+  def test_skip_na
+    xs = [1.0, nil, 3.0, 4.0, Float::NAN, 6.0]
+    ys = [2.0, 5.0, nil, 8.0, 1.0, 12.0]
+    assert_in_delta([1.0, 4.0, 6.0].covariance([2.0, 8.0, 12.0]), xs.covariance(ys, skip_na: true), 1e-12)
+    assert_in_delta(1.0, xs.correlation(ys, skip_na: true), 1e-12)
+    assert_predicate([1.0, Float::NAN, 3.0].correlation([1, 2, 3]), :nan?)
+    assert_raise(TypeError) do
+      xs.covariance(ys)
+    end
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) do
+      [1, 2].covariance([1, 2, 3])
+    end
+    assert_raise(TypeError) do
+      [1, 2].correlation(1)
+    end
+  end
+
+  data("floats", Array.new(2) { Array.new(100_000) { rand } })
+  data("with NaN", Array.new(2) { Array.new(100_000) { rand } }.tap { |xs, _| xs[5000] = Float::NAN })
+  def test_native_buffer((xs, ys))
+    EnumerableStatistics.gvl_release_threshold = nil
+    expected = [xs.covariance(ys, skip_na: true), xs.correlation(ys, skip_na: true)]
+    EnumerableStatistics.gvl_release_threshold = 0
+    [1, 4].each do |k|
+      EnumerableStatistics.parallelism = k
+      actual = [xs.covariance(ys, skip_na: true), xs.correlation(ys, skip_na: true)]
+      assert_in_delta(expected[0], actual[0], expected[0].abs * 1e-9)
+      assert_in_delta(expected[1], actual[1], 1e-12)
+    end
+  end
+end
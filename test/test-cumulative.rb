@@ -0,0 +1,58 @@
+class CumulativeTest < Test::Unit::TestCase
+  def prefix_sums(ary, *args, **opts)
+    Array.new(ary.size) { |i| ary[0..i].each.sum(*args, **opts) }
+  end
+
+  data("integers", [1, 2, 3, 4])
+  data("bignums", [2**64, 1, -(2**64), 3])
+  data("fixnum overflow", [2**62, 2**62, 2**62, -1])
+  data("rationals", [1r/3, 2, 1r/6, 3])
+  data("floats", [0.1] * 20)
+  data("mixed", [1, 1r/2, 0.1, 2**70, 3])
+  data("complex", [1, Complex(0, 1), 2.5])
+  def test_cumsum(ary)
+    assert_equal(prefix_sums(ary), ary.cumsum)
+    assert_equal(prefix_sums(ary), ary.each.cumsum)
+    assert_equal(prefix_sums(ary, 0.0), ary.cumsum(0.0))
+    assert_equal(ary.each.sum, ary.cumsum.last)
+  end
+
+  def test_kahan
+    ary = [0.1] * 10
+    assert_equal(prefix_sums(ary), ary.cumsum)
+    assert_equal(1.0, ary.cumsum.last)
+  end
+
+  def test_block
+    assert_equal([2, 6, 12], [1, 2, 3].cumsum { |x| x * 2 })
+    assert_equal([1, 4, 9], (1..3).cumsum { |x| 2 * x - 1 })
+    assert_equal([2, 8], [1, 2].cumprod { |x| x * 2 })
+  end
+
+  def test_skip_na
+    ary = [1, nil, 2.5, Float::NAN, 3]
+    result = ary.cumsum(skip_na: true)
+    assert_equal([1, nil, 3.5], result[0, 3])
+    assert_predicate(result[3], :nan?)
+    assert_equal(6.5, result[4])
+    assert_raise(TypeError) do
+      ary.cumsum
+    end
+    assert_equal([2, nil, 6], [2, nil, 3].cumprod(skip_na: true))
+  end
+
+  def test_cumprod
+    assert_equal([1, 2, 6, 24], [1, 2, 3, 4].cumprod)
+    assert_equal([2**40, 2**80, 2**120], ([2**40] * 3).cumprod)
+    assert_equal([0.5, 0.25, 0.125], [0.5, 0.5, 0.5].cumprod)
+    assert_equal([1r/2, 1r/6], [1r/2, 1r/3].cumprod)
+    assert_equal([2, 6], [1, 3].cumprod(2))
+    assert_equal([1, 2, 6], (1..3).cumprod)
+  end
+
+  def test_empty
+    assert_equal([], [].cumsum)
+    assert_equal([], [].cumprod)
+    assert_equal([], [].each.cumsum)
+  end
+end
@@ -0,0 +1,81 @@
+class DescribeTest < Test::Unit::TestCase
+  def setup
+    @values = [3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9]
+    @ary = [nil, *@values, Float::NAN]
+  end
+
+  def assert_summary(summary, values, na_count, percentiles)
+    assert_equal({
+                   count: values.length,
+                   na_count: na_count,
+                   sum: values.sum,
+                   mean: values.mean,
+                   variance: values.variance,
+                   min: values.min,
+                   max: values.max,
+                   percentiles: percentiles.zip(values.percentile(percentiles).map(&:to_f)).to_h,
+                 },
+                 summary.to_h)
+  end
+
+  sub_test_case("Array#describe") do
+    def test_default_percentiles
+      assert_summary(@ary.describe, @values, 2, [25, 50, 75])
+    end
+
+    def test_percentiles
+      qs = [0, 10, 33.3, 50, 99, 100]
+      assert_summary(@ary.describe(percentiles: qs), @values, 2, qs)
+    end
+
+    def test_float_values
+      values = @values.map {|x| x * 1.5 }
+      assert_summary(values.describe, values, 0, [25, 50, 75])
+    end
+
+    def test_exact_sum
+      values = [1r/3, 2**80, 1r/6, -(2**80), 1]
+      assert_equal(values.sum, values.describe.sum)
+      assert_equal(3r/2, values.describe.sum)
+      assert_equal(values.sum, values.each.describe.sum)
+      values = [1r/3, 2**64, 0.5, 1]
+      assert_equal(values.sum, values.describe.sum)
+      assert_kind_of(Float, values.describe.sum)
+    end
+
+    def test_block
+      assert_equal(@values.map {|x| x * 2 }.describe, @values.describe {|x| x * 2 })
+    end
+
+    def test_frozen
+      summary = @ary.describe
+      assert_predicate(summary, :frozen?)
+      assert_predicate(summary.percentiles, :frozen?)
+      assert_equal(Math.sqrt(summary.variance), summary.stdev)
+    end
+
+    def test_empty
+      summary = [nil].describe
+      assert_equal([0, 1, 0, 0.0, nil, nil],
+                   summary.to_a.values_at(0, 1, 2, 3, 5, 6))
+      assert_predicate(summary.variance, :nan?)
+      assert_predicate(summary.percentiles[50], :nan?)
+    end
+
+    def test_percentile_out_of_bounds
+      assert_raise(ArgumentError) { @ary.describe(percentiles: [101]) }
+      assert_raise(ArgumentError) { @ary.describe(percentiles: [-1]) }
+    end
+  end
+
+  sub_test_case("Enumerable#describe") do
+    def test_default_percentiles
+      assert_summary(@ary.each.describe, @values, 2, [25, 50, 75])
+    end
+
+    def test_range
+      assert_equal((1..100).to_a.describe(percentiles: [5, 95]),
+                   (1..100).describe(percentiles: [5, 95]))
+    end
+  end
+end
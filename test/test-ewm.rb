@@ -0,0 +1,112 @@
+class EWMTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def naive(ary, alpha)
+    mean = var = nil
+    ary.map do |x|
+      unless x.nil? || x.to_f.nan?
+        if mean.nil?
+          mean, var = x.to_f, 0.0
+        else
+          diff = x - mean
+          mean += alpha * diff
+          var = (1 - alpha) * (var + alpha * diff * diff)
+        end
+      end
+      [mean || Float::NAN, var || Float::NAN]
+    end.transpose
+  end
+
+  def assert_series(expected, actual)
+    assert_equal(expected.size, actual.size)
+    expected.zip(actual).each_with_index do |(e, a), i|
+      if e.nan?
+        assert_predicate(a, :nan?, "at #{i}")
+      else
+        assert_in_delta(e, a, 1e-12, "at #{i}")
+      end
+    end
+  end
+
+  def setup
+    super
+    @ary = Array.new(100) { rand * 10 }
+  end
+
+  def test_ewm
+    means, vars = naive(@ary, 0.3)
+    assert_series(means, @ary.ewm_mean(alpha: 0.3))
+    assert_series(vars, @ary.ewm_variance(alpha: 0.3))
+  end
+
+  def test_span_and_halflife
+    assert_series(@ary.ewm_mean(alpha: 2 / 10.0), @ary.ewm_mean(span: 9))
+    assert_series(@ary.ewm_mean(alpha: 0.5), @ary.ewm_mean(halflife: 1))
+    assert_series(@ary.ewm_variance(alpha: 1 - Math.exp(-Math.log(2) / 3.5)),
+                  @ary.ewm_variance(halflife: 3.5))
+    assert_series(@ary.map(&:to_f), @ary.ewm_mean(alpha: 1))
+  end
+
+  def test_na
+    ary = [nil, 1, Float::NAN, 3, nil, 5]
+    means, vars = naive(ary, 0.5)
+    assert_series(means, ary.ewm_mean(alpha: 0.5))
+    assert_series(vars, ary.ewm_variance(alpha: 0.5))
+    assert_equal([], [].ewm_mean(alpha: 0.5))
+  end
+
+  def test_block
+    rows = [nil, 1, 2.5, nil, 4].map { |x| { v: x } }
+    values = rows.map { |r| r[:v] }
+    assert_series(values.ewm_mean(alpha: 0.4), rows.ewm_mean(alpha: 0.4) { |r| r[:v] })
+    assert_series(values.ewm_variance(span: 3), rows.ewm_variance(span: 3) { |r| r[:v] })
+  end
+
+  def test_large_array
+    EnumerableStatistics.gvl_release_threshold = 0
+    assert_series(naive(@ary, 0.1)[0], @ary.ewm_mean(alpha: 0.1))
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) { @ary.ewm_mean }
+    assert_raise(ArgumentError) { @ary.ewm_mean(alpha: 0.5, span: 3) }
+    assert_raise(ArgumentError) { @ary.ewm_mean(alpha: 0) }
+    assert_raise(ArgumentError) { @ary.ewm_mean(alpha: 1.5) }
+    assert_raise(ArgumentError) { @ary.ewm_mean(halflife: 0) }
+    assert_raise(ArgumentError) { @ary.ewm_mean(span: 0.5) }
+    assert_raise(ArgumentError) { @ary.ewm_mean(window: 3) }
+  end
+
+  def test_accumulator
+    acc = EnumerableStatistics::EWMAccumulator.new(alpha: 0.3)
+    assert_equal(0.3, acc.alpha)
+    assert_equal(0, acc.count)
+    assert_predicate(acc.mean, :nan?)
+    assert_predicate(acc.variance, :nan?)
+
+    means, vars = naive(@ary, 0.3)
+    @ary.each_with_index do |x, i|
+      assert_same(acc, acc.update(x))
+      assert_in_delta(means[i], acc.mean, 1e-12)
+      assert_in_delta(vars[i], acc.variance, 1e-12)
+      assert_in_delta(Math.sqrt(vars[i]), acc.stdev, 1e-12)
+    end
+    assert_equal(100, acc.count)
+
+    acc << nil << Float::NAN
+    assert_equal(100, acc.count)
+
+    copy = acc.dup
+    copy << 100
+    assert_equal(100, acc.count)
+    assert_equal(101, copy.count)
+  end
+
+  def test_accumulator_options
+    assert_equal(0.2, EnumerableStatistics::EWMAccumulator.new(span: 9).alpha)
+    assert_equal(0.5, EnumerableStatistics::EWMAccumulator.new(halflife: 1).alpha)
+    assert_raise(ArgumentError) { EnumerableStatistics::EWMAccumulator.new }
+    assert_raise(FrozenError) { EnumerableStatistics::EWMAccumulator.new(alpha: 0.5).freeze << 1 }
+    assert_raise(TypeError) { EnumerableStatistics::EWMAccumulator.new(alpha: 0.5) << "a" }
+  end
+end
@@ -0,0 +1,71 @@
+class ExactSumTest < Test::Unit::TestCase
+  def exact_sum(ary)
+    ary.map(&:to_r).sum
+  end
+
+  # Rational#to_f does not always round to the nearest
+  def nearest(r)
+    f = r.to_f
+    [f.prev_float, f, f.next_float].min_by { |x| (x.to_r - r).abs }
+  end
+
+  data("tenths", [0.1] * 10)
+  data("cancellation", [1e100, 1.0, -1e100])
+  data("tiny and huge", [1e-300, 1e300, 1e-300, -1e300])
+  data("half even", [1.0, 2.0**-53, 2.0**-106])
+  data("random magnitudes", Array.new(1000) { |i| Math.sin(i) * 10.0**(i % 41 - 20) })
+  data("with integers", [0.5, 2**62, 2**62, -3, 0.25])
+  def test_sum(ary)
+    expected = nearest(exact_sum(ary))
+    assert_equal(expected, ary.sum(exact: true))
+    assert_equal(expected, ary.each.sum(exact: true))
+    assert_equal(nearest(exact_sum(ary) + 10), ary.sum(10, exact: true))
+  end
+
+  data("tenths", [0.1] * 10)
+  data("random magnitudes", Array.new(1000) { |i| Math.sin(i) * 10.0**(i % 41 - 20) })
+  def test_mean(ary)
+    expected = nearest(exact_sum(ary) / ary.size)
+    assert_equal(expected, ary.mean(exact: true))
+    assert_equal(expected, ary.each.mean(exact: true))
+  end
+
+  def test_half_even
+    assert_equal(1.0.next_float, [1.0, 2.0**-53, 2.0**-106].sum(exact: true))
+    assert_equal(1.0, [1.0, 2.0**-53].sum(exact: true))
+    assert_equal(1.0.next_float.next_float, [1.0.next_float, 2.0**-53].sum(exact: true))
+  end
+
+  def test_exact_types
+    assert_equal(6, [1, 2, 3].sum(exact: true))
+    assert_equal(Rational(4, 3), [1r/3, 1].sum(exact: true))
+    assert_equal(nearest(0.1r + 1r/3), [0.1, 1r/3].sum(exact: true))
+    assert_equal(Rational(5, 2), (1..4).mean(exact: true))
+    assert_equal(Rational(0), [].each.mean(exact: true))
+  end
+
+  def test_variance
+    ary = [0.1, 0.2, 0.3, 0.4]
+    mean = exact_sum(ary) / ary.size
+    variance = ary.map { |x| (x.to_r - mean)**2 }.sum / (ary.size - 1)
+    assert_equal([nearest(mean), nearest(variance)], ary.mean_variance(exact: true))
+    assert_equal(nearest(variance), ary.variance(exact: true))
+  end
+
+  def test_special_values
+    assert_equal(Float::INFINITY, [Float::INFINITY, 1.0].sum(exact: true))
+    assert_predicate([Float::INFINITY, -Float::INFINITY].sum(exact: true), :nan?)
+    assert_predicate([Float::NAN, 1.0].sum(exact: true), :nan?)
+    assert_equal(1.0, [Float::NAN, 1.0].sum(exact: true, skip_na: true))
+    assert_equal(Float::INFINITY, [1.0, Float::INFINITY].mean(exact: true))
+    assert_predicate([1.0, Float::INFINITY].variance(exact: true), :nan?)
+  end
+
+  def test_errors
+    assert_raise(TypeError) { [1.0, "a"].sum(exact: true) }
+    assert_raise(TypeError) { [1.0, Complex(1, 1)].each.sum(exact: true) }
+    assert_raise(RangeError) { [1e308, 1e308, -1e308].sum(exact: true) }
+    assert_raise(ArgumentError) { (1..3).mean(foo: 1) }
+    assert_raise(ArgumentError) { (1..3).mean(exact: true, algorithm: :kahan, foo: 1) }
+  end
+end
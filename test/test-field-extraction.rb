@@ -0,0 +1,94 @@
+class FieldExtractionTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  Row = Struct.new(:name, :latency)
+
+  def setup
+    super
+    @latencies = [3, 1.5, 4, 1, 5.5, 9, 2, 6]
+    @hashes = @latencies.map.with_index { |x, i| { name: "r#{i}", latency: x } }
+    @structs = @latencies.map.with_index { |x, i| Row.new("r#{i}", x) }
+    @arrays = @latencies.map.with_index { |x, i| ["r#{i}", x] }
+  end
+
+  def rows
+    [["hashes", @hashes, { key: :latency }],
+     ["structs", @structs, { key: :latency }],
+     ["struct with string key", @structs, { key: "latency" }],
+     ["arrays", @arrays, { index: 1 }],
+     ["arrays with negative index", @arrays, { index: -1 }]]
+  end
+
+  def test_sum_mean_variance
+    rows.each do |label, ary, opts|
+      assert_equal(@latencies.sum, ary.sum(**opts), label)
+      assert_equal(@latencies.sum(10), ary.sum(10, **opts), label)
+      assert_equal(@latencies.mean, ary.mean(**opts), label)
+      assert_equal(@latencies.variance, ary.variance(**opts), label)
+      assert_equal(@latencies.variance(population: true),
+                   ary.variance(population: true, **opts), label)
+      assert_equal(@latencies.stdev, ary.stdev(**opts), label)
+      assert_equal(@latencies.mean_variance, ary.mean_variance(**opts), label)
+      assert_equal(@latencies.mean_stdev, ary.mean_stdev(**opts), label)
+    end
+  end
+
+  def test_percentile
+    rows.each do |label, ary, opts|
+      assert_equal(@latencies.percentile(50), ary.percentile(50, **opts), label)
+      assert_equal(@latencies.percentile([10, 90]), ary.percentile([10, 90], **opts), label)
+    end
+    assert_raise(ArgumentError) do
+      @hashes.percentile(50, foo: 1)
+    end
+  end
+
+  def test_histogram
+    rows.each do |label, ary, opts|
+      assert_equal(@latencies.histogram, ary.histogram(**opts), label)
+      assert_equal(@latencies.histogram(3, closed: :right),
+                   ary.histogram(3, closed: :right, **opts), label)
+    end
+  end
+
+  def test_value_counts
+    ary = [{ a: 1 }, { a: 2 }, { a: 1 }, { b: 1 }]
+    assert_equal({ 1 => 2, 2 => 1 }, ary.value_counts(key: :a))
+    assert_equal({ 1 => 2, 2 => 1, nil => 1 }, ary.value_counts(key: :a, dropna: false))
+    assert_equal({ 2 => 1, 1 => 1 }, [[1, 2], [3, 1]].value_counts(index: 1, ascending: true))
+  end
+
+  def test_missing_fields
+    ary = [{ x: 1.0 }, { x: 3.0 }, { y: 2.0 }]
+    assert_raise(TypeError) do
+      ary.mean(key: :x)
+    end
+    assert_equal(2.0, ary.mean(key: :x, skip_na: true))
+    assert_equal(2.0, [[1.0], [3.0, 2.0], [0, 0]].sum(index: 1, skip_na: true))
+  end
+
+  def test_with_block
+    assert_equal(@latencies.sum { |x| x * 2 }, @hashes.sum(key: :latency) { |x| x * 2 })
+  end
+
+  def test_large_array
+    EnumerableStatistics.gvl_release_threshold = 0
+    values = Array.new(1000) { rand }
+    ary = values.map { |x| { v: x } }
+    assert_equal(values.sum, ary.sum(key: :v))
+    assert_equal(values.mean_variance, ary.mean_variance(key: :v))
+    assert_equal(values.percentile(25), ary.percentile(25, key: :v))
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) do
+      @hashes.mean(key: :latency, index: 0)
+    end
+    assert_raise(TypeError) do
+      @arrays.mean(index: "1")
+    end
+    assert_raise(NameError) do
+      @structs.mean(key: :unknown)
+    end
+  end
+end
@@ -0,0 +1,137 @@
+class GroupStatsTest < Test::Unit::TestCase
+  Request = Struct.new(:endpoint, :latency)
+
+  class Record
+    attr_reader :endpoint, :latency
+
+    def initialize(endpoint, latency)
+      @endpoint = endpoint
+      @latency = latency
+    end
+  end
+
+  def setup
+    @requests = Array.new(200) do |i|
+      Request.new(%w[/users /items /orders][i % 3], (i * 7 % 31) + 0.5)
+    end
+  end
+
+  def expected_stats(values, population: false)
+    {
+      count: values.size,
+      mean: values.mean,
+      variance: values.variance(population: population),
+      min: values.min,
+      max: values.max,
+    }
+  end
+
+  def assert_stats(expected, actual)
+    assert_equal(expected.keys, actual.keys)
+    expected.each do |group, stats|
+      assert_equal(stats.keys, actual[group].keys)
+      stats.each do |name, value|
+        if value.is_a?(Float) && value.nan?
+          assert_predicate(actual[group][name], :nan?)
+        else
+          assert_in_delta(value, actual[group][name], 1e-9, "#{group} #{name}")
+        end
+      end
+    end
+  end
+
+  def test_group_stats
+    expected = @requests.group_by(&:endpoint).transform_values do |rows|
+      expected_stats(rows.map(&:latency))
+    end
+    assert_stats(expected, @requests.group_stats(by: :endpoint, value: :latency))
+    assert_stats(expected, @requests.each.group_stats(by: :endpoint, value: :latency))
+    assert_stats(expected, @requests.group_stats(by: :endpoint.to_proc, value: :latency.to_proc))
+  end
+
+  def test_method_fields
+    records = @requests.map { |r| Record.new(r.endpoint, r.latency) }
+    expected = records.group_by(&:endpoint).transform_values do |rows|
+      expected_stats(rows.map(&:latency))
+    end
+    assert_stats(expected, records.group_stats(by: :endpoint, value: :latency))
+    assert_stats(expected, records.each.group_stats(by: :endpoint, value: :latency))
+  end
+
+  def test_method_fields_of_indexable_items
+    assert_equal({ true => { count: 2, sum: 4 }, false => { count: 1, sum: 2 } },
+                 [1, 2, 3].group_stats(by: :odd?, stats: [:count, :sum]))
+    rows = [["a", 1.0], ["b", 2.0], ["a", 4.0]]
+    assert_equal({ "a" => { mean: 2.5 }, "b" => { mean: 2.0 } },
+                 rows.group_stats(by: :first, value: :last, stats: [:mean]))
+  end
+
+  def test_stats
+    rows = [{ g: :a, v: 1 }, { g: :b, v: 2 }, { g: :a, v: 3 }, { g: :a, v: 5 }]
+    assert_equal({ a: { sum: 9, count: 3 }, b: { sum: 2, count: 1 } },
+                 rows.group_stats(by: :g, value: :v, stats: [:sum, :count]))
+    result = rows.group_stats(by: :g, value: :v, stats: :stdev)
+    assert_equal(2.0, result[:a][:stdev])
+    assert_predicate(result[:b][:stdev], :nan?)
+    assert_in_delta(Math.sqrt(8.0 / 3),
+                    rows.group_stats(by: :g, value: :v, stats: [:stdev], population: true)[:a][:stdev],
+                    1e-12)
+  end
+
+  def test_result_types
+    rows = [[:a, 1], [:a, 2**70], [:a, -3], [:b, 1.5], [:b, 2], [:c, 1r], [:c, 3]]
+    result = rows.group_stats(by: 0, value: 1, stats: [:sum, :min, :max, :mean])
+    assert_equal({ sum: 2**70 - 2, min: -3, max: 2**70, mean: (2**70 - 2) / 3.0 }, result[:a])
+    assert_kind_of(Integer, result[:a][:sum])
+    assert_kind_of(Integer, result[:a][:min])
+    assert_equal([3.5, 1.5, 2], result[:b].values_at(:sum, :min, :max))
+    assert_kind_of(Float, result[:b][:sum])
+    assert_kind_of(Integer, result[:b][:max])
+    assert_equal([4.0, 1r, 3], result[:c].values_at(:sum, :min, :max))
+    assert_kind_of(Rational, result[:c][:min])
+    nan = [1, Float::NAN, 0].group_stats(by: ->(_) { :x }, stats: [:min, :max])[:x]
+    assert_predicate(nan[:min], :nan?)
+    assert_predicate(nan[:max], :nan?)
+  end
+
+  def test_without_value
+    result = (1..10).group_stats(by: ->(x) { x.even? }, stats: [:count, :sum, :min, :max])
+    assert_equal({ false => { count: 5, sum: 25, min: 1, max: 9 },
+                   true => { count: 5, sum: 30, min: 2, max: 10 } },
+                 result)
+  end
+
+  def test_array_rows
+    rows = [["a", 1.0], ["b", 2.0], ["a", 4.0]]
+    assert_equal({ "a" => { mean: 2.5 }, "b" => { mean: 2.0 } },
+                 rows.group_stats(by: 0, value: 1, stats: [:mean]))
+  end
+
+  def test_na
+    rows = [[:a, 1.0], [:a, nil], [:a, 3.0], [:b, nil]]
+    assert_equal({ a: { count: 2, mean: 2.0 } },
+                 rows.group_stats(by: 0, value: 1, stats: [:count, :mean], skip_na: true))
+    result = [[:a, 1.0], [:a, Float::NAN], [:a, 3.0]].group_stats(by: 0, value: 1, stats: [:min, :max])
+    assert_predicate(result[:a][:min], :nan?)
+    assert_predicate(result[:a][:max], :nan?)
+    assert_raise(TypeError) do
+      rows.group_stats(by: 0, value: 1)
+    end
+  end
+
+  def test_empty
+    assert_equal({}, [].group_stats(by: :x))
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) do
+      [1].group_stats
+    end
+    assert_raise(ArgumentError) do
+      [1].group_stats(by: ->(x) { x }, stats: [:median])
+    end
+    assert_raise(TypeError) do
+      [1].group_stats(by: ->(x) { x }, stats: ["mean"])
+    end
+  end
+end
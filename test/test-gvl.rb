@@ -0,0 +1,46 @@
+class GVLReleaseTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def with_and_without_gvl_release
+    EnumerableStatistics.gvl_release_threshold = nil
+    expected = yield
+    EnumerableStatistics.gvl_release_threshold = 0
+    actual = yield
+    # compare the inspected strings so that NaN results can be compared
+    assert_equal(expected.inspect, actual.inspect)
+  end
+
+  def test_threshold
+    assert_equal(100_000, @threshold)
+    EnumerableStatistics.gvl_release_threshold = 10
+    assert_equal(10, EnumerableStatistics.gvl_release_threshold)
+    EnumerableStatistics.gvl_release_threshold = nil
+    assert_nil(EnumerableStatistics.gvl_release_threshold)
+    assert_raise(ArgumentError) do
+      EnumerableStatistics.gvl_release_threshold = -1
+    end
+  end
+
+  data("floats", Array.new(1000) { rand })
+  data("floats and integers", Array.new(1000) { |i| i.even? ? rand(2) : rand })
+  data("floats with NaN", Array.new(1000) { rand }.insert(500, Float::NAN))
+  data("odd length", Array.new(999) { rand })
+  def test_same_results(ary)
+    with_and_without_gvl_release do
+      [
+        ary.sum,
+        ary.sum(0.5),
+        ary.sum(skip_na: true),
+        ary.mean(skip_na: true),
+        ary.mean_variance,
+        ary.variance(skip_na: true),
+        ary.moments(skip_na: true),
+        ary.histogram(edges: [0.0, 0.25, 0.5, 0.75, 1.0]).weights,
+        ary.histogram(edges: [0.0, 0.25, 0.5, 0.75, 1.0], closed: :right).weights,
+        ary.median,
+        ary.percentile(37),
+        ary.percentile([0, 25, 50, 75, 100]),
+      ]
+    end
+  end
+end
@@ -0,0 +1,48 @@
+class HashValuesTest < Test::Unit::TestCase
+  def setup
+    @hash = Array.new(100) { |i| [:"k#{i}", i.even? ? i : i + 0.5] }.to_h
+  end
+
+  def test_sum_values
+    assert_equal(@hash.values.sum, @hash.sum_values)
+    assert_equal(@hash.values.sum(10), @hash.sum_values(10))
+    assert_equal(30, { a: 1, b: 2, c: 3, d: 4 }.sum_values { |k, v| v * v })
+    assert_equal(0, {}.sum_values)
+    assert_equal(3, { a: 1, b: nil, c: 2 }.sum_values(skip_na: true))
+    assert_equal(3r/2, { a: 1r/2, b: 1 }.sum_values)
+  end
+
+  def test_mean_values
+    assert_equal(@hash.values.mean, @hash.mean_values)
+    assert_equal(2.5, { a: 1, b: 2, c: 3, d: 4 }.mean_values)
+    assert_equal(2.0, { a: 1, b: 2 }.mean_values { |k, v| k == :a ? v : v + 1 })
+    assert_equal(0.0, {}.mean_values)
+    assert_equal(1.5, { a: 1, b: Float::NAN, c: 2 }.mean_values(skip_na: true))
+    assert_equal(Complex(1.5, 1.0), { a: Complex(1, 2), b: 2 }.mean_values)
+  end
+
+  def test_variance_values
+    assert_in_delta(@hash.values.variance, @hash.variance_values, 1e-12)
+    assert_in_delta(@hash.values.variance(population: true),
+                    @hash.variance_values(population: true), 1e-12)
+    assert_equal(2.0, { a: 1, b: 3 }.variance_values)
+    assert_equal(0.5, { a: 1, b: 2 }.variance_values { |k, v| v })
+    assert_predicate({ a: 1 }.variance_values, :nan?)
+    assert_equal(0.5, { a: 1, b: nil, c: 2 }.variance_values(skip_na: true))
+  end
+
+  def test_percentile_values
+    assert_equal(@hash.values.percentile(37), @hash.percentile_values(37))
+    assert_equal(@hash.values.percentile([0, 50, 100]), @hash.percentile_values([0, 50, 100]))
+    assert_equal(2.0, { "x" => 1, "yy" => 2, "zzz" => 3 }.percentile_values(50) { |k, v| k.size })
+    assert_raise(ArgumentError) do
+      {}.percentile_values(50)
+    end
+  end
+
+  def test_block_arguments
+    yielded = []
+    { a: 1, b: 2 }.sum_values { |*args| yielded << args; 0 }
+    assert_equal([[:a, 1], [:b, 2]], yielded)
+  end
+end
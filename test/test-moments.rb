@@ -0,0 +1,93 @@
+class MomentsTest < Test::Unit::TestCase
+  def naive_moments(ary)
+    n = ary.length
+    m = ary.sum / n.to_f
+    m2, m3, m4 = [2, 3, 4].map {|k| ary.sum {|x| (x - m)**k } }
+    g1 = Math.sqrt(n) * m3 / m2**1.5
+    g2 = n * m4 / m2**2 - 3
+    {
+      mean: m,
+      variance: m2 / (n - 1),
+      skewness: g1 * Math.sqrt(n * (n - 1)) / (n - 2),
+      kurtosis: (n - 1.0) / ((n - 2) * (n - 3)) * ((n + 1) * g2 + 6),
+      population_skewness: g1,
+      population_kurtosis: g2,
+    }
+  end
+
+  def setup
+    @ary = [1.0, 2, 3, 4, 10.5, 7, Rational(11, 5)]
+    @expected = naive_moments(@ary)
+  end
+
+  sub_test_case("Array") do
+    def test_skewness
+      assert_in_delta(@expected[:skewness], @ary.skewness, 1e-12)
+      assert_in_delta(@expected[:population_skewness], @ary.skewness(population: true), 1e-12)
+    end
+
+    def test_kurtosis
+      assert_in_delta(@expected[:kurtosis], @ary.kurtosis, 1e-12)
+      assert_in_delta(@expected[:population_kurtosis], @ary.kurtosis(population: true), 1e-12)
+    end
+
+    def test_moments
+      result = @ary.moments
+      assert_equal(4, result.length)
+      @expected.values_at(:mean, :variance, :skewness, :kurtosis).zip(result) do |e, a|
+        assert_in_delta(e, a, 1e-12)
+      end
+    end
+
+    def test_moments_upto
+      assert_equal(@ary.mean_variance, @ary.moments(upto: 2))
+      assert_equal([@ary.mean], @ary.moments(upto: 1))
+      assert_equal(3, @ary.moments(upto: 3).length)
+      assert_raise(ArgumentError) { @ary.moments(upto: 0) }
+      assert_raise(ArgumentError) { @ary.moments(upto: 5) }
+    end
+
+    def test_moments_with_block
+      assert_equal([2, 4, 6, 9].moments, [1, 2, 3, 4.5].moments {|x| 2*x })
+    end
+
+    def test_moments_skip_na
+      assert_equal(@ary.moments, [nil, *@ary, Float::NAN].moments(skip_na: true))
+      assert_raise(TypeError) { [nil, *@ary].skewness }
+    end
+
+    def test_too_few_values
+      assert_equal([0.0, true, true, true], [].moments.then {|m, *r| [m, *r.map(&:nan?)] })
+      assert_equal([3.0, true, true, true], [3].moments.then {|m, *r| [m, *r.map(&:nan?)] })
+      assert_predicate([1, 2].skewness, :nan?)
+      assert_predicate([1, 2, 3].kurtosis, :nan?)
+    end
+  end
+
+  sub_test_case("Enumerable") do
+    def test_skewness
+      assert_in_delta(@expected[:skewness], @ary.each.skewness, 1e-12)
+      assert_in_delta(@expected[:population_skewness], @ary.each.skewness(population: true), 1e-12)
+    end
+
+    def test_kurtosis
+      assert_in_delta(@expected[:kurtosis], @ary.each.kurtosis, 1e-12)
+      assert_in_delta(@expected[:population_kurtosis], @ary.each.kurtosis(population: true), 1e-12)
+    end
+
+    def test_moments
+      assert_equal(@ary.moments, @ary.each.moments)
+      assert_equal(@ary.moments(upto: 3, population: true),
+                   @ary.each.moments(upto: 3, population: true))
+    end
+
+    def test_moments_skip_na
+      assert_equal(@ary.moments, [nil, *@ary].each.moments(skip_na: true))
+    end
+
+    def test_hash_moments_with_block
+      hash = { a: 1, b: 2, c: 4, d: 8 }
+      assert_equal(hash.values.moments, hash.moments {|_k, v| v })
+    end
+  end
+end
@@ -0,0 +1,101 @@
+class NADetectionTest < Test::Unit::TestCase
+  class Missing
+    def nan?
+      true
+    end
+
+    def coerce(other)
+      [other, 0]
+    end
+  end
+
+  class Value
+    attr_reader :x
+
+    def initialize(x)
+      @x = x
+    end
+
+    def nan?
+      x.nil?
+    end
+
+    def <=>(other)
+      x <=> other.x
+    end
+
+    def +(other)
+      Value.new(x + (other.is_a?(Value) ? other.x : other))
+    end
+
+    def coerce(other)
+      [Value.new(other), self]
+    end
+  end
+
+  def test_skip_na_classes
+    ary = [1, 2.5, nil, Float::NAN, Missing.new, 3r, 4]
+    assert_equal(10.5, ary.sum(skip_na: true))
+    assert_equal(2.625, ary.mean(skip_na: true))
+    assert_equal(10.5, ary.each.sum(skip_na: true))
+    assert_equal([1, 3.5, nil, Float::NAN, ary[4], 6.5, 10.5].map(&:to_s), ary.cumsum(skip_na: true).map(&:to_s))
+  end
+
+  def test_nan_p_depends_on_value
+    ary = [Value.new(1), Value.new(nil), Value.new(2)]
+    assert_equal(1, ary.value_counts(dropna: false)[nil])
+    assert_equal(3, ary.sum(Value.new(0), skip_na: true).x)
+  end
+
+  def test_singleton_nan_p
+    x = 1.0
+    y = Object.new
+    def y.nan?
+      true
+    end
+    assert_equal({1.0 => 2}, [x, y, x].value_counts)
+  end
+
+  def test_redefined_between_calls
+    klass = Class.new(Numeric) do
+      def coerce(other)
+        [other, 1.0]
+      end
+    end
+    ary = [1.0, klass.new, 2.0]
+    assert_equal(4.0, ary.sum(skip_na: true))
+    klass.class_eval do
+      def nan?
+        true
+      end
+    end
+    assert_equal(3.0, ary.sum(skip_na: true))
+  end
+
+  def test_percentile_with_na
+    ary = [3, nil, 1, 2]
+    assert_predicate(ary.percentile(50), :nan?)
+    assert_predicate(ary.median, :nan?)
+    ary = [3, Value.new(nil), 1, 2].map { |v| v.is_a?(Value) ? v : Value.new(v) }
+    assert_predicate(ary.percentile(50), :nan?)
+    ary = [3, 1, 2].map { |v| Value.new(v) }
+    assert_equal(2, ary.median.x)
+  end
+
+  def test_percentile_with_na_does_not_sort
+    compared = 0
+    ary = [3, 1, 2].map { |v| Value.new(v) } + [Value.new(nil)]
+    ary.each { |v| v.define_singleton_method(:<=>) { |o| compared += 1; super(o) } }
+    assert_predicate(ary.percentile(50), :nan?)
+    assert_equal([Float::NAN, Float::NAN].inspect, ary.percentile([25, 75]).inspect)
+    assert_predicate(ary.median, :nan?)
+    assert_equal(0, compared)
+  end
+
+  def test_rolling_and_group_stats
+    ary = [1.0, Missing.new, 3.0]
+    assert_equal([1.0, 1.0, 3.0], ary.rolling_sum(2, min_periods: 1))
+    stats = [[:a, 1.0], [:a, Missing.new], [:a, 3.0]].group_stats(by: ->(r) { r[0] }, value: ->(r) { r[1] }, stats: [:count, :mean], skip_na: true)
+    assert_equal({ a: { count: 2, mean: 2.0 } }, stats)
+  end
+end
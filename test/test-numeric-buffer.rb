@@ -0,0 +1,134 @@
+class NumericBufferTest < Test::Unit::TestCase
+  NumericBuffer = EnumerableStatistics::NumericBuffer
+
+  def setup
+    @values = Array.new(1000) { |i| i.even? ? rand(10) : rand }
+    @buf = NumericBuffer.new(@values)
+  end
+
+  def test_new
+    assert_predicate(@buf, :frozen?)
+    assert_equal(1000, @buf.size)
+    assert_equal(@values.map(&:to_f), @buf.to_a)
+    assert_equal([0.5, 1.0], NumericBuffer.new([1/2r, 1]).to_a)
+    assert_raise(TypeError) do
+      NumericBuffer.new(["1"])
+    end
+  end
+
+  def test_aref
+    buf = NumericBuffer.new([1, 2, 3])
+    assert_equal([1.0, 3.0, 3.0, nil, nil], [buf[0], buf[2], buf[-1], buf[3], buf[-4]])
+  end
+
+  def test_slice
+    slice = @buf.slice(100, 200)
+    assert_predicate(slice, :frozen?)
+    assert_equal(@values[100, 200].map(&:to_f), slice.to_a)
+    assert_equal(@values[990, 10].map(&:to_f), @buf.slice(-10, 100).to_a)
+    assert_equal([], @buf.slice(1000, 1).to_a)
+    assert_equal(@values[150, 10].map(&:to_f), slice.slice(50, 10).to_a)
+    assert_raise(IndexError) do
+      @buf.slice(1001, 1)
+    end
+  end
+
+  def test_subclass
+    klass = Class.new(NumericBuffer) do
+      def doubled_sum
+        sum(skip_na: true) * 2
+      end
+    end
+    buf = klass.new([1, nil, 3], validity: [0b101].pack("C"))
+    assert_instance_of(klass, buf)
+    assert_equal(8.0, buf.doubled_sum)
+    slice = buf.slice(1, 2)
+    assert_instance_of(klass, slice)
+    assert_equal([nil, 3.0], slice.to_a)
+    assert_equal(6.0, slice.doubled_sum)
+  end
+
+  def test_statistics
+    assert_in_delta(@values.sum, @buf.sum, 1e-9)
+    assert_in_delta(@values.mean, @buf.mean, 1e-12)
+    assert_in_delta(@values.variance, @buf.variance, 1e-12)
+    assert_in_delta(@values.variance(population: true), @buf.variance(population: true), 1e-12)
+    assert_in_delta(@values.stdev, @buf.stdev, 1e-12)
+    assert_equal(@values.mean_variance.map { |x| x.round(12) },
+                 @buf.mean_variance.map { |x| x.round(12) })
+    assert_equal(@values.median, @buf.median)
+    assert_equal(@values.percentile([10, 50, 90]), @buf.percentile([10, 50, 90]))
+    assert_equal(@values.histogram.to_h, @buf.histogram.to_h)
+    assert_equal(@values.histogram(5, closed: :right).to_h, @buf.histogram(5, closed: :right).to_h)
+    assert_equal(@values.histogram(edges: [0, 1, 5, 10]).to_h, @buf.histogram(edges: [0, 1, 5, 10]).to_h)
+  end
+
+  def test_empty
+    buf = NumericBuffer.new([])
+    assert_equal([0.0, 0.0], [buf.sum, buf.mean])
+    assert_predicate(buf.variance, :nan?)
+    assert_predicate(buf.median, :nan?)
+    assert_raise(ArgumentError) do
+      buf.percentile(50)
+    end
+  end
+
+  def test_na
+    buf = NumericBuffer.new([1, nil, 2, Float::NAN, 6])
+    assert_predicate(buf.sum, :nan?)
+    assert_equal(9.0, buf.sum(skip_na: true))
+    assert_equal(3.0, buf.mean(skip_na: true))
+    assert_equal([3.0, 7.0], buf.mean_variance(skip_na: true))
+    assert_predicate(buf.median, :nan?)
+    assert_predicate(buf.percentile(50), :nan?)
+    assert_equal([1, 1, 0, 1], buf.histogram(edges: [0, 2, 3, 4, 10]).weights)
+  end
+
+  def pack_validity(valid)
+    valid.each_slice(8).map { |bits| bits.each_with_index.sum { |v, i| v ? 1 << i : 0 } }.pack("C*")
+  end
+
+  def test_validity
+    values = Array.new(1000) { rand }
+    valid = Array.new(1000) { |i| i / 64 % 3 == 0 || rand < 0.5 }
+    expected = values.zip(valid).map { |x, v| v ? x : nil }
+    buf = NumericBuffer.new(values, validity: pack_validity(valid))
+    assert_equal(expected, buf.to_a)
+    assert_equal([expected[1], nil], [buf[1], buf[valid.index(false)]])
+    assert_predicate(buf.sum, :nan?)
+    assert_in_delta(expected.sum(skip_na: true), buf.sum(skip_na: true), 1e-9)
+    assert_in_delta(expected.mean(skip_na: true), buf.mean(skip_na: true), 1e-12)
+    assert_in_delta(expected.variance(skip_na: true), buf.variance(skip_na: true), 1e-12)
+    assert_predicate(buf.variance, :nan?)
+    assert_predicate(buf.median, :nan?)
+    assert_equal(expected.compact.histogram.to_h, buf.histogram.to_h)
+    assert_equal(expected.value_counts, buf.value_counts)
+
+    slice = buf.slice(37, 500)
+    assert_equal(expected[37, 500], slice.to_a)
+    assert_in_delta(expected[37, 500].sum(skip_na: true), slice.sum(skip_na: true), 1e-9)
+  end
+
+  def test_validity_all_valid
+    values = Array.new(200) { rand }
+    buf = NumericBuffer.new(values, validity: "\xff".b * 25)
+    assert_equal(values, buf.to_a)
+    assert_equal(values.median, buf.median)
+    assert_equal(values.percentile(25), buf.slice(0, 200).percentile(25))
+  end
+
+  def test_validity_errors
+    assert_raise(ArgumentError) do
+      NumericBuffer.new([1] * 9, validity: "\xff")
+    end
+    assert_raise(TypeError) do
+      NumericBuffer.new([1], validity: 1)
+    end
+  end
+
+  def test_value_counts
+    buf = NumericBuffer.new([1, 2, 2, nil, 3], validity: [0b10110].pack("C"))
+    assert_equal({ 2.0 => 2, 3.0 => 1 }, buf.value_counts)
+    assert_equal(2, buf.value_counts(dropna: false)[nil])
+  end
+end
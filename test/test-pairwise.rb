@@ -0,0 +1,81 @@
+class PairwiseSumTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  # The pairwise summation with the blocks of 128 values in 8 lanes
+  def pairwise_sum(ary)
+    if ary.size <= 128
+      lanes = Array.new(8, 0.0)
+      n = ary.size / 8 * 8
+      ary[0, n].each_with_index { |x, i| lanes[i % 8] += x }
+      s = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]))
+      ary[n..-1].inject(s, :+)
+    else
+      m = (ary.size + 127) / 128 / 2 * 128
+      pairwise_sum(ary[0, m]) + pairwise_sum(ary[m..-1])
+    end
+  end
+
+  data("empty", [])
+  data("short", [0.1, 0.2, 0.3])
+  data("one block", Array.new(128) { |i| 0.1 * i })
+  data("blocks and a tail", Array.new(1000) { |i| Math.sin(i) * 10.0**(i % 7) })
+  data("integers", Array.new(300) { |i| i * 3 })
+  def test_sum(ary)
+    expected = pairwise_sum(ary.map(&:to_f))
+    assert_equal(expected, ary.sum(algorithm: :pairwise))
+    assert_equal(expected, ary.each.sum(algorithm: :pairwise))
+    assert_equal(10 + expected, ary.sum(10, algorithm: :pairwise))
+  end
+
+  def test_mean
+    ary = Array.new(1000) { |i| Math.cos(i) }
+    expected = pairwise_sum(ary) / 1000
+    assert_equal(expected, ary.mean(algorithm: :pairwise))
+    assert_equal(expected, ary.each.mean(algorithm: :pairwise))
+    assert_equal(0.0, [].mean(algorithm: :pairwise))
+  end
+
+  def test_precision
+    ary = [0.1] * 1_000_000
+    assert_in_delta(100_000.0, ary.sum(algorithm: :pairwise), 1e-9)
+    assert_operator((ary.inject(:+) - 100_000.0).abs, :>, 1e-7)
+  end
+
+  def test_skip_na
+    ary = [1.0, nil, 2, Float::NAN, 3.5]
+    assert_equal(6.5, ary.sum(skip_na: true, algorithm: :pairwise))
+    assert_equal(6.5 / 3, ary.mean(skip_na: true, algorithm: :pairwise))
+    assert_predicate([nil].mean(skip_na: true, algorithm: :pairwise), :nan?)
+    assert_raise(TypeError) do
+      ary.sum(algorithm: :pairwise)
+    end
+  end
+
+  def test_block_and_field
+    assert_equal(12.0, [1, 2, 3].sum(algorithm: :pairwise) { |x| x * 2 })
+    rows = [{ x: 1.5 }, { x: 2.5 }]
+    assert_equal(4.0, rows.sum(key: :x, algorithm: :pairwise))
+    assert_equal(2.0, rows.mean(key: :x, algorithm: :pairwise))
+  end
+
+  def test_invalid_options
+    assert_equal(6, [1, 2, 3].sum(algorithm: :kahan))
+    assert_raise(ArgumentError) { [1.0].sum(algorithm: :naive) }
+    assert_raise(ArgumentError) { [1.0].sum(algorithm: :pairwise, exact: true) }
+    assert_raise(ArgumentError) { [1.0].mean(algorithm: :pairwise, weights: [1]) }
+    assert_raise(ArgumentError) { [1.0].each.mean(algorithm: :pairwise, population: true) }
+  end
+
+  data("floats", Array.new(300_001) { rand * 10.0**rand(-8..8) })
+  data("floats with NaN", Array.new(300_000) { rand }.insert(12_345, Float::NAN))
+  def test_parallel(ary)
+    EnumerableStatistics.gvl_release_threshold = nil
+    expected = [ary.sum(algorithm: :pairwise), ary.mean(skip_na: true, algorithm: :pairwise)]
+    EnumerableStatistics.gvl_release_threshold = 0
+    [1, 2, 3, 4, 7, 16].each do |k|
+      EnumerableStatistics.parallelism = k
+      actual = [ary.sum(algorithm: :pairwise), ary.mean(skip_na: true, algorithm: :pairwise)]
+      assert_equal(expected.map(&:to_s), actual.map(&:to_s), "parallelism = #{k}")
+    end
+  end
+end
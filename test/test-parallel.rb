@@ -0,0 +1,81 @@
+class ParallelReductionTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def setup
+    super
+    EnumerableStatistics.gvl_release_threshold = 0
+  end
+
+  def calculate(ary)
+    [
+      ary.sum,
+      ary.sum(0.5),
+      ary.sum(skip_na: true),
+      ary.mean(skip_na: true),
+      ary.mean_variance,
+      ary.variance(skip_na: true),
+      ary.moments(skip_na: true),
+    ]
+  end
+
+  def test_parallelism
+    assert_equal(1, @parallelism)
+    EnumerableStatistics.parallelism = 4
+    assert_equal(4, EnumerableStatistics.parallelism)
+    assert_raise(ArgumentError) do
+      EnumerableStatistics.parallelism = 0
+    end
+    assert_raise(ArgumentError) do
+      EnumerableStatistics.parallelism = 257
+    end
+  end
+
+  data("floats", Array.new(100_000) { rand })
+  data("floats and integers", Array.new(100_000) { |i| i.even? ? rand(10) : rand })
+  data("floats with NaN", Array.new(100_000) { rand }.insert(50_000, Float::NAN))
+  def test_same_results(ary)
+    EnumerableStatistics.parallelism = 1
+    expected = calculate(ary)
+    EnumerableStatistics.parallelism = 4
+    actual = calculate(ary)
+    expected.flatten.zip(actual.flatten) do |e, a|
+      if e.nan?
+        assert_predicate(a, :nan?)
+      else
+        # skewness and kurtosis can be close to zero
+        assert_in_delta(e, a, [e.abs * 1e-12, 1e-12].max)
+      end
+    end
+  end
+
+  def test_deterministic
+    ary = Array.new(100_000) { rand * 1e6 }
+    EnumerableStatistics.parallelism = 5
+    expected = calculate(ary)
+    10.times do
+      assert_equal(expected, calculate(ary))
+    end
+  end
+
+  def test_skip_na_count
+    ary = Array.new(100_000) { |i| i % 1000 == 0 ? Float::NAN : 1.0 }
+    EnumerableStatistics.parallelism = 4
+    assert_equal([1.0, 0.0], ary.mean_variance(skip_na: true))
+    assert_equal(99_900.0, ary.sum(skip_na: true))
+  end
+
+  data("random", Array.new(100_001) { rand })
+  data("even length", Array.new(100_000) { rand })
+  data("few distinct values", Array.new(100_000) { rand(3).to_f })
+  data("constant", Array.new(100_000, 1.5))
+  data("sorted", Array.new(100_000) { |i| i * 0.5 })
+  data("reversed", Array.new(100_000) { |i| -i * 0.5 })
+  def test_same_order_statistics(ary)
+    qs = [[0, 0.1, 25, 50, 75, 99.9, 100], Array.new(201) { |i| i / 2.0 }]
+    EnumerableStatistics.parallelism = 1
+    expected = [ary.median, ary.percentile(37), *qs.map { |q| ary.percentile(q) }]
+    EnumerableStatistics.parallelism = 4
+    actual = [ary.median, ary.percentile(37), *qs.map { |q| ary.percentile(q) }]
+    assert_equal(expected, actual)
+  end
+end
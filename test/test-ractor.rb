@@ -9,4 +9,32 @@ class RactorTest < Test::Unit::TestCase
     end
     assert_equal(2.5, r.take)
   end
+
+  test("settings are set only by the main Ractor") do
+    r = Ractor.new do
+      [:gvl_release_threshold=, :parallelism=].map do |name|
+        EnumerableStatistics.public_send(name, 2)
+      rescue Ractor::UnsafeError => e
+        e.class
+      end
+    end
+    assert_equal([Ractor::UnsafeError, Ractor::UnsafeError], r.take)
+    assert_equal(100_000, EnumerableStatistics.gvl_release_threshold)
+    assert_equal(1, EnumerableStatistics.parallelism)
+  end
+
+  test("NumericBuffer") do
+    buf = EnumerableStatistics::NumericBuffer.new(Array.new(1000) { |i| i.to_f })
+    assert_true(Ractor.shareable?(buf))
+    rs = 4.times.map do |i|
+      Ractor.new(buf.slice(i * 250, 250)) do |shard|
+        [shard.mean_variance, shard.histogram(edges: [0, 500, 1000]).weights]
+      end
+    end
+    assert_equal([[[124.5, 5229.166666666667], [250, 0]],
+                  [[374.5, 5229.166666666667], [250, 0]],
+                  [[624.5, 5229.166666666667], [0, 250]],
+                  [[874.5, 5229.166666666667], [0, 250]]],
+                 rs.map(&:take))
+  end
 end
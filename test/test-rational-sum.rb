@@ -0,0 +1,32 @@
+class RationalSumTest < Test::Unit::TestCase
+  data("same denominators", Array.new(1000) { |i| Rational(i * 7 - 3000, 100) })
+  data("divisors of a denominator", Array.new(1000) { |i| Rational(i, 100) })
+  data("coprime denominators", Array.new(200) { |i| Rational(1, i + 1) })
+  data("large denominators", Array.new(200) { |i| Rational(i + 1, 2**61 + i) })
+  data("large numerators", [Rational(2**61, 3)] * 300)
+  data("bignum components", [Rational(2**100, 3), Rational(1, 2**70), Rational(5, 7)])
+  data("with integers", [Rational(1, 3), 2, Rational(1, 6), 2**64, Rational(-1, 2)])
+  data("cancelling", [Rational(1, 2), Rational(1, 2)])
+  def test_sum(ary)
+    expected = ary.inject(:+)
+    assert_equal(expected, ary.sum)
+    assert_equal(expected.class, ary.sum.class)
+    assert_equal(expected, ary.each.sum)
+    assert_equal(expected + Rational(1, 3), ary.sum(Rational(1, 3)))
+    assert_equal(expected.to_f, ary.sum(0.0))
+    assert_equal(expected, ary.cumsum.last)
+  end
+
+  def test_float_after_rationals
+    ary = [Rational(1, 3), Rational(1, 6), 0.25]
+    assert_equal(Rational(1, 2) + 0.25, ary.sum)
+    assert_equal(Rational(1, 2) + 0.25, ary.each.sum)
+  end
+
+  def test_exact_variance
+    ary = Array.new(100) { |i| Rational(i, 7) }
+    mean = ary.inject(:+) / ary.size
+    variance = ary.inject(0) { |s, x| s + (x - mean)**2 } / (ary.size - 1)
+    assert_equal([mean, variance], ary.mean_variance(exact: true))
+  end
+end
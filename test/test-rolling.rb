@@ -0,0 +1,173 @@
+class RollingTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def naive(ary, window, min_periods: window)
+    Array.new(ary.size) do |i|
+      values = ary[[i - window + 1, 0].max..i].reject { |x| x.nil? || x.to_f.nan? }
+      values.size < min_periods ? Float::NAN : yield(values)
+    end
+  end
+
+  def assert_series(expected, actual, delta = 1e-9)
+    assert_equal(expected.size, actual.size)
+    expected.zip(actual).each_with_index do |(e, a), i|
+      if e.nan?
+        assert_predicate(a, :nan?, "at #{i}")
+      else
+        assert_in_delta(e, a, delta, "at #{i}")
+      end
+    end
+  end
+
+  data("small window", [3, [1, 2, 3, 4, 5, 6, 7]])
+  data("window 1", [1, [1.5, 2, 3.5]])
+  data("window larger than array", [10, [1, 2, 3]])
+  data("random", [7, Array.new(100) { rand * 100 }])
+  def test_rolling(data)
+    window, ary = data
+    assert_series(naive(ary, window) { |v| v.sum.to_f }, ary.rolling_sum(window))
+    assert_series(naive(ary, window) { |v| v.mean }, ary.rolling_mean(window))
+    assert_series(naive(ary, window) { |v| v.size < 2 ? Float::NAN : v.variance },
+                  ary.rolling_variance(window))
+    assert_series(naive(ary, window) { |v| m = v.mean; v.sum { |x| (x - m)**2 } / v.size },
+                  ary.rolling_variance(window, population: true))
+    assert_series(naive(ary, window) { |v| v.size < 2 ? Float::NAN : v.stdev },
+                  ary.rolling_stdev(window))
+  end
+
+  def test_min_periods
+    ary = [1, 2, nil, 4, Float::NAN, 6, 7]
+    assert_series(naive(ary, 3, min_periods: 1) { |v| v.sum.to_f },
+                  ary.rolling_sum(3, min_periods: 1))
+    assert_series(naive(ary, 3, min_periods: 2) { |v| v.mean },
+                  ary.rolling_mean(3, min_periods: 2))
+    assert_equal([1.0, 3.0, 3.0, 6.0, 4.0, 10.0, 13.0], ary.rolling_sum(3, min_periods: 0))
+    assert_equal([0.0, 0.0], [nil, nil].rolling_sum(2, min_periods: 0))
+    assert_series([Float::NAN, Float::NAN], [nil, nil].rolling_mean(2, min_periods: 0))
+  end
+
+  def test_drift
+    ary = Array.new(5_000) { 1e9 + rand * 1e6 } + Array.new(5_000) { rand }
+    expected = naive(ary.last(500), 50) { |v| v.variance }.last(400)
+    assert_series(expected, ary.rolling_variance(50).last(400), 1e-12)
+  end
+
+  def test_offset
+    ary = Array.new(2_000) { 1e9 + rand }
+    expected = naive(ary, 50) { |v| v.map { |x| x - v[0] }.variance }
+    actual = ary.rolling_variance(50)
+    expected.zip(actual).drop(49).each do |e, a|
+      assert_in_delta(0, (a - e) / e, 1e-12)
+    end
+  end
+
+  def test_block
+    rows = [{ v: 1 }, { v: 2 }, { v: nil }, { v: 4 }, { v: 5 }]
+    values = rows.map { |r| r[:v] }
+    assert_series(values.rolling_sum(2, min_periods: 1), rows.rolling_sum(2, min_periods: 1) { |r| r[:v] })
+    assert_series(values.rolling_mean(2), rows.rolling_mean(2) { |r| r[:v] })
+    assert_series(values.rolling_variance(3, min_periods: 2), rows.rolling_variance(3, min_periods: 2) { |r| r[:v] })
+    assert_series(values.rolling_stdev(3, min_periods: 2), rows.rolling_stdev(3, min_periods: 2) { |r| r[:v] })
+  end
+
+  def test_large_array
+    EnumerableStatistics.gvl_release_threshold = 0
+    ary = Array.new(500) { rand }
+    assert_series(naive(ary, 20) { |v| v.mean }, ary.rolling_mean(20))
+  end
+
+  def test_empty
+    assert_equal([], [].rolling_mean(3))
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) do
+      [1, 2].rolling_mean(0)
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].rolling_mean(2, min_periods: 3)
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].rolling_mean(2, min_periods: -1)
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].rolling_mean(2, population: true)
+    end
+    assert_raise(TypeError) do
+      [1, 2].rolling_mean(1.5)
+    end
+  end
+end
+
+class RollingPercentileTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def naive(ary, window, q, min_periods: window)
+    Array.new(ary.size) do |i|
+      values = ary[[i - window + 1, 0].max..i]
+      if values.size < min_periods
+        Float::NAN
+      else
+        values.percentile(q).to_f
+      end
+    end
+  end
+
+  def assert_series(expected, actual)
+    assert_equal(expected.size, actual.size)
+    expected.zip(actual).each_with_index do |(e, a), i|
+      if e.nan?
+        assert_predicate(a, :nan?, "at #{i}")
+      else
+        assert_in_delta(e, a, 1e-12, "at #{i}")
+      end
+    end
+  end
+
+  data("small window", [3, [5, 1, 4, 2, 3, 9, 0]])
+  data("window 1", [1, [1.5, 2, 3.5]])
+  data("window larger than array", [10, [3, 1, 2]])
+  data("ties", [4, Array.new(50) { rand(3) }])
+  data("random", [8, Array.new(200) { rand * 100 }])
+  def test_rolling_percentile(data)
+    window, ary = data
+    assert_series(naive(ary, window, 50), ary.rolling_median(window))
+    [0, 10, 25, 33.3, 75, 100].each do |q|
+      assert_series(naive(ary, window, q), ary.rolling_percentile(window, q))
+    end
+    assert_series(naive(ary, window, 40, min_periods: 1),
+                  ary.rolling_percentile(window, 40, min_periods: 1))
+  end
+
+  def test_na
+    ary = [1, 2, nil, 4, 5, Float::NAN, 7, 8, 9]
+    expected = [Float::NAN, 1.5, Float::NAN, Float::NAN, 4.5, Float::NAN, Float::NAN, 7.5, 8.5]
+    assert_series(expected, ary.rolling_median(2))
+  end
+
+  def test_block
+    rows = [5, 1, nil, 2, 3, 9, 0].map { |x| { v: x } }
+    values = rows.map { |r| r[:v] }
+    assert_series(values.rolling_median(3), rows.rolling_median(3) { |r| r[:v] })
+    assert_series(values.rolling_percentile(2, 25), rows.rolling_percentile(2, 25) { |r| r[:v] })
+  end
+
+  def test_large_array
+    EnumerableStatistics.gvl_release_threshold = 0
+    ary = Array.new(500) { rand }
+    assert_series(naive(ary, 25, 50), ary.rolling_median(25))
+  end
+
+  def test_errors
+    assert_equal([], [].rolling_median(3))
+    assert_raise(ArgumentError) do
+      [1, 2].rolling_median(0)
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].rolling_percentile(2, 101)
+    end
+    assert_raise(TypeError) do
+      [1, 2].rolling_median(2.0)
+    end
+  end
+end
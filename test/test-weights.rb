@@ -0,0 +1,128 @@
+class WeightsTest < Test::Unit::TestCase
+  include GlobalSettingsFixture
+
+  def setup
+    super
+    @values = [3.5, 1.0, 4.0, 1.5, 5.0, 9.0, 2.5]
+    @counts = [2, 1, 0, 3, 1, 4, 2]
+    @expanded = @values.zip(@counts).flat_map { |x, c| [x] * c }
+  end
+
+  def test_mean_variance
+    assert_in_delta(@expanded.mean, @values.mean(weights: @counts), 1e-12)
+    assert_in_delta(@expanded.variance, @values.variance(weights: @counts), 1e-12)
+    assert_in_delta(@expanded.variance(population: true),
+                    @values.variance(weights: @counts, population: true), 1e-12)
+    assert_in_delta(@expanded.stdev, @values.stdev(weights: @counts), 1e-12)
+    m, v = @values.mean_variance(weights: @counts)
+    assert_in_delta(@expanded.mean, m, 1e-12)
+    assert_in_delta(@expanded.variance, v, 1e-12)
+    m, s = @values.mean_stdev(weights: @counts)
+    assert_in_delta(@expanded.mean, m, 1e-12)
+    assert_in_delta(@expanded.stdev, s, 1e-12)
+  end
+
+  def test_unit_weights
+    ones = [1] * @values.size
+    assert_in_delta(@values.mean, @values.mean(weights: ones), 1e-12)
+    assert_in_delta(@values.variance, @values.variance(weights: ones), 1e-12)
+    assert_equal(@values.median, @values.median(weights: ones))
+    assert_equal(@values.percentile([0, 10, 33, 50, 90, 100]),
+                 @values.percentile([0, 10, 33, 50, 90, 100], weights: ones))
+  end
+
+  def test_fractional_weights
+    assert_in_delta(2.0, [1, 3].mean(weights: [0.25, 0.25]), 1e-12)
+    assert_in_delta(2.375, [1.0, 2.0, 3.0].mean(weights: [0.5, 1.5, 2.0]), 1e-12)
+  end
+
+  def test_percentile
+    qs = [0, 5, 25, 37.5, 50, 75, 99, 100]
+    assert_equal(@expanded.percentile(qs), @values.percentile(qs, weights: @counts))
+    assert_equal(@expanded.percentile(40), @values.percentile(40, weights: @counts))
+    assert_equal(@expanded.median, @values.median(weights: @counts))
+    assert_equal(2.0, [1, 2, 3].median(weights: [1, 3, 1]))
+  end
+
+  def test_large_array
+    EnumerableStatistics.gvl_release_threshold = 0
+    values = Array.new(1000) { rand }
+    weights = Array.new(1000) { rand(4) }
+    expanded = values.zip(weights).flat_map { |x, c| [x] * c }
+    assert_in_delta(expanded.mean, values.mean(weights: weights), 1e-12)
+    assert_in_delta(expanded.variance, values.variance(weights: weights), 1e-12)
+    assert_equal(expanded.percentile([10, 50, 90]), values.percentile([10, 50, 90], weights: weights))
+  end
+
+  def test_na
+    assert_equal(2.0, [1.0, nil, 3.0].mean(weights: [1, 5, 1], skip_na: true))
+    assert_predicate([1.0, Float::NAN, 3.0].mean(weights: [1, 1, 1]), :nan?)
+    assert_equal(2.0, [1.0, Float::NAN, 3.0].mean(weights: [1, 0, 1]))
+    assert_predicate([1.0, Float::NAN, 3.0].median(weights: [1, 1, 1]), :nan?)
+  end
+
+  def test_percentile_na
+    assert_predicate([1.0, nil, 3.0].percentile(50), :nan?)
+    assert_predicate([1.0, nil, 3.0].percentile(50, weights: [1, 1, 1]), :nan?)
+    assert_predicate([1.0, nil, Float::NAN].median(weights: [1, 1, 1]), :nan?)
+    assert_equal([2.0, 2.0],
+                 [1.0, nil, 3.0, Float::NAN].percentile([50, 50], weights: [1, 0, 1, 0]))
+  end
+
+  def test_empty
+    assert_equal(0.0, [].mean(weights: []))
+    assert_predicate([].variance(weights: []), :nan?)
+    assert_predicate([1.0].variance(weights: [1]), :nan?)
+    assert_equal(0.0, [1.0].variance(weights: [1], population: true))
+    assert_predicate([].median(weights: []), :nan?)
+    assert_raise(ArgumentError) do
+      [1, 2].percentile(50, weights: [0, 0])
+    end
+  end
+
+  def test_with_key
+    rows = [{ x: 1.0, n: 3 }, { x: 2.0, n: 1 }]
+    assert_equal(1.25, rows.mean(key: :x, weights: rows.map { |r| r[:n] }))
+  end
+
+  def test_errors
+    assert_raise(ArgumentError) do
+      [1, 2].mean(weights: [1])
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].variance(weights: [1, -1])
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].median(weights: [1, Float::NAN])
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].percentile(50, weights: [1, Float::INFINITY])
+    end
+    assert_raise(TypeError) do
+      [1, 2].mean(weights: [1, nil])
+    end
+    assert_raise(TypeError) do
+      [1, 2].mean(weights: 5)
+    end
+    assert_raise(TypeError) do
+      [1, 2].median(weights: "1,1")
+    end
+    assert_raise(TypeError) do
+      [1, 2].histogram(weights: 5)
+    end
+    assert_raise(ArgumentError) do
+      [1, 2].median(foo: 1)
+    end
+  end
+
+  def test_weights_changed_in_block
+    weights = [1, 1, 1, 1, 1]
+    assert_raise(ArgumentError) do
+      [1, 2, 3, 4, 5].mean(weights: weights) { |x| weights.clear if x == 1; x }
+    end
+    weights = [1, 1, 1, 1, 1]
+    assert_raise(ArgumentError) do
+      [1, 2, 3, 4, 5].percentile(50, weights: weights) { |x| weights.pop; x }
+    end
+  end
+end
@@ -0,0 +1,53 @@
+class WideIntTest < Test::Unit::TestCase
+  def exact_variance(ary, ddof)
+    mean = ary.inject(:+).quo(ary.size)
+    ary.inject(0) { |s, x| s + (x - mean)**2 }.quo(ary.size - ddof)
+  end
+
+  data("fixnums", [1, 2, 3, 4])
+  data("fixnum overflow", Array.new(100) { |i| 2**62 - i })
+  data("small bignums", Array.new(100) { |i| 2**64 + i * 7 })
+  data("negative bignums", Array.new(100) { |i| -(2**90) + i })
+  data("huge bignums", [2**200, 1, -(2**200), 2**130, 3])
+  data("mixed signs", [2**62, -(2**62), 2**100, -(2**100), 5])
+  def test_sum(ary)
+    expected = ary.inject(:+)
+    assert_equal(expected, ary.sum)
+    assert_equal(expected, ary.each.sum)
+    assert_equal(expected, ary.describe[:sum])
+    assert_equal(expected + 1r/2, ary.sum(1r/2))
+  end
+
+  data("fixnums", [1, 2, 3, 4])
+  data("fixnum overflow", Array.new(100) { |i| 2**62 - i })
+  data("small bignums", Array.new(100) { |i| 2**64 + i * 7 })
+  data("huge bignums", [2**200, 1, -(2**200), 2**130, 3])
+  data("rationals", [1, 1r/3, 2**70, 5r/7])
+  def test_exact_mean_variance(ary)
+    mean = ary.inject(:+).quo(ary.size)
+    assert_equal(mean, ary.mean(exact: true))
+    assert_equal(exact_variance(ary, 1), ary.variance(exact: true))
+    assert_equal(exact_variance(ary, 0), ary.variance(exact: true, population: true))
+    assert_equal([mean, exact_variance(ary, 1)], ary.mean_variance(exact: true))
+    assert_equal(Math.sqrt(exact_variance(ary, 1)), ary.stdev(exact: true))
+  end
+
+  def test_exact_result_type
+    assert_equal(Rational(5, 2), [1, 2, 3, 4].mean(exact: true))
+    assert_kind_of(Rational, [2, 2].mean(exact: true))
+    assert_equal(Rational(0), [].mean(exact: true))
+    assert_predicate([1].variance(exact: true), :nan?)
+  end
+
+  def test_exact_options
+    assert_equal(Rational(2), [1, nil, 3].mean(exact: true, skip_na: true))
+    assert_equal(Rational(4), [1, 2, 3].mean(exact: true) { |x| x * 2 })
+    assert_equal(Rational(5, 2), [{v: 2}, {v: 3}].mean(exact: true, key: :v))
+    assert_equal(2.0, [1, 2, 3].mean(exact: false))
+  end
+
+  def test_exact_errors
+    assert_raise(TypeError) { [1, "2"].mean(exact: true) }
+    assert_raise(ArgumentError) { [1, 2].mean(exact: true, weights: [1, 1]) }
+  end
+end